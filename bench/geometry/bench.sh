@@ -0,0 +1,64 @@
+#!/bin/bash
+# P3D geometry kernels (bounding boxes, spheres, mass) on large LODs
+
+# Runs the binarization once per instruction set (see ARMAKESIMD) and checks
+# that all of them produce the same output. Set POINTS to change the number
+# of points per LOD.
+
+points=${POINTS:-1000000}
+
+mkdir -p /tmp/amkbench || exit 1
+
+# a visual and a geometry LOD with a mass per point, but only a single face
+# each, so most of the time goes to the per-point passes
+python3 - /tmp/amkbench/model.p3d $points <<'PY' || { rm -rf /tmp/amkbench; exit 1; }
+import array, math, struct, sys
+
+path, points = sys.argv[1], int(sys.argv[2])
+
+def tagg(name, data):
+    return b"\x01" + name.encode() + b"\0" + struct.pack("<I", len(data)) + data
+
+with open(path, "wb") as f:
+    f.write(b"MLOD" + struct.pack("<II", 257, 2))
+
+    for resolution in (0.0, 1e13):
+        coords = array.array("f")
+        for i in range(points):
+            coords.extend((math.sin(i * 0.001) * 5, math.cos(i * 0.0007) * 3, (i % 1000) * 0.01, 0.0))
+
+        f.write(b"P3DM" + struct.pack("<IIIIII", 0x1c, 0x100, points, 1, 1, 0))
+        f.write(coords.tobytes())
+        f.write(struct.pack("<fff", 0.0, 1.0, 0.0))
+        f.write(struct.pack("<I", 3) + b"".join(struct.pack("<IIff", p, 0, 0.0, 0.0) for p in (0, 1, 2, 0)) +
+                struct.pack("<I", 0) + b"\0\0")
+
+        f.write(b"TAGG")
+        if resolution > 0:
+            f.write(tagg("#Mass#", array.array("f", [1.0 + (i % 7) for i in range(points)]).tobytes()))
+        f.write(tagg("#EndOfFile#", b""))
+        f.write(struct.pack("<f", resolution))
+PY
+
+bench() {
+    start=$(date +%s%N)
+    ARMAKESIMD=$1 ./bin/armake binarize -f /tmp/amkbench/model.p3d /tmp/amkbench/$1.p3d || return 1
+    end=$(date +%s%N)
+
+    echo "    $1: $(( (end - start) / 1000000 )) ms ($points points per LOD)"
+}
+
+for simd in none sse2 avx2; do
+    bench $simd || {
+        rm -rf /tmp/amkbench
+        exit 1
+    }
+
+    cmp -s /tmp/amkbench/none.p3d /tmp/amkbench/$simd.p3d || {
+        echo "    $simd output differs from scalar output"
+        rm -rf /tmp/amkbench
+        exit 1
+    }
+done
+
+rm -rf /tmp/amkbench
@@ -0,0 +1,84 @@
+#!/bin/bash
+# P3D to ODOL conversion of high-poly LODs
+
+# Set ARMAKE_BASELINE to another armake binary to compare against it.
+# Set LODS and GRID to change the number of LODs and the number of quads
+# per LOD (GRID x GRID).
+
+lods=${LODS:-3}
+grid=${GRID:-200}
+
+mkdir -p /tmp/amkbench || exit 1
+
+# a grid of quads per LOD, with a separate normal per face, so corners shared
+# by several faces end up as several ODOL vertices
+python3 - /tmp/amkbench/model.p3d $lods $grid <<'PY' || { rm -rf /tmp/amkbench; exit 1; }
+import math, struct, sys
+
+path, lods, grid = sys.argv[1], int(sys.argv[2]), int(sys.argv[3])
+
+def tagg(name, data):
+    return b"\x01" + name.encode() + b"\0" + struct.pack("<I", len(data)) + data
+
+with open(path, "wb") as f:
+    f.write(b"MLOD" + struct.pack("<II", 257, lods))
+
+    for lod in range(lods):
+        n = grid + 1
+        points = b"".join(struct.pack("<fffI", x * 0.1, math.sin(x * 0.3) * math.cos(z * 0.2), z * 0.1, 0)
+                for z in range(n) for x in range(n))
+
+        normals = []
+        faces = []
+        for z in range(grid):
+            for x in range(grid):
+                normals.append(struct.pack("<fff", math.sin(x * 0.1), 1.0, math.cos(z * 0.1)))
+                corners = [(x, z), (x, z + 1), (x + 1, z + 1), (x + 1, z)]
+                table = b"".join(struct.pack("<IIff", cz * n + cx, len(normals) - 1, cx / grid, cz / grid)
+                        for cx, cz in corners)
+                faces.append(struct.pack("<I", 4) + table + struct.pack("<I", 0) +
+                        b"bench\\data\\grid_co.paa\0\0")
+
+        f.write(b"P3DM" + struct.pack("<IIIIII", 0x1c, 0x100, n * n, len(normals), len(faces), 0))
+        f.write(points)
+        f.write(b"".join(normals))
+        f.write(b"".join(faces))
+
+        f.write(b"TAGG")
+        f.write(tagg("#EndOfFile#", b""))
+        f.write(struct.pack("<f", float(lod)))
+PY
+
+bench() {
+    start=$(date +%s%N)
+    $1 binarize -f $4 /tmp/amkbench/model.p3d $2 || return 1
+    end=$(date +%s%N)
+
+    echo "    $3: $(( (end - start) / 1000000 )) ms ($(( (end - start) / 1000000 / lods )) ms per LOD, $((grid * grid)) faces each)"
+}
+
+bench ./bin/armake /tmp/amkbench/model_odol.p3d "binarize" || {
+    rm -rf /tmp/amkbench
+    exit 1
+}
+
+# prints the ACMR of every LOD as well
+bench ./bin/armake /tmp/amkbench/model_optimized.p3d "binarize --optimize-meshes" --optimize-meshes || {
+    rm -rf /tmp/amkbench
+    exit 1
+}
+
+if [ -n "$ARMAKE_BASELINE" ]; then
+    bench "$ARMAKE_BASELINE" /tmp/amkbench/baseline.p3d "baseline" || {
+        rm -rf /tmp/amkbench
+        exit 1
+    }
+
+    cmp -s /tmp/amkbench/model_odol.p3d /tmp/amkbench/baseline.p3d || {
+        echo "    output differs from baseline"
+        rm -rf /tmp/amkbench
+        exit 1
+    }
+fi
+
+rm -rf /tmp/amkbench
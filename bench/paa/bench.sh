@@ -0,0 +1,71 @@
+#!/bin/bash
+# DXT compression quality tiers
+
+# Set CORPUS to a directory of PNG textures to use instead of the test
+# images. RMSE is measured on the top mipmap against the source, over all
+# four channels.
+
+corpus=${CORPUS:-./test/paa}
+
+mkdir -p /tmp/amkbench || exit 1
+
+cat > /tmp/amkbench/rmse.c <<'C'
+#define STB_IMAGE_IMPLEMENTATION
+#include <math.h>
+#include <stdio.h>
+#include "stb_image.h"
+
+int main(int argc, char *argv[]) {
+    unsigned char *a;
+    unsigned char *b;
+    double sum = 0.0;
+    int w1, h1, w2, h2, c, i;
+
+    a = stbi_load(argv[1], &w1, &h1, &c, 4);
+    b = stbi_load(argv[2], &w2, &h2, &c, 4);
+    if (a == NULL || b == NULL || w1 != w2 || h1 != h2)
+        return 1;
+
+    for (i = 0; i < w1 * h1 * 4; i++)
+        sum += (double)(a[i] - b[i]) * (a[i] - b[i]);
+
+    printf("%.3f\n", sqrt(sum / (w1 * h1 * 4)));
+    return 0;
+}
+C
+cc -O2 -Ilib -o /tmp/amkbench/rmse /tmp/amkbench/rmse.c -lm || {
+    rm -rf /tmp/amkbench
+    exit 1
+}
+
+bench() {
+    total=0
+    errors=""
+
+    for source in $corpus/*.png; do
+        start=$(date +%s%N)
+        ARMAKESIMD=$2 ./bin/armake img2paa -f -q $1 $source /tmp/amkbench/out_$1.paa || return 1
+        end=$(date +%s%N)
+        total=$(( total + end - start ))
+
+        ./bin/armake paa2img -f /tmp/amkbench/out_$1.paa /tmp/amkbench/out_$1.png || return 1
+        errors="$errors $(/tmp/amkbench/rmse $source /tmp/amkbench/out_$1.png)" || return 1
+    done
+
+    rmse=$(echo $errors | awk '{ for (i = 1; i <= NF; i++) sum += $i; printf "%.3f", sum / NF }')
+    echo "    $1$3: $(( total / 1000000 )) ms, RMSE $rmse"
+}
+
+for quality in fast normal best; do
+    bench $quality || {
+        rm -rf /tmp/amkbench
+        exit 1
+    }
+done
+
+bench fast none " (no SIMD)" || {
+    rm -rf /tmp/amkbench
+    exit 1
+}
+
+rm -rf /tmp/amkbench
@@ -0,0 +1,41 @@
+#!/bin/bash
+# Preprocessor macro table (10k defines, 100k uses)
+
+mkdir -p /tmp/amkbench || exit 1
+
+awk 'BEGIN {
+    for (i = 0; i < 10000; i++) {
+        if (i % 2)
+            printf "#define MACRO_%i(x) x\n", i;
+        else
+            printf "#define MACRO_%i %i\n", i, i;
+    }
+}' > /tmp/amkbench/macros.hpp
+
+awk 'BEGIN {
+    print "#include \"macros.hpp\"";
+    print "class CfgBench {";
+    for (i = 0; i < 1000; i++) {
+        printf "    value%i[] = {", i;
+        for (j = 0; j < 100; j++) {
+            k = (i * 100 + j * 37) % 10000;
+            if (k % 2)
+                printf "%sMACRO_%i(%i)", (j ? ", " : ""), k, j;
+            else
+                printf "%sMACRO_%i", (j ? ", " : ""), k;
+        }
+        print "};";
+    }
+    print "};";
+}' > /tmp/amkbench/config.cpp
+
+start=$(date +%s%N)
+./bin/armake binarize -f /tmp/amkbench/config.cpp /tmp/amkbench/config.bin || {
+    rm -rf /tmp/amkbench
+    exit 1
+}
+end=$(date +%s%N)
+
+echo "    binarize: $(( (end - start) / 1000000 )) ms"
+
+rm -rf /tmp/amkbench
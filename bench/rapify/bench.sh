@@ -0,0 +1,51 @@
+#!/bin/bash
+# Rapification of a large class tree (50k classes)
+
+# Set ARMAKE_BASELINE to another armake binary to compare against it.
+
+mkdir -p /tmp/amkbench || exit 1
+
+awk 'BEGIN {
+    print "class CfgBench {";
+    print "    class Base0 { scope = 0; };";
+    for (i = 1; i < 25000; i++) {
+        printf "    class Vehicle%i: Base%i {\n", i, (i - 1) % 100;
+        printf "        displayName = \"Vehicle %i\";\n", i;
+        printf "        mass = %i;\n", i * 3;
+        printf "        speed = %i.5;\n", i % 200;
+        printf "        weapons[] = {\"Weapon%i\", \"Weapon%i\"};\n", i % 37, i % 53;
+        printf "        class Turret%i { gunner = \"Crew%i\"; elevation[] = {-5, 25.5}; };\n", i, i % 11;
+        print "    };";
+        if (i < 100)
+            printf "    class Base%i: Base0 { scope = 1; };\n", i;
+    }
+    print "};";
+}' > /tmp/amkbench/config.cpp
+
+bench() {
+    start=$(date +%s%N)
+    $1 binarize -f /tmp/amkbench/config.cpp $2 || return 1
+    end=$(date +%s%N)
+
+    echo "    $3: $(( (end - start) / 1000000 )) ms"
+}
+
+bench ./bin/armake /tmp/amkbench/config.bin "binarize" || {
+    rm -rf /tmp/amkbench
+    exit 1
+}
+
+if [ -n "$ARMAKE_BASELINE" ]; then
+    bench "$ARMAKE_BASELINE" /tmp/amkbench/baseline.bin "baseline" || {
+        rm -rf /tmp/amkbench
+        exit 1
+    }
+
+    cmp -s /tmp/amkbench/config.bin /tmp/amkbench/baseline.bin || {
+        echo "    output differs from baseline"
+        rm -rf /tmp/amkbench
+        exit 1
+    }
+fi
+
+rm -rf /tmp/amkbench
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+failed=0
+
+if [[ $# -ge 1 ]]; then
+    targets="./bench/${1/bench\-//}/"
+else
+    targets=$(ls -d ./bench/*/)
+fi
+
+for d in $targets ; do
+    name=$(sed -n 2p $d/bench.sh | tail -c +3)
+    echo " BENCH $name:"
+
+    $d/bench.sh
+
+    if [ $? -ne 0 ]; then
+        echo -e "\033[31mFAILED\033[0m"
+        failed=$((failed + 1))
+    fi
+done
+
+exit $failed
@@ -30,10 +30,16 @@ struct arguments {
     bool force;
     bool packonly;
     bool compress;
+    bool optimizemeshes;
+    bool verbose;
+    bool recursive;
     char *privatekey;
     char *signature;
     char *indent;
     char *paatype;
+    char *quality;
+    char *jobs;
+    char *cache;
     int num_mutedwarnings;
     char **mutedwarnings;
     int num_includefolders;
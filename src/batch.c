@@ -0,0 +1,219 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "stb_image.h"
+
+#include "args.h"
+#include "filesystem.h"
+#include "utils.h"
+#include "threads.h"
+#include "batch.h"
+
+
+int collect_conversion(char *root, char *source, char *conversions_ptr) {
+    /*
+     * Adds a conversion for the file if it has one of the source extensions
+     * and its target is missing or older than it (or --force is set).
+     */
+
+    extern struct arguments args;
+
+    struct conversions *conversions = (struct conversions *)conversions_ptr;
+    struct conversion *conversion;
+    char target[2048];
+    char containing[2048];
+    char *extension;
+    int64_t target_mtime;
+    int i;
+
+    extension = strrchr(source, '.');
+    if (extension == NULL || strchr(extension, PATHSEP) != NULL)
+        return 0;
+
+    for (i = 0; conversions->extensions[i] != NULL; i++) {
+        if (stricmp(extension + 1, conversions->extensions[i]) == 0)
+            break;
+    }
+    if (conversions->extensions[i] == NULL)
+        return 0;
+
+    snprintf(target, sizeof(target), "%s%.*s.%s", conversions->target_root,
+            (int)(extension - source - strlen(root)), source + strlen(root), conversions->target_extension);
+
+    target_mtime = get_file_mtime(target);
+    if (!args.force && target_mtime >= 0 && target_mtime >= get_file_mtime(source)) {
+        conversions->num_skipped++;
+        return 0;
+    }
+
+    strcpy(containing, target);
+    *strrchr(containing, PATHSEP) = 0;
+    if (create_folders(containing)) {
+        errorf("Failed to create folder %s.\n", containing);
+        return -1;
+    }
+
+    if (conversions->num_conversions % CONVERSIONINTERVAL == 0)
+        conversions->conversions = (struct conversion *)safe_realloc(conversions->conversions,
+                sizeof(struct conversion) * (conversions->num_conversions + CONVERSIONINTERVAL));
+
+    conversion = &conversions->conversions[conversions->num_conversions++];
+
+    strncpy(conversion->source, source, sizeof(conversion->source));
+    strncpy(conversion->target, target, sizeof(conversion->target));
+    conversion->time = 0.0;
+    conversion->num_pixels = 0;
+
+    return 0;
+}
+
+
+int conversion_job(int index, void *conversions_ptr) {
+    /*
+     * Runs the conversion with the given index and records how long it took
+     * and how many pixels the image (whichever side isn't the PAA) has.
+     *
+     * stb_image keeps its failure reason in a global that all conversion
+     * threads would share, so it is never read; conversions only report
+     * generic errors.
+     */
+
+    struct conversions *conversions = (struct conversions *)conversions_ptr;
+    struct conversion *conversion = &conversions->conversions[index];
+    char *image;
+    double start;
+    int success;
+    int w;
+    int h;
+    int num_channels;
+
+    start = get_milliseconds();
+    // files are already converted in parallel, so every one gets a single thread
+    success = conversions->convert(conversion->source, conversion->target, 1);
+    conversion->time = get_milliseconds() - start;
+
+    if (success)
+        return success;
+
+    image = (stricmp(conversions->target_extension, "paa") == 0) ? conversion->source : conversion->target;
+    if (stbi_info(image, &w, &h, &num_channels))
+        conversion->num_pixels = (int64_t)w * h;
+
+    return 0;
+}
+
+
+int convert_directory(char *source, char *target, char **extensions, char *target_extension,
+        int (*convert)(char *, char *, int)) {
+    /*
+     * Converts every file in the source folder with one of the given
+     * extensions (NULL terminated) to the same path in the target folder,
+     * with the target extension. convert is called with the source, the
+     * target and the number of threads to use. Files are converted in
+     * parallel on -j threads, each one on a single thread, and targets that
+     * aren't older than their source are skipped unless --force is set.
+     *
+     * Prints the number of converted files, the throughput in MPix/s and
+     * the average time per file (and with --verbose the time for every
+     * file).
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    extern struct arguments args;
+
+    struct conversions conversions;
+    char source_root[2048];
+    char target_root[2048];
+    double start;
+    double elapsed;
+    double time_sum;
+    int64_t num_pixels;
+    int *results;
+    int failed;
+    int i;
+
+    strncpy(source_root, source, sizeof(source_root) - 1);
+    source_root[sizeof(source_root) - 1] = 0;
+    strncpy(target_root, target, sizeof(target_root) - 1);
+    target_root[sizeof(target_root) - 1] = 0;
+
+    // Remove trailing path seperators
+    if (strlen(source_root) > 1 && source_root[strlen(source_root) - 1] == PATHSEP)
+        source_root[strlen(source_root) - 1] = 0;
+    if (strlen(target_root) > 1 && target_root[strlen(target_root) - 1] == PATHSEP)
+        target_root[strlen(target_root) - 1] = 0;
+
+    conversions.num_conversions = 0;
+    conversions.conversions = NULL;
+    conversions.num_skipped = 0;
+    conversions.target_root = target_root;
+    conversions.extensions = extensions;
+    conversions.target_extension = target_extension;
+    conversions.convert = convert;
+
+    start = get_milliseconds();
+
+    if (traverse_directory(source_root, collect_conversion, (char *)&conversions)) {
+        errorf("Failed to collect files to convert.\n");
+        free(conversions.conversions);
+        return 1;
+    }
+
+    results = (int *)safe_malloc(sizeof(int) * MAX(conversions.num_conversions, 1));
+
+    run_parallel(conversions.num_conversions, get_num_jobs(), conversion_job, &conversions, results);
+
+    elapsed = get_milliseconds() - start;
+
+    failed = 0;
+    time_sum = 0.0;
+    num_pixels = 0;
+    for (i = 0; i < conversions.num_conversions; i++) {
+        if (results[i]) {
+            errorf("Failed to convert %s.\n", conversions.conversions[i].source);
+            failed++;
+            continue;
+        }
+
+        time_sum += conversions.conversions[i].time;
+        num_pixels += conversions.conversions[i].num_pixels;
+
+        if (args.verbose)
+            infof("%s: %.1f ms\n", conversions.conversions[i].target, conversions.conversions[i].time);
+    }
+
+    infof("Converted %i file(s), skipped %i up to date, %i failed.\n",
+            conversions.num_conversions - failed, conversions.num_skipped, failed);
+
+    if (conversions.num_conversions > failed) {
+        infof("%.1f MPix in %.1f s: %.1f MPix/s, %.1f ms per file.\n", num_pixels / 1000000.0, elapsed / 1000.0,
+                num_pixels / 1000.0 / MAX(elapsed, 1.0), time_sum / (conversions.num_conversions - failed));
+    }
+
+    free(results);
+    free(conversions.conversions);
+
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+
+#define CONVERSIONINTERVAL 64
+
+
+struct conversion {
+    char source[2048];
+    char target[2048];
+    double time;
+    int64_t num_pixels;
+};
+
+struct conversions {
+    int num_conversions;
+    struct conversion *conversions;
+    int num_skipped;
+    char *target_root;
+    char **extensions;
+    char *target_extension;
+    int (*convert)(char *, char *, int);
+};
+
+
+int collect_conversion(char *root, char *source, char *conversions_ptr);
+
+int conversion_job(int index, void *conversions_ptr);
+
+int convert_directory(char *source, char *target, char **extensions, char *target_extension,
+        int (*convert)(char *, char *, int));
@@ -37,6 +37,8 @@
 #include "rapify.h"
 #include "p3d.h"
 #include "binarize.h"
+#include "cache.h"
+#include "threads.h"
 #include "utils.h"
 
 
@@ -88,7 +90,6 @@ int attempt_bis_binarize(char *source, char *target) {
      * success and a positive integer on failure.
      */
 
-    extern char *current_target;
     SECURITY_ATTRIBUTES secattr = { sizeof(secattr) };
     STARTUPINFO info = { sizeof(info) };
     PROCESS_INFORMATION processInfo;
@@ -96,9 +97,9 @@ int attempt_bis_binarize(char *source, char *target) {
     long success;
     int32_t num_lods;
     int i;
-    int j;
     int k;
     bool is_rtm;
+    bool *used;
     char command[2048];
     char temp[2048];
     char tempfolder[2048];
@@ -108,6 +109,7 @@ int attempt_bis_binarize(char *source, char *target) {
     char *root;
     FILE *f_source;
     struct mlod_lod *mlod_lods;
+    struct string_table strings;
 
     current_target = source;
 
@@ -146,58 +148,50 @@ int attempt_bis_binarize(char *source, char *target) {
         fseek(f_source, 8, SEEK_SET);
         fread(&num_lods, 4, 1, f_source);
         mlod_lods = (struct mlod_lod *)safe_malloc(sizeof(struct mlod_lod) * num_lods);
-        num_lods = read_lods(f_source, mlod_lods, num_lods);
+        string_table_init(&strings);
+        num_lods = read_lods(f_source, mlod_lods, num_lods, &strings);
         fflush(stdout);
         if (num_lods < 0) {
             printf("Source file seems to be invalid P3D.\n");
+            fclose(f_source);
+            free(mlod_lods);
+            string_table_free(&strings);
             return 2;
         }
 
         fclose(f_source);
 
-        memset(dependencies, 0, sizeof(dependencies));
+        // the string table holds the face texture and material names of all
+        // LODs, including the edit LODs read_lods discards
+        used = (bool *)safe_malloc(sizeof(bool) * strings.num_strings);
+        memset(used, 0, sizeof(bool) * strings.num_strings);
         for (i = 0; i < num_lods; i++) {
-            for (j = 0; j < mlod_lods[i].num_faces; j++) {
-                if (strlen(mlod_lods[i].faces[j].texture_name) > 0 && mlod_lods[i].faces[j].texture_name[0] != '#') {
-                    for (k = 0; k < MAXTEXTURES; k++) {
-                        if (dependencies[k] == 0)
-                            break;
-                        if (stricmp(mlod_lods[i].faces[j].texture_name, dependencies[k]) == 0)
-                            break;
-                    }
-                    if (k < MAXTEXTURES && dependencies[k] == 0) {
-                        dependencies[k] = (char *)safe_malloc(2048);
-                        strcpy(dependencies[k], mlod_lods[i].faces[j].texture_name);
-                    }
-                }
-                if (strlen(mlod_lods[i].faces[j].material_name) > 0 && mlod_lods[i].faces[j].material_name[0] != '#') {
-                    for (k = 0; k < MAXTEXTURES; k++) {
-                        if (dependencies[k] == 0)
-                            break;
-                        if (stricmp(mlod_lods[i].faces[j].material_name, dependencies[k]) == 0)
-                            break;
-                    }
-                    if (k < MAXTEXTURES && dependencies[k] == 0) {
-                        dependencies[k] = (char *)safe_malloc(2048);
-                        strcpy(dependencies[k], mlod_lods[i].faces[j].material_name);
-                    }
-                }
+            for (k = 0; k < mlod_lods[i].num_faces; k++) {
+                used[mlod_lods[i].faces[k].texture_name] = true;
+                used[mlod_lods[i].faces[k].material_name] = true;
             }
+            free_mlod_lod(&mlod_lods[i]);
+        }
+        free(mlod_lods);
 
-            free(mlod_lods[i].points);
-            free(mlod_lods[i].facenormals);
-            free(mlod_lods[i].faces);
-            free(mlod_lods[i].mass);
-            free(mlod_lods[i].sharp_edges);
-
-            for (j = 0; j < mlod_lods[i].num_selections; j++) {
-                free(mlod_lods[i].selections[j].points);
-                free(mlod_lods[i].selections[j].faces);
+        memset(dependencies, 0, sizeof(dependencies));
+        for (i = 1; i < strings.num_strings; i++) {
+            if (!used[i] || strings.strings[i][0] == '#')
+                continue;
+            for (k = 0; k < MAXTEXTURES; k++) {
+                if (dependencies[k] == 0)
+                    break;
+                if (stricmp(strings.strings[i], dependencies[k]) == 0)
+                    break;
+            }
+            if (k < MAXTEXTURES && dependencies[k] == 0) {
+                dependencies[k] = (char *)safe_malloc(2048);
+                strcpy(dependencies[k], strings.strings[i]);
             }
-
-            free(mlod_lods[i].selections);
         }
-        free(mlod_lods);
+
+        free(used);
+        string_table_free(&strings);
     }
 
     // Create a temporary folder to isolate the target file and copy it there
@@ -240,12 +234,14 @@ int attempt_bis_binarize(char *source, char *target) {
     strcpy(filename, tempfolder);
     strcat(filename, "config.cpp");
     copy_file(temp, filename);
+    cache_add_dependency(temp);
 
     strcpy(temp, root);
     strcat(temp, "model.cfg");
     strcpy(filename, tempfolder);
     strcat(filename, "model.cfg");
     copy_file(temp, filename);
+    cache_add_dependency(temp);
 
     free(root);
 
@@ -265,6 +261,8 @@ int attempt_bis_binarize(char *source, char *target) {
                 continue;
             }
 
+            cache_add_dependency(temp);
+
             strcpy(filename, tempfolder);
             strcat(filename, dependencies[i]);
 
@@ -342,11 +340,31 @@ int attempt_bis_binarize(char *source, char *target) {
 #endif
 
 
-int binarize(char *source, char *target) {
+bool binarizable(char *path) {
+    /*
+     * Returns true if binarize() knows how to handle the given file type.
+     */
+
+    char *fileext;
+
+    fileext = strrchr(path, '.');
+    if (fileext == NULL)
+        return false;
+
+    return (!strcmp(fileext, ".cpp") ||
+            !strcmp(fileext, ".rvmat") ||
+            !strcmp(fileext, ".ext") ||
+            !strcmp(fileext, ".p3d") ||
+            !strcmp(fileext, ".rtm"));
+}
+
+
+int binarize_file(char *source, char *target, int num_threads) {
     /*
      * Binarize the given file. If source and target are identical, the target
-     * is overwritten. If the source is a P3D, it is converted to ODOL. If the
-     * source is a rapifiable type (cpp, ext, etc.), it is rapified.
+     * is overwritten. If the source is a P3D, it is converted to ODOL on up
+     * to num_threads threads. If the source is a rapifiable type (cpp, ext,
+     * etc.), it is rapified.
      *
      * If the file type is not recognized, -1 is returned. 0 is returned on
      * success and a positive integer on error.
@@ -380,20 +398,55 @@ int binarize(char *source, char *target) {
         }
 #endif
         if (!strcmp(fileext, ".p3d"))
-            return mlod2odol(source, target);
+            return mlod2odol(source, target, num_threads);
     }
 
     return -1;
 }
 
 
+int binarize(char *source, char *target, int num_threads) {
+    /*
+     * Binarizes the given file like binarize_file. If a binarization cache
+     * is configured, the result is taken from the cache when neither the
+     * source nor any file read while binarizing it changed, and stored in
+     * it otherwise.
+     */
+
+    struct cache_entry entry;
+    char *cache_dir;
+    int success;
+
+    cache_dir = get_cache_dir();
+    if (cache_dir == NULL || strcmp(target, "-") == 0 || !binarizable(source))
+        return binarize_file(source, target, num_threads);
+
+    success = cache_lookup(cache_dir, source, target, &entry);
+    if (success == 0)
+        return 0;
+    if (success < 0)
+        return binarize_file(source, target, num_threads);
+
+    cache_start_recording(&entry);
+    success = binarize_file(source, target, num_threads);
+    cache_stop_recording();
+
+    if (success == 0 && cache_store(cache_dir, &entry, target))
+        lwarningf(source, -1, "Failed to store binarized file in cache.\n");
+
+    cache_entry_free(&entry);
+
+    return success;
+}
+
+
 int cmd_binarize() {
     int success;
 
     if (args.num_positionals == 1) {
         return 128;
     } else if (args.num_positionals == 2) {
-        success = binarize(args.positionals[1], "-");
+        success = binarize(args.positionals[1], "-", get_num_jobs());
     } else {
         // check if target already exists
         if (access(args.positionals[2], F_OK) != -1 && !args.force) {
@@ -401,7 +454,7 @@ int cmd_binarize() {
             return 1;
         }
 
-        success = binarize(args.positionals[1], args.positionals[2]);
+        success = binarize(args.positionals[1], args.positionals[2], get_num_jobs());
     }
 
     if (success == -1) {
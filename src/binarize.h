@@ -19,6 +19,13 @@
 #pragma once
 
 
-int binarize(char *source, char *target);
+#include <stdbool.h>
+
+
+bool binarizable(char *path);
+
+int binarize_file(char *source, char *target, int num_threads);
+
+int binarize(char *source, char *target, int num_threads);
 
 int cmd_binarize();
@@ -17,6 +17,7 @@
  */
 
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -30,9 +31,11 @@
 #include "sha1.h"
 #include "args.h"
 #include "binarize.h"
+#include "cache.h"
 #include "filesystem.h"
 #include "utils.h"
 #include "sign.h"
+#include "threads.h"
 #include "build.h"
 
 
@@ -52,37 +55,81 @@ bool file_allowed(char *filename) {
 }
 
 
-int binarize_callback(char *root, char *source, char *junk) {
-    int success;
-    char target[2048];
-    char filename[1024];
+int compare_pbo_paths(const char *a, const char *b) {
+    /*
+     * Orders paths like the depth-first directory traversal would visit
+     * them. That compares lower cased names on POSIX (alphasort_ci) and
+     * upper cased ones on Windows, where FindFirstFile returns NTFS folders
+     * in that order (so "ab" comes before "a_b" there, but after it here).
+     */
 
-    filename[0] = 0;
-    strcat(filename, source + strlen(root) + 1);
+    size_t len_a;
+    size_t len_b;
+    size_t i;
+    int diff;
 
-    if (!file_allowed(filename))
-        return 0;
+    while (true) {
+        len_a = strcspn(a, PATHSEP_STR);
+        len_b = strcspn(b, PATHSEP_STR);
 
-    strncpy(target, source, sizeof(target));
+        for (i = 0; i < len_a && i < len_b; i++) {
+#ifdef _WIN32
+            diff = toupper((unsigned char)a[i]) - toupper((unsigned char)b[i]);
+#else
+            diff = tolower((unsigned char)a[i]) - tolower((unsigned char)b[i]);
+#endif
+            if (diff != 0)
+                return diff;
+        }
+
+        if (len_a != len_b)
+            return (len_a < len_b) ? -1 : 1;
 
-    if (strlen(target) > 10 &&
-            strcmp(target + strlen(target) - 10, "config.cpp") == 0) {
-        strcpy(target + strlen(target) - 3, "bin");
+        if (a[len_a] == 0 || b[len_b] == 0)
+            return (a[len_a] != 0) - (b[len_b] != 0);
+
+        a += len_a + 1;
+        b += len_b + 1;
     }
+}
+
 
-    success = binarize(source, target);
+int compare_pbo_entries(const void *a, const void *b) {
+    return compare_pbo_paths(((struct pbo_entry *)a)->filename, ((struct pbo_entry *)b)->filename);
+}
 
-    if (success > 0)
-        return success * -1;
 
-    return 0;
+void add_pbo_entry(struct pbo_entries *entries, char *filename, char *path, int job) {
+    struct pbo_entry *entry;
+
+    if (!file_allowed(filename))
+        return;
+
+    if (entries->num_entries % ENTRYINTERVAL == 0)
+        entries->entries = (struct pbo_entry *)safe_realloc(entries->entries,
+                sizeof(struct pbo_entry) * (entries->num_entries + ENTRYINTERVAL));
+
+    entry = &entries->entries[entries->num_entries++];
+
+    entry->filename = safe_strdup(filename);
+    entry->path = safe_strdup(path);
+    entry->job = job;
+    entry->size = 0;
 }
 
 
-int write_header_to_pbo(char *root, char *source, char *target) {
-    FILE *f_source;
-    FILE *f_target;
+int collect_callback(char *root, char *source, char *entries_ptr) {
+    /*
+     * Adds the file to the list of PBO entries. Files that are to be
+     * binarized get a job that writes the binarized version to the temp
+     * folder, everything else is later read straight from the source.
+     */
+
+    struct pbo_entries *entries = (struct pbo_entries *)entries_ptr;
+    struct binarize_jobs *jobs = &entries->jobs;
+    struct binarize_job *job;
     char filename[1024];
+    char containing[2048];
 
     filename[0] = 0;
     strcat(filename, source + strlen(root) + 1);
@@ -90,142 +137,254 @@ int write_header_to_pbo(char *root, char *source, char *target) {
     if (!file_allowed(filename))
         return 0;
 
-    f_target = fopen(target, "ab");
-    if (!f_target)
+    if (!entries->binarize || !binarizable(filename)) {
+        add_pbo_entry(entries, filename, source, -1);
+        return 0;
+    }
+
+    if (jobs->num_jobs % JOBINTERVAL == 0)
+        jobs->jobs = (struct binarize_job *)safe_realloc(jobs->jobs,
+                sizeof(struct binarize_job) * (jobs->num_jobs + JOBINTERVAL));
+
+    job = &jobs->jobs[jobs->num_jobs++];
+
+    strncpy(job->filename, filename, sizeof(job->filename));
+    strncpy(job->source, source, sizeof(job->source));
+    snprintf(job->target, sizeof(job->target), "%s%s", entries->tempfolder, filename);
+
+    strcpy(containing, job->target);
+    *strrchr(containing, PATHSEP) = 0;
+    if (create_folders(containing))
         return -1;
 
-    struct {
-        uint32_t method;
-        uint32_t originalsize;
-        uint32_t reserved;
-        uint32_t timestamp;
-        uint32_t datasize;
-    } header;
-    header.method = 0;
-    header.reserved = 0;
-    header.timestamp = 0;
+    if (strlen(job->target) > 10 &&
+            strcmp(job->target + strlen(job->target) - 10, "config.cpp") == 0) {
+        strcpy(job->target + strlen(job->target) - 3, "bin");
 
-    f_source = fopen(source, "rb");
-    if (!f_source) {
-        fclose(f_target);
-        return -2;
+        // the unbinarized config is only left out in the addon root
+        if (strcmp(filename, "config.cpp") != 0)
+            add_pbo_entry(entries, filename, source, -1);
+
+        strcpy(filename + strlen(filename) - 3, "bin");
     }
 
-    fseek(f_source, 0, SEEK_END);
-    header.datasize = ftell(f_source);
-    header.originalsize = header.datasize;
-    fclose(f_source);
+    add_pbo_entry(entries, filename, job->target, jobs->num_jobs - 1);
 
-    // replace pathseps on linux
-#ifndef _WIN32
+    return 0;
+}
+
+
+int binarize_job(int index, void *jobs_ptr) {
+    struct binarize_job *job = &((struct binarize_jobs *)jobs_ptr)->jobs[index];
+
+    // the files are already binarized in parallel, so every one gets a single thread
+    return binarize(job->source, job->target, 1);
+}
+
+
+void free_pbo_entries(struct pbo_entries *entries) {
     int i;
-    for (i = 0; i < strlen(filename); i++) {
-        if (filename[i] == '/')
-            filename[i] = '\\';
+
+    for (i = 0; i < entries->num_entries; i++) {
+        free(entries->entries[i].filename);
+        free(entries->entries[i].path);
     }
-#endif
 
-    // replace .p3do ending
-    if (strlen(filename) > 5 && !strcmp(filename + strlen(filename) - 5, ".p3do"))
-        filename[strlen(filename) - 1] = 0;
+    free(entries->entries);
+    free(entries->jobs.jobs);
+}
 
-    fwrite(filename, strlen(filename), 1, f_target);
-    fputc(0, f_target);
 
-    fwrite(&header, sizeof(header), 1, f_target);
-    fclose(f_target);
+int pbo_writer_open(struct pbo_writer *writer, char *path) {
+    /*
+     * Opens the given PBO for writing. Everything written through the
+     * writer is buffered and fed into a running SHA-1, so the checksum at
+     * the end doesn't require reading the PBO again.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    writer->f = fopen(path, "wb");
+    if (!writer->f)
+        return 1;
+
+    setvbuf(writer->f, NULL, _IONBF, 0);
+
+    writer->buffer = (unsigned char *)safe_malloc(PBOWRITERBUFFER);
+    writer->used = 0;
+    writer->failed = false;
+
+    SHA1Reset(&writer->sha);
 
     return 0;
 }
 
 
-int write_data_to_pbo(char *root, char *source, char *target) {
-    FILE *f_source;
-    FILE *f_target;
-    char buffer[4096];
-    char filename[1024];
-    int datasize;
-    int i;
+int pbo_writer_flush(struct pbo_writer *writer) {
+    if (writer->used == 0)
+        return writer->failed;
 
-    filename[0] = 0;
-    strcat(filename, source + strlen(root) + 1);
+    SHA1Input(&writer->sha, writer->buffer, writer->used);
 
-    if (!file_allowed(filename))
-        return 0;
+    if (fwrite(writer->buffer, writer->used, 1, writer->f) != 1)
+        writer->failed = true;
 
-    f_source = fopen(source, "rb");
-    if (!f_source)
-        return -1;
-    fseek(f_source, 0, SEEK_END);
-    datasize = ftell(f_source);
+    writer->used = 0;
 
-    f_target = fopen(target, "ab");
-    if (!f_target) {
-        fclose(f_source);
-        return -2;
+    return writer->failed;
+}
+
+
+int pbo_writer_write(struct pbo_writer *writer, const void *data, size_t length) {
+    const unsigned char *ptr = (const unsigned char *)data;
+    size_t chunk;
+
+    while (length > 0) {
+        if (writer->used == PBOWRITERBUFFER && pbo_writer_flush(writer))
+            return 1;
+
+        chunk = MIN(length, PBOWRITERBUFFER - writer->used);
+        memcpy(writer->buffer + writer->used, ptr, chunk);
+
+        writer->used += chunk;
+        ptr += chunk;
+        length -= chunk;
     }
 
-    fseek(f_source, 0, SEEK_SET);
-    for (i = 0; datasize - i >= sizeof(buffer); i += sizeof(buffer)) {
-        fread(buffer, sizeof(buffer), 1, f_source);
-        fwrite(buffer, sizeof(buffer), 1, f_target);
+    return writer->failed;
+}
+
+
+int pbo_writer_putc(struct pbo_writer *writer, char c) {
+    return pbo_writer_write(writer, &c, 1);
+}
+
+
+int pbo_writer_copy_file(struct pbo_writer *writer, char *path, uint32_t size) {
+    /*
+     * Appends the first size bytes of the given file, reading them
+     * straight into the write buffer.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    FILE *f_source;
+    size_t chunk;
+
+    f_source = fopen(path, "rb");
+    if (!f_source)
+        return 1;
+
+    while (size > 0) {
+        if (writer->used == PBOWRITERBUFFER && pbo_writer_flush(writer)) {
+            fclose(f_source);
+            return 2;
+        }
+
+        chunk = MIN(size, PBOWRITERBUFFER - writer->used);
+        if (fread(writer->buffer + writer->used, chunk, 1, f_source) != 1) {
+            fclose(f_source);
+            return 3;
+        }
+
+        writer->used += chunk;
+        size -= chunk;
     }
-    fread(buffer, datasize - i, 1, f_source);
-    fwrite(buffer, datasize - i, 1, f_target);
 
     fclose(f_source);
-    fclose(f_target);
 
     return 0;
 }
 
 
-int hash_file(char *path, unsigned char *hash) {
-    SHA1Context sha;
-    FILE *file;
-    int filesize, i;
+int pbo_writer_close(struct pbo_writer *writer) {
+    /*
+     * Appends the checksum of everything written so far and closes the PBO.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    unsigned char checksum[20];
     unsigned temp;
-    char buffer[4096];
+    int success = 0;
+    int i;
 
-    SHA1Reset(&sha);
+    if (pbo_writer_flush(writer) || !SHA1Result(&writer->sha))
+        success = 1;
 
-    file = fopen(path, "rb");
-    if (!file)
-        return -1;
+    for (i = 0; i < 5; i++) {
+        temp = writer->sha.Message_Digest[i];
+        checksum[i * 4 + 0] = (temp >> 24) & 0xff;
+        checksum[i * 4 + 1] = (temp >> 16) & 0xff;
+        checksum[i * 4 + 2] = (temp >> 8) & 0xff;
+        checksum[i * 4 + 3] = temp & 0xff;
+    }
 
-    fseek(file, 0, SEEK_END);
-    filesize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    if (!success && (fputc(0, writer->f) == EOF || fwrite(checksum, 20, 1, writer->f) != 1))
+        success = 2;
 
-    for (i = 0; filesize - i >= sizeof(buffer); i += sizeof(buffer)) {
-        fread(buffer, sizeof(buffer), 1, file);
-        SHA1Input(&sha, (const unsigned char *)buffer, sizeof(buffer));
-    }
-    fread(buffer, filesize - i, 1, file);
-    SHA1Input(&sha, (const unsigned char *)buffer, filesize - i);
+    if (fclose(writer->f) && !success)
+        success = 3;
 
-    fclose(file);
+    free(writer->buffer);
 
-    if (!SHA1Result(&sha))
-        return -2;
+    return success;
+}
 
-    for (i = 0; i < 5; i++) {
-        temp = sha.Message_Digest[i];
-        sha.Message_Digest[i] = ((temp>>24)&0xff) |
-            ((temp<<8)&0xff0000) | ((temp>>8)&0xff00) | ((temp<<24)&0xff000000);
+
+void pbo_writer_abort(struct pbo_writer *writer) {
+    fclose(writer->f);
+    free(writer->buffer);
+}
+
+
+int write_header_to_pbo(struct pbo_entry *entry, struct pbo_writer *writer) {
+    char filename[1024];
+
+    strncpy(filename, entry->filename, sizeof(filename));
+
+    struct {
+        uint32_t method;
+        uint32_t originalsize;
+        uint32_t reserved;
+        uint32_t timestamp;
+        uint32_t datasize;
+    } header;
+    header.method = 0;
+    header.reserved = 0;
+    header.timestamp = 0;
+    header.datasize = entry->size;
+    header.originalsize = header.datasize;
+
+    // replace pathseps on linux
+#ifndef _WIN32
+    int i;
+    for (i = 0; i < strlen(filename); i++) {
+        if (filename[i] == '/')
+            filename[i] = '\\';
     }
+#endif
 
-    memcpy(hash, sha.Message_Digest, 20);
+    // replace .p3do ending
+    if (strlen(filename) > 5 && !strcmp(filename + strlen(filename) - 5, ".p3do"))
+        filename[strlen(filename) - 1] = 0;
 
-    return 0;
+    pbo_writer_write(writer, filename, strlen(filename) + 1);
+
+    return pbo_writer_write(writer, &header, sizeof(header));
+}
+
+
+int write_data_to_pbo(struct pbo_entry *entry, struct pbo_writer *writer) {
+    return pbo_writer_copy_file(writer, entry->path, entry->size);
 }
 
 
 int cmd_build() {
-    extern char *current_target;
     int i;
     int j;
     int k;
+    int64_t filesize;
     char buffer[512];
     bool valid = false;
 
@@ -318,65 +477,114 @@ int cmd_build() {
     strcat(addonprefix, tmp);
 #endif
 
-    // create and prepare temp folder
+    // create temp folder for binarized files
     char tempfolder[1024];
     if (create_temp_folder(addonprefix, tempfolder, sizeof(tempfolder))) {
         errorf("Failed to create temp folder.\n");
         remove_file(args.positionals[2]);
         return 2;
     }
-    if (copy_directory(args.positionals[1], tempfolder)) {
-        errorf("Failed to copy to temp folder.\n");
-        remove_file(args.positionals[2]);
-        remove_folder(tempfolder);
-        return 3;
-    }
 
-    // preprocess and binarize stuff if required
+    // collect files, everything that isn't binarized is packed straight from the source
     char nobinpath[1024];
     char notestpath[1024];
+    struct pbo_entries entries = { 0, NULL, { 0, NULL }, tempfolder, false };
     strcpy(nobinpath, prefixpath);
     strcpy(notestpath, prefixpath);
     strcpy(nobinpath + strlen(nobinpath) - 11, "$NOBIN$");
     strcpy(notestpath + strlen(notestpath) - 11, "$NOBIN-NOTEST$");
-    if (!args.packonly && access(nobinpath, F_OK) == -1 && access(notestpath, F_OK) == -1) {
-        if (traverse_directory(tempfolder, binarize_callback, "")) {
-            current_target = args.positionals[1];
-            errorf("Failed to binarize some files.\n");
+    entries.binarize = !args.packonly && access(nobinpath, F_OK) == -1 && access(notestpath, F_OK) == -1;
+
+    if (traverse_directory(args.positionals[1], collect_callback, (char *)&entries)) {
+        errorf("Failed to collect files to pack.\n");
+        free_pbo_entries(&entries);
+        remove_file(args.positionals[2]);
+        remove_folder(tempfolder);
+        return 3;
+    }
+
+    // preprocess and binarize stuff if required
+    if (entries.jobs.num_jobs > 0) {
+        int *results;
+        int failed = 0;
+
+        results = (int *)safe_malloc(sizeof(int) * entries.jobs.num_jobs);
+
+        cache_set_root(args.positionals[1]);
+        run_parallel(entries.jobs.num_jobs, get_num_jobs(), binarize_job, &entries.jobs, results);
+        cache_set_root(NULL);
+
+        current_target = args.positionals[1];
+
+        for (i = 0; i < entries.jobs.num_jobs; i++) {
+            if (results[i] > 0) {
+                errorf("Failed to binarize %s.\n", entries.jobs.jobs[i].filename);
+                failed++;
+            }
+        }
+
+        // files binarize() doesn't handle after all are packed as they are
+        for (i = 0, j = 0; i < entries.num_entries; i++) {
+            entries.entries[j] = entries.entries[i];
+
+            if (entries.entries[j].job >= 0 && results[entries.entries[j].job] < 0) {
+                if (strcmp(entries.entries[j].filename, entries.jobs.jobs[entries.entries[j].job].filename) != 0) {
+                    free(entries.entries[j].filename);
+                    free(entries.entries[j].path);
+                    continue;
+                }
+
+                free(entries.entries[j].path);
+                entries.entries[j].path = safe_strdup(entries.jobs.jobs[entries.entries[j].job].source);
+            }
+
+            j++;
+        }
+        entries.num_entries = j;
+
+        free(results);
+
+        if (failed) {
+            errorf("Failed to binarize %i file(s).\n", failed);
+            free_pbo_entries(&entries);
             remove_file(args.positionals[2]);
             remove_folder(tempfolder);
             return 4;
         }
+    }
 
-        char configpath[2048];
-        strcpy(configpath, tempfolder);
-        strcat(configpath, "?config.cpp");
-        configpath[strlen(tempfolder)] = PATHSEP;
-
-        if (access(configpath, F_OK) != -1) {
-#ifdef _WIN32
-            if (!DeleteFile(configpath)) {
-#else
-            if (remove(configpath)) {
-#endif
-                remove_file(args.positionals[2]);
-                remove_folder(tempfolder);
-                return 5;
-            }
+    for (i = 0; i < entries.num_entries; i++) {
+        filesize = get_file_size(entries.entries[i].path);
+        entries.entries[i].size = (uint32_t)filesize;
+        if (filesize < 0) {
+            errorf("Failed to read %s.\n", entries.entries[i].path);
+            free_pbo_entries(&entries);
+            remove_file(args.positionals[2]);
+            remove_folder(tempfolder);
+            return 5;
         }
     }
 
+    // renamed binarized files have to end up where a traversal would put them
+    qsort(entries.entries, entries.num_entries, sizeof(struct pbo_entry), compare_pbo_entries);
+
     current_target = args.positionals[1];
 
     // write header extensions
-    f_target = fopen(args.positionals[2], "wb");
-    fwrite("\0sreV\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0prefix\0", 28, 1, f_target);
+    struct pbo_writer writer;
+    if (pbo_writer_open(&writer, args.positionals[2])) {
+        errorf("Failed to open %s.\n", args.positionals[2]);
+        free_pbo_entries(&entries);
+        remove_folder(tempfolder);
+        return 2;
+    }
+    pbo_writer_write(&writer, "\0sreV\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0prefix\0", 28);
     // write addonprefix with windows pathseps
     for (i = 0; i <= strlen(addonprefix); i++) {
         if (addonprefix[i] == PATHSEP)
-            fputc('\\', f_target);
+            pbo_writer_putc(&writer, '\\');
         else
-            fputc(addonprefix[i], f_target);
+            pbo_writer_putc(&writer, addonprefix[i]);
     }
     // write extra header extensions
     for (i = 0; i < args.num_headerextensions && args.headerextensions[i][0] != 0; i++) {
@@ -391,14 +599,15 @@ int cmd_build() {
                 // validate
                 if (args.headerextensions[i][j] == '\0' && !valid) {
                     errorf("Invalid header extension format (%s).\n", args.headerextensions[i]);
+                    pbo_writer_abort(&writer);
+                    free_pbo_entries(&entries);
                     remove_file(args.positionals[2]);
                     remove_folder(tempfolder);
                     return 6;
                 }
 
                 // write
-                fputs(buffer, f_target);
-                fputc(0, f_target);
+                pbo_writer_write(&writer, buffer, strlen(buffer) + 1);
                 k = 0;
                 valid = true;
             } else {
@@ -407,50 +616,45 @@ int cmd_build() {
             }
         }
     }
-    fputc(0, f_target);
-    fclose(f_target);
+    pbo_writer_putc(&writer, 0);
 
     // write headers to file
-    if (traverse_directory(tempfolder, write_header_to_pbo, args.positionals[2])) {
-        errorf("Failed to write some file header(s) to PBO.\n");
-        remove_file(args.positionals[2]);
-        remove_folder(tempfolder);
-        return 7;
+    for (i = 0; i < entries.num_entries; i++) {
+        if (write_header_to_pbo(&entries.entries[i], &writer)) {
+            errorf("Failed to write some file header(s) to PBO.\n");
+            pbo_writer_abort(&writer);
+            free_pbo_entries(&entries);
+            remove_file(args.positionals[2]);
+            remove_folder(tempfolder);
+            return 7;
+        }
     }
 
     // header boundary
-    f_target = fopen(args.positionals[2], "ab");
-    if (!f_target) {
-        errorf("Failed to write header boundary to PBO.\n");
-        remove_file(args.positionals[2]);
-        remove_folder(tempfolder);
-        return 8;
-    }
     for (i = 0; i < 21; i++)
-        fputc(0, f_target);
-    fclose(f_target);
+        pbo_writer_putc(&writer, 0);
 
     // write contents to file
-    if (traverse_directory(tempfolder, write_data_to_pbo, args.positionals[2])) {
-        errorf("Failed to pack some file(s) into the PBO.\n");
-        remove_file(args.positionals[2]);
-        remove_folder(tempfolder);
-        return 9;
+    for (i = 0; i < entries.num_entries; i++) {
+        if (write_data_to_pbo(&entries.entries[i], &writer)) {
+            errorf("Failed to pack some file(s) into the PBO.\n");
+            pbo_writer_abort(&writer);
+            free_pbo_entries(&entries);
+            remove_file(args.positionals[2]);
+            remove_folder(tempfolder);
+            return 9;
+        }
     }
 
+    free_pbo_entries(&entries);
+
     // write checksum to file
-    unsigned char checksum[20];
-    hash_file(args.positionals[2], checksum);
-    f_target = fopen(args.positionals[2], "ab");
-    if (!f_target) {
+    if (pbo_writer_close(&writer)) {
         errorf("Failed to write checksum to file.\n");
         remove_file(args.positionals[2]);
         remove_folder(tempfolder);
         return 10;
     }
-    fputc(0, f_target);
-    fwrite(checksum, 20, 1, f_target);
-    fclose(f_target);
 
     // remove temp folder
     if (remove_folder(tempfolder)) {
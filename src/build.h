@@ -19,4 +19,64 @@
 #pragma once
 
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sha1.h"
+
+
+#define JOBINTERVAL 64
+#define ENTRYINTERVAL 256
+#define PBOWRITERBUFFER 1048576
+
+
+struct binarize_job {
+    char filename[1024];
+    char source[2048];
+    char target[2048];
+};
+
+struct binarize_jobs {
+    int num_jobs;
+    struct binarize_job *jobs;
+};
+
+
+struct pbo_entry {
+    char *filename;
+    char *path;
+    int job;
+    uint32_t size;
+};
+
+struct pbo_entries {
+    int num_entries;
+    struct pbo_entry *entries;
+    struct binarize_jobs jobs;
+    char *tempfolder;
+    bool binarize;
+};
+
+struct pbo_writer {
+    FILE *f;
+    SHA1Context sha;
+    unsigned char *buffer;
+    size_t used;
+    bool failed;
+};
+
+
+int pbo_writer_open(struct pbo_writer *writer, char *path);
+
+int pbo_writer_write(struct pbo_writer *writer, const void *data, size_t length);
+
+int pbo_writer_putc(struct pbo_writer *writer, char c);
+
+int pbo_writer_copy_file(struct pbo_writer *writer, char *path, uint32_t size);
+
+int pbo_writer_close(struct pbo_writer *writer);
+
+void pbo_writer_abort(struct pbo_writer *writer);
+
 int cmd_build();
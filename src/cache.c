@@ -0,0 +1,466 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "args.h"
+#include "filesystem.h"
+#include "utils.h"
+#include "sha1.h"
+#include "cache.h"
+
+
+pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned cache_temp_counter = 0;
+
+// dependencies of the file currently being binarized on this thread
+__thread struct cache_entry *cache_recording = NULL;
+
+// folder that dependencies are stored relative to, if any
+char cache_root[2048] = "";
+
+
+char *get_cache_dir() {
+    /*
+     * Returns the binarization cache folder given with --cache or through
+     * the environment variable BINARIZECACHE, or NULL if caching is off.
+     */
+
+    char *cache_dir;
+
+    cache_dir = args.cache;
+    if (cache_dir == NULL)
+        cache_dir = getenv("BINARIZECACHE");
+
+    if (cache_dir == NULL || cache_dir[0] == 0)
+        return NULL;
+
+    return cache_dir;
+}
+
+
+void get_absolute_path(char *path, char *absolute, size_t buffsize) {
+#ifdef _WIN32
+    if (!GetFullPathName(path, buffsize, absolute, NULL))
+        strncpy(absolute, path, buffsize);
+#else
+    char temp[PATH_MAX];
+
+    if (realpath(path, temp) == NULL)
+        strncpy(absolute, path, buffsize);
+    else
+        strncpy(absolute, temp, buffsize);
+#endif
+    absolute[buffsize - 1] = 0;
+}
+
+
+void sha1_to_hex(SHA1Context *sha, char *hash) {
+    int i;
+
+    for (i = 0; i < 5; i++)
+        sprintf(hash + i * 8, "%08x", sha->Message_Digest[i]);
+}
+
+
+int cache_hash_file(char *path, char *hash) {
+    /*
+     * Writes the hex SHA-1 of the file contents to hash, which has to hold
+     * at least 41 bytes.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    SHA1Context sha;
+    FILE *f;
+    char buffer[65536];
+    size_t len;
+
+    f = fopen(path, "rb");
+    if (!f)
+        return 1;
+
+    SHA1Reset(&sha);
+
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        SHA1Input(&sha, (unsigned char *)buffer, len);
+
+    fclose(f);
+
+    if (!SHA1Result(&sha))
+        return 2;
+
+    sha1_to_hex(&sha, hash);
+
+    return 0;
+}
+
+
+int compute_cache_key(char *source, char *key) {
+    /*
+     * The key covers the source bytes, the armake version, the include
+     * folders, which decide where includes and materials are found, and
+     * options changing the output. The included files themselves are
+     * checked against the stored manifest.
+     */
+
+    SHA1Context sha;
+    FILE *f;
+    char buffer[65536];
+    char *fileext;
+    size_t len;
+    int i;
+
+    f = fopen(source, "rb");
+    if (!f)
+        return 1;
+
+    SHA1Reset(&sha);
+
+    SHA1Input(&sha, (unsigned char *)"armake " VERSION, strlen("armake " VERSION) + 1);
+
+    fileext = strrchr(source, '.');
+    if (fileext != NULL)
+        SHA1Input(&sha, (unsigned char *)fileext, strlen(fileext) + 1);
+
+    for (i = 0; i < args.num_includefolders; i++) {
+        get_absolute_path(args.includefolders[i], buffer, sizeof(buffer));
+        SHA1Input(&sha, (unsigned char *)buffer, strlen(buffer) + 1);
+    }
+
+    if (args.optimizemeshes)
+        SHA1Input(&sha, (unsigned char *)"--optimize-meshes", strlen("--optimize-meshes") + 1);
+
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        SHA1Input(&sha, (unsigned char *)buffer, len);
+
+    fclose(f);
+
+    if (!SHA1Result(&sha))
+        return 2;
+
+    sha1_to_hex(&sha, key);
+
+    return 0;
+}
+
+
+void cache_set_root(char *root) {
+    /*
+     * Sets the folder that dependencies are stored relative to. cmd_build
+     * sets this to the addon folder, so the cache still applies when the
+     * addon is built from a different checkout or location.
+     */
+
+    if (root == NULL)
+        cache_root[0] = 0;
+    else
+        get_absolute_path(root, cache_root, sizeof(cache_root));
+
+    if (cache_root[0] != 0 && cache_root[strlen(cache_root) - 1] == PATHSEP)
+        cache_root[strlen(cache_root) - 1] = 0;
+}
+
+
+void get_temp_cache_path(char *path, char *temp_path, size_t buffsize) {
+    unsigned counter;
+
+    pthread_mutex_lock(&cache_lock);
+    counter = cache_temp_counter++;
+    pthread_mutex_unlock(&cache_lock);
+
+    snprintf(temp_path, buffsize, "%s.%i.%u", path, (int)getpid(), counter);
+}
+
+
+int replace_file(char *source, char *target) {
+#ifdef _WIN32
+    if (!MoveFileEx(source, target, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(source, target)) {
+#endif
+        remove_file(source);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+int cache_lookup(char *cache_dir, char *source, char *target, struct cache_entry *entry) {
+    /*
+     * Computes the cache key for the source and checks whether a binarized
+     * version of it is cached. A cached file is only used if all files the
+     * original binarization depended on are still unchanged. On a hit, the
+     * cached file is copied to the target. It is never hardlinked, since
+     * binarizing to the target later truncates it in place and would
+     * overwrite the cached file with it.
+     *
+     * Returns 0 on a hit, a positive integer on a miss and a negative
+     * integer if the source can't be cached at all.
+     */
+
+    FILE *f;
+    char *line = NULL;
+    char *path;
+    char header[2048];
+    char root_path[4096];
+    char manifest_path[2048];
+    char output_path[2048];
+    char temp_path[2048];
+    char hash[41];
+    size_t buffsize = 0;
+    ssize_t len;
+    int success = 1;
+
+    entry->num_dependencies = 0;
+    entry->dependencies = NULL;
+
+    if (compute_cache_key(source, entry->key))
+        return -1;
+
+    snprintf(manifest_path, sizeof(manifest_path), "%s%c%s.armake.dep", cache_dir, PATHSEP, entry->key);
+    output_path[0] = 0;
+
+    f = fopen(manifest_path, "rb");
+    if (!f)
+        return 1;
+
+    snprintf(header, sizeof(header), "armake binarize cache %s\n", VERSION);
+
+    if (getline(&line, &buffsize, f) < 0 || strcmp(line, header) != 0) {
+        success = 2;
+        goto cleanup;
+    }
+
+    while ((len = getline(&line, &buffsize, f)) > 0) {
+        if (line[len - 1] == '\n')
+            line[--len] = 0;
+
+        if (len < 3 || line[1] != '\t') {
+            success = 3;
+            goto cleanup;
+        }
+
+        if (line[0] == 'D' || line[0] == 'R') {
+            if ((path = strchr(line + 2, '\t')) == NULL) {
+                success = 3;
+                goto cleanup;
+            }
+            *(path++) = 0;
+
+            if (line[0] == 'R') {
+                if (cache_root[0] == 0) {
+                    success = 4;
+                    goto cleanup;
+                }
+                snprintf(root_path, sizeof(root_path), "%s%c%s", cache_root, PATHSEP, path);
+                path = root_path;
+            }
+
+            if (cache_hash_file(path, hash))
+                strcpy(hash, "-");
+
+            if (strcmp(hash, line + 2) != 0) {
+                success = 4;
+                goto cleanup;
+            }
+        } else if (line[0] == 'O') {
+            snprintf(output_path, sizeof(output_path), "%s%c%s.armake.bin", cache_dir, PATHSEP, line + 2);
+        } else {
+            success = 5;
+            goto cleanup;
+        }
+    }
+
+    if (output_path[0] == 0) {
+        success = 6;
+        goto cleanup;
+    }
+
+    if (access(output_path, F_OK) == -1) {
+        success = 7;
+        goto cleanup;
+    }
+
+    // the target might be the source itself, so only replace it once the copy worked
+    get_temp_cache_path(target, temp_path, sizeof(temp_path));
+
+    if (copy_file(output_path, temp_path)) {
+        remove_file(temp_path);
+        success = 8;
+        goto cleanup;
+    }
+
+    success = replace_file(temp_path, target) ? 9 : 0;
+
+cleanup:
+    free(line);
+    fclose(f);
+
+    return success;
+}
+
+
+void cache_start_recording(struct cache_entry *entry) {
+    cache_recording = entry;
+}
+
+
+void cache_stop_recording() {
+    cache_recording = NULL;
+}
+
+
+struct cache_entry *cache_get_recording() {
+    /*
+     * Returns the entry recorded into on this thread, so work handed off to
+     * other threads can record into the same entry.
+     */
+
+    return cache_recording;
+}
+
+
+void cache_add_dependency(char *path) {
+    /*
+     * Records a file read while binarizing the current file on this thread,
+     * if the binarization cache is used.
+     */
+
+    char absolute[2048];
+    uint32_t i;
+
+    if (cache_recording == NULL)
+        return;
+
+    get_absolute_path(path, absolute, sizeof(absolute));
+
+    // several threads may record into the same entry
+    pthread_mutex_lock(&cache_lock);
+
+    for (i = 0; i < cache_recording->num_dependencies; i++) {
+        if (strcmp(cache_recording->dependencies[i], absolute) == 0) {
+            pthread_mutex_unlock(&cache_lock);
+            return;
+        }
+    }
+
+    if (cache_recording->num_dependencies % DEPENDENCYINTERVAL == 0)
+        cache_recording->dependencies = (char **)safe_realloc(cache_recording->dependencies,
+                sizeof(char *) * (cache_recording->num_dependencies + DEPENDENCYINTERVAL));
+
+    cache_recording->dependencies[cache_recording->num_dependencies++] = safe_strdup(absolute);
+
+    pthread_mutex_unlock(&cache_lock);
+}
+
+
+int cache_store(char *cache_dir, struct cache_entry *entry, char *target) {
+    /*
+     * Stores the binarized target in the cache. The output is stored under
+     * its own hash, the manifest under the cache key. Both are written to a
+     * temporary file first and then moved into place, so concurrent armake
+     * calls never see half of them.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    FILE *f;
+    char manifest_path[2048];
+    char output_path[2048];
+    char temp_path[2048];
+    char output_hash[41];
+    char hash[41];
+    uint32_t i;
+
+    if (cache_hash_file(target, output_hash))
+        return 1;
+
+    create_folders(cache_dir);
+
+    snprintf(output_path, sizeof(output_path), "%s%c%s.armake.bin", cache_dir, PATHSEP, output_hash);
+
+    if (access(output_path, F_OK) == -1) {
+        get_temp_cache_path(output_path, temp_path, sizeof(temp_path));
+
+        if (copy_file(target, temp_path)) {
+            remove_file(temp_path);
+            return 2;
+        }
+
+        if (replace_file(temp_path, output_path))
+            return 3;
+    }
+
+    snprintf(manifest_path, sizeof(manifest_path), "%s%c%s.armake.dep", cache_dir, PATHSEP, entry->key);
+    get_temp_cache_path(manifest_path, temp_path, sizeof(temp_path));
+
+    f = fopen(temp_path, "wb");
+    if (!f)
+        return 4;
+
+    fprintf(f, "armake binarize cache %s\n", VERSION);
+
+    for (i = 0; i < entry->num_dependencies; i++) {
+        if (cache_hash_file(entry->dependencies[i], hash))
+            strcpy(hash, "-");
+
+        if (cache_root[0] != 0 && strncmp(entry->dependencies[i], cache_root, strlen(cache_root)) == 0 &&
+                entry->dependencies[i][strlen(cache_root)] == PATHSEP)
+            fprintf(f, "R\t%s\t%s\n", hash, entry->dependencies[i] + strlen(cache_root) + 1);
+        else
+            fprintf(f, "D\t%s\t%s\n", hash, entry->dependencies[i]);
+    }
+
+    fprintf(f, "O\t%s\n", output_hash);
+
+    if (fclose(f)) {
+        remove_file(temp_path);
+        return 5;
+    }
+
+    if (replace_file(temp_path, manifest_path))
+        return 6;
+
+    return 0;
+}
+
+
+void cache_entry_free(struct cache_entry *entry) {
+    uint32_t i;
+
+    for (i = 0; i < entry->num_dependencies; i++)
+        free(entry->dependencies[i]);
+
+    free(entry->dependencies);
+
+    entry->num_dependencies = 0;
+    entry->dependencies = NULL;
+}
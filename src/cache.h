@@ -0,0 +1,54 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define DEPENDENCYINTERVAL 32
+
+
+struct cache_entry {
+    char key[41];
+    uint32_t num_dependencies;
+    char **dependencies;
+};
+
+
+char *get_cache_dir();
+
+int cache_hash_file(char *path, char *hash);
+
+void cache_set_root(char *root);
+
+int cache_lookup(char *cache_dir, char *source, char *target, struct cache_entry *entry);
+
+void cache_start_recording(struct cache_entry *entry);
+
+void cache_stop_recording();
+
+struct cache_entry *cache_get_recording();
+
+void cache_add_dependency(char *path);
+
+int cache_store(char *cache_dir, struct cache_entry *entry, char *target);
+
+void cache_entry_free(struct cache_entry *entry);
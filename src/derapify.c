@@ -506,10 +506,12 @@ int read_float_array(FILE *f, char *config_path, float *array, int size) {
 }
 
 
-int read_string_array(FILE *f, char *config_path, char *buffer, int size, size_t buffsize) {
+int read_string_array(FILE *f, char *config_path, struct string_table *strings, char ***array, uint32_t *num_entries) {
     /*
-     * Reads the given array from config. size should be the maximum number of
-     * elements in the array, buffsize the length of the individual buffers.
+     * Reads the given array from config and appends its elements to the
+     * given list, interned in the given string table. The list is grown in
+     * steps of STRINGARRAYINTERVAL, so it has to start out empty or come
+     * from a previous call.
      *
      * Returns -1 if the value could not be found, 0 on success
      * and a positive integer on failure.
@@ -519,7 +521,8 @@ int read_string_array(FILE *f, char *config_path, char *buffer, int size, size_t
     int success;
     long fp;
     uint8_t temp;
-    uint32_t num_entries;
+    uint32_t num_array;
+    char buffer[2048];
 
     success = seek_definition(f, config_path);
     if (success != 0)
@@ -531,45 +534,43 @@ int read_string_array(FILE *f, char *config_path, char *buffer, int size, size_t
 
     while (fgetc(f) != 0);
 
-    num_entries = read_compressed_int(f);
-
-    for (i = 0; i < num_entries; i++) {
-        // Array is full
-        if (i == size)
-            return 2;
+    num_array = read_compressed_int(f);
 
+    for (i = 0; i < num_array; i++) {
         temp = fgetc(f);
         if (temp != 0)
             return 3;
 
         fp = ftell(f);
 
-        if (fgets(buffer + i * buffsize, buffsize, f) == NULL)
+        if (fgets(buffer, sizeof(buffer), f) == NULL)
             return 3;
 
-        fseek(f, fp + strlen(buffer + i * buffsize) + 1, SEEK_SET);
+        fseek(f, fp + strlen(buffer) + 1, SEEK_SET);
+
+        if (*num_entries % STRINGARRAYINTERVAL == 0)
+            *array = (char **)safe_realloc(*array, sizeof(char *) * (*num_entries + STRINGARRAYINTERVAL));
+        (*array)[(*num_entries)++] = string_table_intern(strings, buffer);
     }
 
     return 0;
 }
 
 
-int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffsize) {
+int read_classes(FILE *f, char *config_path, struct string_table *strings, char ***array, uint32_t *num_entries) {
     /*
-     * Reads all subclass names for the given config path into the given
-     * array.
+     * Reads all subclass names for the given config path and appends them
+     * to the given list, the same way read_string_array does.
      *
      * Returns a positive integer on failure, a 0 on success and -1
      * if the given path doesn't exist.
      */
 
     int i;
-    int j;
     int success;
     uint8_t type;
-    uint32_t num_entries;
+    uint32_t num_definitions;
     uint32_t fp;
-    char target[512];
     char buffer[512];
 
     fseek(f, 16, SEEK_SET);
@@ -580,9 +581,9 @@ int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffs
     // Inherited classname
     while (fgetc(f) != 0);
 
-    num_entries = read_compressed_int(f);
+    num_definitions = read_compressed_int(f);
 
-    for (i = 0; i < num_entries; i++) {
+    for (i = 0; i < num_definitions; i++) {
         fp = ftell(f);
         type = fgetc(f);
 
@@ -590,14 +591,9 @@ int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffs
             if (fgets(buffer, sizeof(buffer), f) == NULL)
                 return 1;
 
-            for (j = 0; j < size; j++) {
-                if (*(array + j * buffsize) == 0)
-                    break;
-            }
-            if (j == size)
-                return 2;
-
-            strncpy(array + j * buffsize, buffer, buffsize);
+            if (*num_entries % STRINGARRAYINTERVAL == 0)
+                *array = (char **)safe_realloc(*array, sizeof(char *) * (*num_entries + STRINGARRAYINTERVAL));
+            (*array)[(*num_entries)++] = string_table_intern(strings, buffer);
 
             fseek(f, fp + strlen(buffer) + 6, SEEK_SET);
         } else if (type == 1) { // value
@@ -606,13 +602,6 @@ int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffs
             if (fgets(buffer, sizeof(buffer), f) == NULL)
                 return 1;
 
-            lower_case(buffer);
-
-            if (strcmp(buffer, target) == 0) {
-                fseek(f, fp, SEEK_SET);
-                return 0;
-            }
-
             fseek(f, fp + strlen(buffer) + 3, SEEK_SET);
 
             if (type == 0 || type == 4)
@@ -623,13 +612,6 @@ int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffs
             if (fgets(buffer, sizeof(buffer), f) == NULL)
                 return 1;
 
-            lower_case(buffer);
-
-            if (strcmp(buffer, target) == 0) {
-                fseek(f, fp, SEEK_SET);
-                return 0;
-            }
-
             fseek(f, fp + strlen(buffer) + 2, SEEK_SET);
 
             skip_array(f);
@@ -836,7 +818,6 @@ int derapify_file(char *source, char *target) {
      * returned. 0 is returned on success and a positive integer on failure.
      */
 
-    extern char *current_target;
     FILE *f_source;
     FILE *f_target;
     char buffer[4096];
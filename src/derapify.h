@@ -20,6 +20,10 @@
 
 
 #define RAD2DEG 0.017453293;
+#define STRINGARRAYINTERVAL 32
+
+
+#include "utils.h"
 
 
 int seek_config_path(FILE *f, char *config_path);
@@ -38,9 +42,9 @@ int read_long_array(FILE *f, char *config_path, int32_t *array, int size);
 
 int read_float_array(FILE *f, char *config_path, float *array, int size);
 
-int read_string_array(FILE *f, char *config_path, char *buffer, int size, size_t buffsize);
+int read_string_array(FILE *f, char *config_path, struct string_table *strings, char ***array, uint32_t *num_entries);
 
-int read_classes(FILE *f, char *config_path, char *array, int size, size_t buffsize);
+int read_classes(FILE *f, char *config_path, struct string_table *strings, char ***array, uint32_t *num_entries);
 
 int derapify_file(char *source, char *target);
 
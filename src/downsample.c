@@ -0,0 +1,247 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "utils.h"
+#include "simd.h"
+#include "downsample.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Pixels are averaged in linear light: sRGB bytes are looked up as linear
+ * floats in [0, 1], and averages are quantized to LINEARLEVELS steps and
+ * looked up as sRGB bytes again. The last table has 3 bytes of padding so
+ * the AVX2 kernel can gather 32 bit words from it.
+ */
+float srgb_to_linear[256];
+unsigned char linear_to_srgb[LINEARLEVELS + 3];
+bool downsample_ready = false;
+
+
+void downsample_init() {
+    /*
+     * Builds the lookup tables. Has to be called before downsampling on
+     * several threads.
+     */
+
+    double c;
+    int i;
+
+    if (downsample_ready)
+        return;
+
+    for (i = 0; i < 256; i++) {
+        c = i / 255.0;
+        srgb_to_linear[i] = (float)((c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+    }
+
+    memset(linear_to_srgb, 0, sizeof(linear_to_srgb));
+    for (i = 0; i < LINEARLEVELS; i++) {
+        c = i / (double)(LINEARLEVELS - 1);
+        c = (c <= 0.0031308) ? c * 12.92 : 1.055 * pow(c, 1 / 2.4) - 0.055;
+        linear_to_srgb[i] = (unsigned char)MIN((int)(c * 255.0 + 0.5), 255);
+    }
+
+    downsample_ready = true;
+}
+
+
+static void downsample_pixel(const unsigned char *row0, const unsigned char *row1, int x, unsigned char *dest,
+        bool premultiply) {
+    /*
+     * Averages the 2x2 source pixels of the output pixel x. With
+     * premultiply the colors are weighted by their alpha, so transparent
+     * pixels don't bleed into the visible ones, unless all four are fully
+     * transparent.
+     */
+
+    const unsigned char *pixels[4];
+    float weights[4];
+    float weight_sum;
+    float sum;
+    int index;
+    int i;
+    int c;
+
+    pixels[0] = row0 + x * 8;
+    pixels[1] = row0 + x * 8 + 4;
+    pixels[2] = row1 + x * 8;
+    pixels[3] = row1 + x * 8 + 4;
+
+    for (i = 0; i < 4; i++)
+        weights[i] = premultiply ? (float)pixels[i][3] : 1.0f;
+
+    weight_sum = weights[0] + weights[1] + weights[2] + weights[3];
+    if (weight_sum == 0.0f) {
+        for (i = 0; i < 4; i++)
+            weights[i] = 1.0f;
+        weight_sum = 4.0f;
+    }
+
+    // the kernels have to add up in the same order to get the same bytes
+    for (c = 0; c < 3; c++) {
+        sum = srgb_to_linear[pixels[0][c]] * weights[0] + srgb_to_linear[pixels[1][c]] * weights[1] +
+                srgb_to_linear[pixels[2][c]] * weights[2] + srgb_to_linear[pixels[3][c]] * weights[3];
+
+        index = (int)(sum / weight_sum * (float)(LINEARLEVELS - 1) + 0.5f);
+        dest[c] = linear_to_srgb[MIN(index, LINEARLEVELS - 1)];
+    }
+
+    dest[3] = (pixels[0][3] + pixels[1][3] + pixels[2][3] + pixels[3][3] + 2) >> 2;
+}
+
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("avx2")
+static int downsample_row_avx2(const unsigned char *row0, const unsigned char *row1, int width,
+        unsigned char *dest, bool premultiply) {
+    /*
+     * Downsamples 8 output pixels at a time and returns how many were done.
+     * Every lane holds one output pixel, its 4 source pixels are split into
+     * the even and odd pixels of both rows.
+     */
+
+    const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 levels = _mm256_set1_ps((float)(LINEARLEVELS - 1));
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256i pixels[4];
+    __m256i alpha[4];
+    __m256i a;
+    __m256i b;
+    __m256i index;
+    __m256i result;
+    __m256 weights[4];
+    __m256 weight_sum;
+    __m256 zero_mask;
+    __m256 sum;
+    int x;
+    int i;
+    int c;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(row0 + x * 8)), deinterleave);
+        b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(row0 + x * 8 + 32)), deinterleave);
+        pixels[0] = _mm256_permute2x128_si256(a, b, 0x20);
+        pixels[1] = _mm256_permute2x128_si256(a, b, 0x31);
+
+        a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(row1 + x * 8)), deinterleave);
+        b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(row1 + x * 8 + 32)), deinterleave);
+        pixels[2] = _mm256_permute2x128_si256(a, b, 0x20);
+        pixels[3] = _mm256_permute2x128_si256(a, b, 0x31);
+
+        for (i = 0; i < 4; i++) {
+            alpha[i] = _mm256_srli_epi32(pixels[i], 24);
+            weights[i] = premultiply ? _mm256_cvtepi32_ps(alpha[i]) : one;
+        }
+
+        weight_sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(weights[0], weights[1]), weights[2]), weights[3]);
+        zero_mask = _mm256_cmp_ps(weight_sum, _mm256_setzero_ps(), _CMP_EQ_OQ);
+        for (i = 0; i < 4; i++)
+            weights[i] = _mm256_blendv_ps(weights[i], one, zero_mask);
+        weight_sum = _mm256_blendv_ps(weight_sum, _mm256_set1_ps(4.0f), zero_mask);
+
+        result = _mm256_add_epi32(_mm256_add_epi32(alpha[0], alpha[1]), _mm256_add_epi32(alpha[2], alpha[3]));
+        result = _mm256_slli_epi32(_mm256_srli_epi32(_mm256_add_epi32(result, _mm256_set1_epi32(2)), 2), 24);
+
+        for (c = 0; c < 3; c++) {
+            sum = _mm256_mul_ps(_mm256_i32gather_ps(srgb_to_linear,
+                    _mm256_and_si256(_mm256_srli_epi32(pixels[0], c * 8), byte_mask), 4), weights[0]);
+            for (i = 1; i < 4; i++) {
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_i32gather_ps(srgb_to_linear,
+                        _mm256_and_si256(_mm256_srli_epi32(pixels[i], c * 8), byte_mask), 4), weights[i]));
+            }
+
+            sum = _mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(sum, weight_sum), levels), half);
+            index = _mm256_min_epi32(_mm256_cvttps_epi32(sum), _mm256_set1_epi32(LINEARLEVELS - 1));
+            index = _mm256_and_si256(_mm256_i32gather_epi32((const int *)linear_to_srgb, index, 1), byte_mask);
+            result = _mm256_or_si256(result, _mm256_slli_epi32(index, c * 8));
+        }
+
+        _mm256_storeu_si256((__m256i *)(dest + x * 4), result);
+    }
+
+    return x;
+}
+
+#endif
+
+
+static void average_pixel(const unsigned char *row0, const unsigned char *row1, int x, unsigned char *dest) {
+    /*
+     * Averages the 2x2 source pixels of the output pixel x byte by byte, for
+     * data that isn't color.
+     */
+
+    int c;
+
+    for (c = 0; c < 4; c++)
+        dest[c] = (row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c] + 2) >> 2;
+}
+
+
+void downsample_2x2(const unsigned char *src, int width, int height, unsigned char *dest, bool linear, bool premultiply,
+        int simd) {
+    /*
+     * Halves the RGBA image of the given (even) dimensions. With linear
+     * every 2x2 block of pixels is averaged in linear light (and weighted
+     * by alpha with premultiply), which is only right for color. Otherwise
+     * the bytes are averaged as they are. simd is the instruction set to
+     * use, as returned by simd_level; all of them give the same result.
+     */
+
+    const unsigned char *row0;
+    const unsigned char *row1;
+    unsigned char *row_dest;
+    int x;
+    int y;
+
+    for (y = 0; y < height / 2; y++) {
+        row0 = src + (y * 2) * width * 4;
+        row1 = row0 + width * 4;
+        row_dest = dest + y * (width / 2) * 4;
+
+        if (!linear) {
+            for (x = 0; x < width / 2; x++)
+                average_pixel(row0, row1, x, row_dest + x * 4);
+            continue;
+        }
+
+        x = 0;
+#ifdef SIMD_X86
+        if (simd == SIMD_AVX2)
+            x = downsample_row_avx2(row0, row1, width / 2, row_dest, premultiply);
+#endif
+
+        for (; x < width / 2; x++)
+            downsample_pixel(row0, row1, x, row_dest + x * 4, premultiply);
+    }
+}
@@ -0,0 +1,980 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "stb_dxt.h"
+
+#include "utils.h"
+#include "simd.h"
+#include "dxt.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Colors are matched against the palette the same way paa2img and stb_dxt
+ * decode it: 565 endpoints expanded by bit replication, the two other
+ * entries at 1/3 and 2/3 without rounding. Distances are squared RGB
+ * differences, which are small enough integers to be exact as floats, so
+ * all kernels pick the same indices.
+ */
+struct color_block {
+    float r[16];
+    float g[16];
+    float b[16];
+};
+
+/*
+ * The splits of the 16 sorted pixels into the 4 palette entries for the
+ * cluster fit, with their least squares factors scaled by 9 (see
+ * fit_clusters). Entry rows[i][j] starts the splits with the given i and
+ * j for every k from j to 16, padded to a multiple of 8 so the SIMD kernels
+ * can load them directly. Padding and splits with a singular system have all
+ * factors set to 0 and never win.
+ */
+struct partition_table {
+    int num_entries;
+    int rows[17][17];
+    unsigned char i[MAXPARTITIONS];
+    unsigned char j[MAXPARTITIONS];
+    unsigned char k[MAXPARTITIONS];
+    float alpha2[MAXPARTITIONS];
+    float beta2[MAXPARTITIONS];
+    float alphabeta2[MAXPARTITIONS];
+    float inv_det[MAXPARTITIONS];
+};
+
+struct partition_table partitions;
+
+
+void dxt_init() {
+    /*
+     * Builds the lookup tables of the encoders. Has to be called before
+     * compressing blocks on several threads.
+     */
+
+    unsigned char src[64];
+    unsigned char dest[16];
+    int alpha2;
+    int beta2;
+    int alphabeta;
+    int det;
+    int i;
+    int j;
+    int k;
+    int n;
+
+    // stb_dxt builds its tables on first use
+    memset(src, 0, sizeof(src));
+    stb_compress_dxt_block(dest, src, 1, STB_DXT_HIGHQUAL);
+
+    if (partitions.num_entries > 0)
+        return;
+
+    n = 0;
+    for (i = 0; i <= 16; i++) {
+        for (j = i; j <= 16; j++) {
+            partitions.rows[i][j] = n;
+
+            for (k = j; k < j + (17 - j + 7) / 8 * 8; k++, n++) {
+                partitions.i[n] = i;
+                partitions.j[n] = j;
+                partitions.k[n] = MIN(k, 16);
+                partitions.alpha2[n] = 0.0f;
+                partitions.beta2[n] = 0.0f;
+                partitions.alphabeta2[n] = 0.0f;
+                partitions.inv_det[n] = 0.0f;
+
+                if (k > 16)
+                    continue;
+
+                alpha2 = 9 * i + 4 * (j - i) + (k - j);
+                beta2 = (j - i) + 4 * (k - j) + 9 * (16 - k);
+                alphabeta = 2 * (k - i);
+
+                det = alpha2 * beta2 - alphabeta * alphabeta;
+                if (det == 0)
+                    continue;
+
+                partitions.alpha2[n] = (float)alpha2;
+                partitions.beta2[n] = (float)beta2;
+                partitions.alphabeta2[n] = (float)(2 * alphabeta);
+                partitions.inv_det[n] = 1.0f / det;
+            }
+        }
+    }
+
+    partitions.num_entries = n;
+}
+
+
+int dxt_quality(char *name) {
+    /*
+     * Returns the quality tier with the given name, or -1 if there is none.
+     */
+
+    if (stricmp(name, "fast") == 0)
+        return DXT_FAST;
+    if (stricmp(name, "normal") == 0)
+        return DXT_NORMAL;
+    if (stricmp(name, "best") == 0)
+        return DXT_BEST;
+
+    return -1;
+}
+
+
+static int expand5(int v) {
+    return (v << 3) | (v >> 2);
+}
+
+
+static int expand6(int v) {
+    return (v << 2) | (v >> 4);
+}
+
+
+static int quantize(float v, int max) {
+    int q;
+
+    q = (int)(v * max / 255.0f + 0.5f);
+
+    return MAX(0, MIN(q, max));
+}
+
+
+static uint16_t pack565(float r, float g, float b) {
+    return (uint16_t)((quantize(r, 31) << 11) | (quantize(g, 63) << 5) | quantize(b, 31));
+}
+
+
+static int color_palette(uint16_t c0, uint16_t c1, float palette[3][4]) {
+    /*
+     * Decodes the palette of the given endpoints and returns the number of
+     * usable entries. Equal endpoints switch the decoder to the 3 color
+     * mode, where only the first entries are still the endpoint color.
+     */
+
+    int first[3];
+    int second[3];
+    int i;
+
+    first[0] = expand5(c0 >> 11);
+    first[1] = expand6((c0 >> 5) & 63);
+    first[2] = expand5(c0 & 31);
+    second[0] = expand5(c1 >> 11);
+    second[1] = expand6((c1 >> 5) & 63);
+    second[2] = expand5(c1 & 31);
+
+    for (i = 0; i < 3; i++) {
+        palette[i][0] = (float)first[i];
+        palette[i][1] = (float)second[i];
+        palette[i][2] = (float)((2 * first[i] + second[i]) / 3);
+        palette[i][3] = (float)((first[i] + 2 * second[i]) / 3);
+    }
+
+    return (c0 == c1) ? 1 : 4;
+}
+
+
+static uint32_t match_colors_scalar(const struct color_block *block, float palette[3][4], int num_colors,
+        unsigned char *indices) {
+    uint32_t error;
+    int best;
+    int d;
+    int i;
+    int k;
+
+    error = 0;
+    for (i = 0; i < 16; i++) {
+        best = INT32_MAX;
+        for (k = 0; k < num_colors; k++) {
+            d = ((int)block->r[i] - (int)palette[0][k]) * ((int)block->r[i] - (int)palette[0][k]) +
+                ((int)block->g[i] - (int)palette[1][k]) * ((int)block->g[i] - (int)palette[1][k]) +
+                ((int)block->b[i] - (int)palette[2][k]) * ((int)block->b[i] - (int)palette[2][k]);
+            if (d < best) {
+                best = d;
+                indices[i] = k;
+            }
+        }
+        error += best;
+    }
+
+    return error;
+}
+
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static uint32_t match_colors_sse2(const struct color_block *block, float palette[3][4], int num_colors,
+        unsigned char *indices) {
+    float lanes[4];
+    int i;
+    int k;
+    __m128 r;
+    __m128 g;
+    __m128 b;
+    __m128 t;
+    __m128 d;
+    __m128 mask;
+    __m128 best;
+    __m128 index;
+    __m128 total = _mm_setzero_ps();
+
+    for (i = 0; i < 16; i += 4) {
+        r = _mm_loadu_ps(block->r + i);
+        g = _mm_loadu_ps(block->g + i);
+        b = _mm_loadu_ps(block->b + i);
+
+        best = _mm_set1_ps(1e30f);
+        index = _mm_setzero_ps();
+
+        for (k = 0; k < num_colors; k++) {
+            t = _mm_sub_ps(r, _mm_set1_ps(palette[0][k]));
+            d = _mm_mul_ps(t, t);
+            t = _mm_sub_ps(g, _mm_set1_ps(palette[1][k]));
+            d = _mm_add_ps(d, _mm_mul_ps(t, t));
+            t = _mm_sub_ps(b, _mm_set1_ps(palette[2][k]));
+            d = _mm_add_ps(d, _mm_mul_ps(t, t));
+
+            mask = _mm_cmplt_ps(d, best);
+            best = _mm_min_ps(d, best);
+            index = _mm_or_ps(_mm_and_ps(mask, _mm_set1_ps((float)k)), _mm_andnot_ps(mask, index));
+        }
+
+        total = _mm_add_ps(total, best);
+
+        _mm_storeu_ps(lanes, index);
+        for (k = 0; k < 4; k++)
+            indices[i + k] = (unsigned char)lanes[k];
+    }
+
+    _mm_storeu_ps(lanes, total);
+
+    return (uint32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+
+SIMD_TARGET("avx2")
+static uint32_t match_colors_avx2(const struct color_block *block, float palette[3][4], int num_colors,
+        unsigned char *indices) {
+    float lanes[8];
+    int i;
+    int k;
+    __m256 r;
+    __m256 g;
+    __m256 b;
+    __m256 t;
+    __m256 d;
+    __m256 mask;
+    __m256 best;
+    __m256 index;
+    __m256 total = _mm256_setzero_ps();
+
+    for (i = 0; i < 16; i += 8) {
+        r = _mm256_loadu_ps(block->r + i);
+        g = _mm256_loadu_ps(block->g + i);
+        b = _mm256_loadu_ps(block->b + i);
+
+        best = _mm256_set1_ps(1e30f);
+        index = _mm256_setzero_ps();
+
+        for (k = 0; k < num_colors; k++) {
+            t = _mm256_sub_ps(r, _mm256_set1_ps(palette[0][k]));
+            d = _mm256_mul_ps(t, t);
+            t = _mm256_sub_ps(g, _mm256_set1_ps(palette[1][k]));
+            d = _mm256_add_ps(d, _mm256_mul_ps(t, t));
+            t = _mm256_sub_ps(b, _mm256_set1_ps(palette[2][k]));
+            d = _mm256_add_ps(d, _mm256_mul_ps(t, t));
+
+            mask = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+            best = _mm256_min_ps(d, best);
+            index = _mm256_blendv_ps(index, _mm256_set1_ps((float)k), mask);
+        }
+
+        total = _mm256_add_ps(total, best);
+
+        _mm256_storeu_ps(lanes, index);
+        for (k = 0; k < 8; k++)
+            indices[i + k] = (unsigned char)lanes[k];
+    }
+
+    _mm256_storeu_ps(lanes, total);
+
+    return (uint32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7]);
+}
+
+SIMD_TARGET("sse2")
+static int search_partitions_sse2(float prefix[3][PREFIXSIZE]) {
+    float lanes[4];
+    int lanes_index[4];
+    int best_index;
+    float best_error;
+    int base;
+    int i;
+    int j;
+    int n;
+    __m128 third = _mm_set1_ps(1.0f / 3.0f);
+    __m128 sr;
+    __m128 sg;
+    __m128 sb;
+    __m128 ar;
+    __m128 ag;
+    __m128 ab;
+    __m128 aa;
+    __m128 axb;
+    __m128 bb;
+    __m128 t;
+    __m128 error;
+    __m128 mask;
+    __m128 best = _mm_setzero_ps();
+    __m128i index;
+    __m128i best_indices = _mm_set1_epi32(-1);
+
+    for (i = 0; i <= 16; i++) {
+        for (j = i; j <= 16; j++) {
+            base = partitions.rows[i][j];
+            sr = _mm_set1_ps(prefix[0][i] + prefix[0][j]);
+            sg = _mm_set1_ps(prefix[1][i] + prefix[1][j]);
+            sb = _mm_set1_ps(prefix[2][i] + prefix[2][j]);
+
+            for (n = 0; n < 17 - j; n += 4) {
+                ar = _mm_mul_ps(_mm_add_ps(sr, _mm_loadu_ps(prefix[0] + j + n)), third);
+                ag = _mm_mul_ps(_mm_add_ps(sg, _mm_loadu_ps(prefix[1] + j + n)), third);
+                ab = _mm_mul_ps(_mm_add_ps(sb, _mm_loadu_ps(prefix[2] + j + n)), third);
+
+                aa = _mm_mul_ps(ar, ar);
+                t = _mm_sub_ps(_mm_set1_ps(prefix[0][16]), ar);
+                axb = _mm_mul_ps(ar, t);
+                bb = _mm_mul_ps(t, t);
+                aa = _mm_add_ps(aa, _mm_mul_ps(ag, ag));
+                t = _mm_sub_ps(_mm_set1_ps(prefix[1][16]), ag);
+                axb = _mm_add_ps(axb, _mm_mul_ps(ag, t));
+                bb = _mm_add_ps(bb, _mm_mul_ps(t, t));
+                aa = _mm_add_ps(aa, _mm_mul_ps(ab, ab));
+                t = _mm_sub_ps(_mm_set1_ps(prefix[2][16]), ab);
+                axb = _mm_add_ps(axb, _mm_mul_ps(ab, t));
+                bb = _mm_add_ps(bb, _mm_mul_ps(t, t));
+
+                error = _mm_mul_ps(_mm_loadu_ps(partitions.alphabeta2 + base + n), axb);
+                error = _mm_sub_ps(error, _mm_mul_ps(_mm_loadu_ps(partitions.beta2 + base + n), aa));
+                error = _mm_sub_ps(error, _mm_mul_ps(_mm_loadu_ps(partitions.alpha2 + base + n), bb));
+                error = _mm_mul_ps(error, _mm_loadu_ps(partitions.inv_det + base + n));
+
+                index = _mm_add_epi32(_mm_set1_epi32(base + n), _mm_set_epi32(3, 2, 1, 0));
+                mask = _mm_cmplt_ps(error, best);
+                best = _mm_or_ps(_mm_and_ps(mask, error), _mm_andnot_ps(mask, best));
+                best_indices = _mm_or_si128(_mm_and_si128(_mm_castps_si128(mask), index),
+                        _mm_andnot_si128(_mm_castps_si128(mask), best_indices));
+            }
+        }
+    }
+
+    _mm_storeu_ps(lanes, best);
+    _mm_storeu_si128((__m128i *)lanes_index, best_indices);
+
+    // every lane holds its first minimum, so the lowest index wins ties
+    best_index = -1;
+    best_error = 0.0f;
+    for (n = 0; n < 4; n++) {
+        if (lanes_index[n] < 0)
+            continue;
+        if (best_index < 0 || lanes[n] < best_error || (lanes[n] == best_error && lanes_index[n] < best_index)) {
+            best_error = lanes[n];
+            best_index = lanes_index[n];
+        }
+    }
+
+    return best_index;
+}
+
+
+SIMD_TARGET("avx2")
+static int search_partitions_avx2(float prefix[3][PREFIXSIZE]) {
+    float lanes[8];
+    int lanes_index[8];
+    int best_index;
+    float best_error;
+    int base;
+    int i;
+    int j;
+    int n;
+    __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+    __m256 sr;
+    __m256 sg;
+    __m256 sb;
+    __m256 ar;
+    __m256 ag;
+    __m256 ab;
+    __m256 aa;
+    __m256 axb;
+    __m256 bb;
+    __m256 t;
+    __m256 error;
+    __m256 mask;
+    __m256 best = _mm256_setzero_ps();
+    __m256i index;
+    __m256i best_indices = _mm256_set1_epi32(-1);
+
+    for (i = 0; i <= 16; i++) {
+        for (j = i; j <= 16; j++) {
+            base = partitions.rows[i][j];
+            sr = _mm256_set1_ps(prefix[0][i] + prefix[0][j]);
+            sg = _mm256_set1_ps(prefix[1][i] + prefix[1][j]);
+            sb = _mm256_set1_ps(prefix[2][i] + prefix[2][j]);
+
+            for (n = 0; n < 17 - j; n += 8) {
+                ar = _mm256_mul_ps(_mm256_add_ps(sr, _mm256_loadu_ps(prefix[0] + j + n)), third);
+                ag = _mm256_mul_ps(_mm256_add_ps(sg, _mm256_loadu_ps(prefix[1] + j + n)), third);
+                ab = _mm256_mul_ps(_mm256_add_ps(sb, _mm256_loadu_ps(prefix[2] + j + n)), third);
+
+                aa = _mm256_mul_ps(ar, ar);
+                t = _mm256_sub_ps(_mm256_set1_ps(prefix[0][16]), ar);
+                axb = _mm256_mul_ps(ar, t);
+                bb = _mm256_mul_ps(t, t);
+                aa = _mm256_add_ps(aa, _mm256_mul_ps(ag, ag));
+                t = _mm256_sub_ps(_mm256_set1_ps(prefix[1][16]), ag);
+                axb = _mm256_add_ps(axb, _mm256_mul_ps(ag, t));
+                bb = _mm256_add_ps(bb, _mm256_mul_ps(t, t));
+                aa = _mm256_add_ps(aa, _mm256_mul_ps(ab, ab));
+                t = _mm256_sub_ps(_mm256_set1_ps(prefix[2][16]), ab);
+                axb = _mm256_add_ps(axb, _mm256_mul_ps(ab, t));
+                bb = _mm256_add_ps(bb, _mm256_mul_ps(t, t));
+
+                error = _mm256_mul_ps(_mm256_loadu_ps(partitions.alphabeta2 + base + n), axb);
+                error = _mm256_sub_ps(error, _mm256_mul_ps(_mm256_loadu_ps(partitions.beta2 + base + n), aa));
+                error = _mm256_sub_ps(error, _mm256_mul_ps(_mm256_loadu_ps(partitions.alpha2 + base + n), bb));
+                error = _mm256_mul_ps(error, _mm256_loadu_ps(partitions.inv_det + base + n));
+
+                index = _mm256_add_epi32(_mm256_set1_epi32(base + n), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+                mask = _mm256_cmp_ps(error, best, _CMP_LT_OQ);
+                best = _mm256_blendv_ps(best, error, mask);
+                best_indices = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best_indices),
+                        _mm256_castsi256_ps(index), mask));
+            }
+        }
+    }
+
+    _mm256_storeu_ps(lanes, best);
+    _mm256_storeu_si256((__m256i *)lanes_index, best_indices);
+
+    best_index = -1;
+    best_error = 0.0f;
+    for (n = 0; n < 8; n++) {
+        if (lanes_index[n] < 0)
+            continue;
+        if (best_index < 0 || lanes[n] < best_error || (lanes[n] == best_error && lanes_index[n] < best_index)) {
+            best_error = lanes[n];
+            best_index = lanes_index[n];
+        }
+    }
+
+    return best_index;
+}
+
+#endif
+
+
+static uint32_t match_colors(const struct color_block *block, uint16_t c0, uint16_t c1,
+        unsigned char *indices, int simd) {
+    /*
+     * Picks the closest palette entry for every pixel and returns the sum of
+     * the squared errors.
+     */
+
+    float palette[3][4];
+    int num_colors;
+
+    num_colors = color_palette(c0, c1, palette);
+
+#ifdef SIMD_X86
+    switch (simd) {
+        case SIMD_AVX2: return match_colors_avx2(block, palette, num_colors, indices);
+        case SIMD_SSE2: return match_colors_sse2(block, palette, num_colors, indices);
+    }
+#endif
+
+    return match_colors_scalar(block, palette, num_colors, indices);
+}
+
+
+static void try_endpoints(const struct color_block *block, uint16_t c0, uint16_t c1, int simd,
+        uint32_t *best_error, uint16_t *best_endpoints, unsigned char *best_indices) {
+    /*
+     * Keeps the given endpoints if they beat the best ones so far. The
+     * first endpoint has to be the larger one for the 4 color mode.
+     */
+
+    unsigned char indices[16];
+    uint32_t error;
+    uint16_t temp;
+
+    if (c0 < c1) {
+        temp = c0;
+        c0 = c1;
+        c1 = temp;
+    }
+
+    error = match_colors(block, c0, c1, indices, simd);
+    if (error >= *best_error)
+        return;
+
+    *best_error = error;
+    best_endpoints[0] = c0;
+    best_endpoints[1] = c1;
+    memcpy(best_indices, indices, 16);
+}
+
+
+static void fit_bounding_box(const struct color_block *block, uint16_t *c0, uint16_t *c1) {
+    /*
+     * Uses the corners of the bounding box of the block, moved inwards by
+     * 1/16 of its size, as endpoints. Red and blue are flipped if they go
+     * against green, so the diagonal follows the colors of the block.
+     */
+
+    float min[3];
+    float max[3];
+    float mean[3];
+    float inset;
+    float cov_rg;
+    float cov_bg;
+    float temp;
+    int i;
+
+    min[0] = max[0] = block->r[0];
+    min[1] = max[1] = block->g[0];
+    min[2] = max[2] = block->b[0];
+    mean[0] = mean[1] = mean[2] = 0.0f;
+
+    for (i = 0; i < 16; i++) {
+        min[0] = MIN(min[0], block->r[i]);
+        min[1] = MIN(min[1], block->g[i]);
+        min[2] = MIN(min[2], block->b[i]);
+        max[0] = MAX(max[0], block->r[i]);
+        max[1] = MAX(max[1], block->g[i]);
+        max[2] = MAX(max[2], block->b[i]);
+        mean[0] += block->r[i];
+        mean[1] += block->g[i];
+        mean[2] += block->b[i];
+    }
+
+    for (i = 0; i < 3; i++) {
+        mean[i] /= 16.0f;
+        inset = (max[i] - min[i]) / 16.0f;
+        min[i] += inset;
+        max[i] -= inset;
+    }
+
+    cov_rg = 0.0f;
+    cov_bg = 0.0f;
+    for (i = 0; i < 16; i++) {
+        cov_rg += (block->r[i] - mean[0]) * (block->g[i] - mean[1]);
+        cov_bg += (block->b[i] - mean[2]) * (block->g[i] - mean[1]);
+    }
+
+    if (cov_rg < 0.0f) {
+        temp = min[0];
+        min[0] = max[0];
+        max[0] = temp;
+    }
+    if (cov_bg < 0.0f) {
+        temp = min[2];
+        min[2] = max[2];
+        max[2] = temp;
+    }
+
+    *c0 = pack565(max[0], max[1], max[2]);
+    *c1 = pack565(min[0], min[1], min[2]);
+}
+
+
+static void principal_axis(const struct color_block *block, float *mean, float *axis) {
+    float cov[6];
+    float x[3];
+    float v[3];
+    float scale;
+    int i;
+
+    mean[0] = mean[1] = mean[2] = 0.0f;
+    for (i = 0; i < 16; i++) {
+        mean[0] += block->r[i];
+        mean[1] += block->g[i];
+        mean[2] += block->b[i];
+    }
+    for (i = 0; i < 3; i++)
+        mean[i] /= 16.0f;
+
+    memset(cov, 0, sizeof(cov));
+    for (i = 0; i < 16; i++) {
+        x[0] = block->r[i] - mean[0];
+        x[1] = block->g[i] - mean[1];
+        x[2] = block->b[i] - mean[2];
+        cov[0] += x[0] * x[0];
+        cov[1] += x[0] * x[1];
+        cov[2] += x[0] * x[2];
+        cov[3] += x[1] * x[1];
+        cov[4] += x[1] * x[2];
+        cov[5] += x[2] * x[2];
+    }
+
+    // power iteration, starting with the column of the largest variance
+    if (cov[0] >= cov[3] && cov[0] >= cov[5]) {
+        axis[0] = cov[0]; axis[1] = cov[1]; axis[2] = cov[2];
+    } else if (cov[3] >= cov[5]) {
+        axis[0] = cov[1]; axis[1] = cov[3]; axis[2] = cov[4];
+    } else {
+        axis[0] = cov[2]; axis[1] = cov[4]; axis[2] = cov[5];
+    }
+
+    for (i = 0; i < 8; i++) {
+        v[0] = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        v[1] = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        v[2] = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+        scale = MAX(fabsf(v[0]), MAX(fabsf(v[1]), fabsf(v[2])));
+        if (scale < 1e-6f)
+            break;
+
+        axis[0] = v[0] / scale;
+        axis[1] = v[1] / scale;
+        axis[2] = v[2] / scale;
+    }
+}
+
+
+static int search_partitions_scalar(float prefix[3][PREFIXSIZE]) {
+    /*
+     * Returns the index of the split in the partition table with the
+     * smallest least squares error, or -1 if no split has one.
+     */
+
+    float alphax[3];
+    float betax[3];
+    float aa;
+    float ab;
+    float bb;
+    float error;
+    float best_error;
+    int best_index;
+    int i;
+    int j;
+    int n;
+    int ch;
+
+    best_index = -1;
+    best_error = 0.0f;
+
+    for (i = 0; i <= 16; i++) {
+        for (j = i; j <= 16; j++) {
+            for (n = partitions.rows[i][j]; n < partitions.rows[i][j] + 17 - j; n++) {
+                aa = 0.0f;
+                ab = 0.0f;
+                bb = 0.0f;
+                for (ch = 0; ch < 3; ch++) {
+                    alphax[ch] = ((prefix[ch][i] + prefix[ch][j]) + prefix[ch][partitions.k[n]]) * (1.0f / 3.0f);
+                    betax[ch] = prefix[ch][16] - alphax[ch];
+                    aa += alphax[ch] * alphax[ch];
+                    ab += alphax[ch] * betax[ch];
+                    bb += betax[ch] * betax[ch];
+                }
+
+                // without the constant sum of x^2
+                error = (partitions.alphabeta2[n] * ab - partitions.beta2[n] * aa - partitions.alpha2[n] * bb) *
+                        partitions.inv_det[n];
+
+                if (error < best_error) {
+                    best_error = error;
+                    best_index = n;
+                }
+            }
+        }
+    }
+
+    return best_index;
+}
+
+
+static void fit_clusters(const struct color_block *block, uint16_t *c0, uint16_t *c1, int simd) {
+    /*
+     * Cluster fit: the pixels are sorted along the principal axis and every
+     * split of that order into the 4 palette entries is tried. The split
+     * whose least squares endpoints have the smallest error is kept and
+     * those endpoints are snapped to 565.
+     *
+     * With the palette weights 1, 2/3, 1/3 and 0 the weighted sums reduce
+     * to alphax = (P[i] + P[j] + P[k]) / 3 and betax = P[16] - alphax for
+     * the prefix sums P.
+     */
+
+    float mean[3];
+    float axis[3];
+    float dots[16];
+    float prefix[3][PREFIXSIZE];
+    float alphax;
+    float betax;
+    float alpha2;
+    float beta2;
+    float alphabeta;
+    float a[3];
+    float b[3];
+    float temp;
+    int order[16];
+    int best;
+    int i;
+    int j;
+    int k;
+    int n;
+    int ch;
+
+    principal_axis(block, mean, axis);
+
+    for (i = 0; i < 16; i++) {
+        order[i] = i;
+        dots[i] = (block->r[i] - mean[0]) * axis[0] + (block->g[i] - mean[1]) * axis[1] + (block->b[i] - mean[2]) * axis[2];
+    }
+
+    // insertion sort, 16 entries only
+    for (i = 1; i < 16; i++) {
+        n = order[i];
+        temp = dots[n];
+        for (j = i; j > 0 && dots[order[j - 1]] > temp; j--)
+            order[j] = order[j - 1];
+        order[j] = n;
+    }
+
+    memset(prefix, 0, sizeof(prefix));
+    for (i = 0; i < 16; i++) {
+        prefix[0][i + 1] = prefix[0][i] + block->r[order[i]];
+        prefix[1][i + 1] = prefix[1][i] + block->g[order[i]];
+        prefix[2][i + 1] = prefix[2][i] + block->b[order[i]];
+    }
+
+    fit_bounding_box(block, c0, c1);
+
+    best = -1;
+#ifdef SIMD_X86
+    switch (simd) {
+        case SIMD_AVX2: best = search_partitions_avx2(prefix); break;
+        case SIMD_SSE2: best = search_partitions_sse2(prefix); break;
+        default: best = search_partitions_scalar(prefix);
+    }
+#else
+    best = search_partitions_scalar(prefix);
+#endif
+
+    if (best < 0)
+        return;
+
+    i = partitions.i[best];
+    j = partitions.j[best];
+    k = partitions.k[best];
+
+    alpha2 = partitions.alpha2[best];
+    beta2 = partitions.beta2[best];
+    alphabeta = partitions.alphabeta2[best] * 0.5f;
+
+    for (ch = 0; ch < 3; ch++) {
+        alphax = ((prefix[ch][i] + prefix[ch][j]) + prefix[ch][k]) * (1.0f / 3.0f);
+        betax = prefix[ch][16] - alphax;
+        a[ch] = 9.0f * (alphax * beta2 - betax * alphabeta) * partitions.inv_det[best];
+        b[ch] = 9.0f * (betax * alpha2 - alphax * alphabeta) * partitions.inv_det[best];
+    }
+
+    // snap the endpoints to the values 565 can represent
+    *c0 = pack565(a[0], a[1], a[2]);
+    *c1 = pack565(b[0], b[1], b[2]);
+}
+
+
+static void compress_color_block(unsigned char *dest, const unsigned char *src, int quality, int simd) {
+    struct color_block block;
+    unsigned char indices[16];
+    unsigned char stb_block[8];
+    uint32_t error;
+    uint32_t mask;
+    uint16_t endpoints[2];
+    uint16_t c0;
+    uint16_t c1;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        block.r[i] = (float)src[i * 4 + 0];
+        block.g[i] = (float)src[i * 4 + 1];
+        block.b[i] = (float)src[i * 4 + 2];
+    }
+
+    error = UINT32_MAX;
+    endpoints[0] = 0;
+    endpoints[1] = 0;
+
+    fit_bounding_box(&block, &c0, &c1);
+    try_endpoints(&block, c0, c1, simd, &error, endpoints, indices);
+
+    if (quality == DXT_BEST && error > 0) {
+        fit_clusters(&block, &c0, &c1, simd);
+        try_endpoints(&block, c0, c1, simd, &error, endpoints, indices);
+
+        // stb_dxt handles single colors and gradients well, so it competes too
+        stb_compress_dxt_block(stb_block, src, 0, STB_DXT_HIGHQUAL);
+        try_endpoints(&block, stb_block[0] | (stb_block[1] << 8), stb_block[2] | (stb_block[3] << 8),
+                simd, &error, endpoints, indices);
+    }
+
+    mask = 0;
+    for (i = 0; i < 16; i++)
+        mask |= (uint32_t)indices[i] << (i * 2);
+
+    dest[0] = endpoints[0] & 0xff;
+    dest[1] = endpoints[0] >> 8;
+    dest[2] = endpoints[1] & 0xff;
+    dest[3] = endpoints[1] >> 8;
+    dest[4] = mask & 0xff;
+    dest[5] = (mask >> 8) & 0xff;
+    dest[6] = (mask >> 16) & 0xff;
+    dest[7] = mask >> 24;
+}
+
+
+static uint32_t match_alpha(const unsigned char *src, int a0, int a1, unsigned char *indices) {
+    /*
+     * Picks the closest alpha value for every pixel, decoded like paa2img
+     * does, and returns the sum of the squared errors.
+     */
+
+    int palette[8];
+    uint32_t error;
+    int best;
+    int d;
+    int i;
+    int k;
+
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (i = 1; i < 7; i++)
+            palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (i = 1; i < 5; i++)
+            palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    error = 0;
+    for (i = 0; i < 16; i++) {
+        best = INT32_MAX;
+        for (k = 0; k < 8; k++) {
+            d = (src[i * 4 + 3] - palette[k]) * (src[i * 4 + 3] - palette[k]);
+            if (d < best) {
+                best = d;
+                indices[i] = k;
+            }
+        }
+        error += best;
+    }
+
+    return error;
+}
+
+
+static void compress_alpha_block(unsigned char *dest, const unsigned char *src, int quality) {
+    /*
+     * Uses the alpha range of the block with 8 values. DXT_BEST also tries
+     * the 6 value mode, which has exact 0 and 255 in addition to the range
+     * of the values in between.
+     */
+
+    unsigned char indices[16];
+    unsigned char best_indices[16];
+    uint32_t error;
+    uint32_t best_error;
+    uint64_t mask;
+    int min;
+    int max;
+    int inner_min;
+    int inner_max;
+    int a0;
+    int a1;
+    int i;
+
+    min = 255;
+    max = 0;
+    inner_min = 255;
+    inner_max = 0;
+    for (i = 0; i < 16; i++) {
+        min = MIN(min, src[i * 4 + 3]);
+        max = MAX(max, src[i * 4 + 3]);
+        if (src[i * 4 + 3] > 0 && src[i * 4 + 3] < 255) {
+            inner_min = MIN(inner_min, src[i * 4 + 3]);
+            inner_max = MAX(inner_max, src[i * 4 + 3]);
+        }
+    }
+
+    a0 = max;
+    a1 = min;
+    best_error = match_alpha(src, a0, a1, best_indices);
+
+    if (quality == DXT_BEST && inner_min <= inner_max) {
+        error = match_alpha(src, inner_min, inner_max, indices);
+        if (error < best_error) {
+            best_error = error;
+            a0 = inner_min;
+            a1 = inner_max;
+            memcpy(best_indices, indices, 16);
+        }
+    }
+
+    mask = 0;
+    for (i = 0; i < 16; i++)
+        mask |= (uint64_t)best_indices[i] << (i * 3);
+
+    dest[0] = a0;
+    dest[1] = a1;
+    for (i = 0; i < 6; i++)
+        dest[i + 2] = (mask >> (i * 8)) & 0xff;
+}
+
+
+void dxt_compress_block(unsigned char *dest, const unsigned char *src, int alpha, int quality, int simd) {
+    /*
+     * Compresses a block of 4x4 RGBA pixels to DXT1, or DXT5 if alpha is
+     * set. simd is the instruction set to use, as returned by simd_level.
+     */
+
+    if (quality == DXT_NORMAL) {
+        stb_compress_dxt_block(dest, src, alpha, STB_DXT_HIGHQUAL);
+        return;
+    }
+
+    if (alpha) {
+        compress_alpha_block(dest, src, quality);
+        dest += 8;
+    }
+
+    compress_color_block(dest, src, quality, simd);
+}
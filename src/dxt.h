@@ -0,0 +1,43 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#define MAXPARTITIONS 1592
+#define PREFIXSIZE 24
+
+
+/*
+ * Encoder quality tiers: DXT_FAST fits the endpoints to the bounding box of
+ * the block, DXT_NORMAL is stb_dxt's high quality mode and DXT_BEST searches
+ * all clusterings of the block along its principal axis, keeping whichever
+ * of its own and stb_dxt's endpoints give the smaller error.
+ */
+enum {
+    DXT_FAST,
+    DXT_NORMAL,
+    DXT_BEST
+};
+
+
+void dxt_init();
+
+int dxt_quality(char *name);
+
+void dxt_compress_block(unsigned char *dest, const unsigned char *src, int alpha, int quality, int simd);
@@ -26,6 +26,7 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <wchar.h>
+#include <sys/stat.h>
 #else
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -203,6 +204,66 @@ int create_temp_folder(char *addon, char *temp_folder, size_t bufsize) {
 }
 
 
+int64_t get_file_size(char *path) {
+    /*
+     * Returns the size of the given file in bytes or -1 on failure.
+     */
+
+    struct stat st;
+
+    if (stat(path, &st))
+        return -1;
+
+    return (int64_t)st.st_size;
+}
+
+
+int64_t get_file_mtime(char *path) {
+    /*
+     * Returns the modification time of the given file or -1 on failure.
+     */
+
+    struct stat st;
+
+    if (stat(path, &st))
+        return -1;
+
+    return (int64_t)st.st_mtime;
+}
+
+
+FILE *open_memory_file(void *data, size_t size) {
+    /*
+     * Opens the given data for reading as a file. The data has to stay
+     * around until the file is closed. Returns NULL on failure.
+     */
+
+#ifdef _WIN32
+
+    FILE *f;
+
+    // no fmemopen, use an anonymous temp file that is deleted on close
+    f = tmpfile();
+    if (!f)
+        return NULL;
+
+    if (fwrite(data, size, 1, f) != 1) {
+        fclose(f);
+        return NULL;
+    }
+
+    rewind(f);
+
+    return f;
+
+#else
+
+    return fmemopen(data, size, "rb");
+
+#endif
+}
+
+
 int remove_file(char *path) {
     /*
      * Remove a file. Returns 0 on success and 1 on failure.
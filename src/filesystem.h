@@ -19,6 +19,10 @@
 #pragma once
 
 
+#include <stdio.h>
+#include <stdint.h>
+
+
 #ifdef _WIN32
 #define PATHSEP '\\'
 #define PATHSEP_STR "\\"
@@ -44,6 +48,12 @@ int create_folders(char *path);
 
 int create_temp_folder(char *addon, char *temp_folder, size_t bufsize);
 
+int64_t get_file_size(char *path);
+
+int64_t get_file_mtime(char *path);
+
+FILE *open_memory_file(void *data, size_t size);
+
 int remove_file(char *path);
 
 int remove_folder(char *folder);
@@ -0,0 +1,661 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "utils.h"
+#include "simd.h"
+#include "geometry.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+void point_soa_init(struct point_soa *soa, const void *points, uint32_t num_points, size_t stride) {
+    /*
+     * Copies the coordinates of the given points into one array per axis.
+     * Each point starts with its x, y and z coordinates, stride is the
+     * distance between two points in bytes.
+     */
+
+    const float *point;
+    uint32_t i;
+
+    soa->num_points = num_points;
+    soa->x = (float *)safe_malloc(sizeof(float) * 3 * MAX(num_points, 1));
+    soa->y = soa->x + num_points;
+    soa->z = soa->y + num_points;
+
+    for (i = 0; i < num_points; i++) {
+        point = (const float *)((const char *)points + i * stride);
+        soa->x[i] = point[0];
+        soa->y[i] = point[1];
+        soa->z[i] = point[2];
+    }
+}
+
+
+void point_soa_free(struct point_soa *soa) {
+    free(soa->x);
+
+    soa->num_points = 0;
+    soa->x = NULL;
+    soa->y = NULL;
+    soa->z = NULL;
+}
+
+
+static double fold_lanes(const double *lanes) {
+    double sum;
+    int k;
+
+    sum = 0;
+    for (k = 0; k < GEOMETRYLANES; k++)
+        sum += lanes[k];
+
+    return sum;
+}
+
+
+static void fold_bounds(const float *lanes, int num_lanes, float *min, float *max) {
+    /*
+     * Merges num_lanes partial minimums and maximums (stored after one
+     * another) into min and max.
+     */
+
+    int k;
+
+    for (k = 0; k < num_lanes; k++) {
+        if (lanes[k] < *min)
+            *min = lanes[k];
+        if (lanes[num_lanes + k] > *max)
+            *max = lanes[num_lanes + k];
+    }
+}
+
+
+static void bounds_scalar(const struct point_soa *soa, uint32_t start, float *min, float *max) {
+    uint32_t i;
+
+    for (i = start; i < soa->num_points; i++) {
+        if (soa->x[i] < min[0])
+            min[0] = soa->x[i];
+        if (soa->x[i] > max[0])
+            max[0] = soa->x[i];
+
+        if (soa->y[i] < min[1])
+            min[1] = soa->y[i];
+        if (soa->y[i] > max[1])
+            max[1] = soa->y[i];
+
+        if (soa->z[i] < min[2])
+            min[2] = soa->z[i];
+        if (soa->z[i] > max[2])
+            max[2] = soa->z[i];
+    }
+}
+
+
+static float sphere_scalar(const struct point_soa *soa, uint32_t start, vector center, float sphere) {
+    uint32_t i;
+    float dx;
+    float dy;
+    float dz;
+    float dist;
+
+    for (i = start; i < soa->num_points; i++) {
+        dx = soa->x[i] - center.x;
+        dy = soa->y[i] - center.y;
+        dz = soa->z[i] - center.z;
+
+        dist = dx * dx + dy * dy + dz * dz;
+        if (dist > sphere)
+            sphere = dist;
+    }
+
+    return sphere;
+}
+
+
+static void mass_scalar(const struct point_soa *soa, const float *mass, uint32_t start,
+        double sums[4][GEOMETRYLANES]) {
+    uint32_t i;
+    int lane;
+    double m;
+
+    for (i = start; i < soa->num_points; i++) {
+        lane = i % GEOMETRYLANES;
+        m = mass[i];
+
+        sums[0][lane] += m;
+        sums[1][lane] += m * soa->x[i];
+        sums[2][lane] += m * soa->y[i];
+        sums[3][lane] += m * soa->z[i];
+    }
+}
+
+
+static void inertia_scalar(const struct point_soa *soa, const float *mass, uint32_t start,
+        vector centre, double sums[6][GEOMETRYLANES]) {
+    uint32_t i;
+    int lane;
+    double m;
+    double dx;
+    double dy;
+    double dz;
+
+    for (i = start; i < soa->num_points; i++) {
+        lane = i % GEOMETRYLANES;
+        m = mass[i];
+        dx = soa->x[i] - centre.x;
+        dy = soa->y[i] - centre.y;
+        dz = soa->z[i] - centre.z;
+
+        sums[0][lane] += m * (dy * dy + dz * dz);
+        sums[1][lane] += m * (dx * dx + dz * dz);
+        sums[2][lane] += m * (dx * dx + dy * dy);
+        sums[3][lane] += m * dx * dy;
+        sums[4][lane] += m * dx * dz;
+        sums[5][lane] += m * dy * dz;
+    }
+}
+
+
+#ifdef SIMD_X86
+
+/*
+ * The SIMD kernels below handle as many points as fit into whole vectors and
+ * return how many that were, the rest is left to the scalar kernels. Floats
+ * are widened to doubles in point order, so every double lane sees the same
+ * points in the same order as in mass_scalar and inertia_scalar.
+ */
+
+SIMD_TARGET("sse2")
+static uint32_t bounds_sse2(const struct point_soa *soa, float *min, float *max) {
+    float lanes[8];
+    uint32_t i;
+    __m128 v;
+    __m128 min_x = _mm_set1_ps(min[0]);
+    __m128 min_y = _mm_set1_ps(min[1]);
+    __m128 min_z = _mm_set1_ps(min[2]);
+    __m128 max_x = _mm_set1_ps(max[0]);
+    __m128 max_y = _mm_set1_ps(max[1]);
+    __m128 max_z = _mm_set1_ps(max[2]);
+
+    for (i = 0; i + 4 <= soa->num_points; i += 4) {
+        v = _mm_loadu_ps(soa->x + i);
+        min_x = _mm_min_ps(v, min_x);
+        max_x = _mm_max_ps(v, max_x);
+
+        v = _mm_loadu_ps(soa->y + i);
+        min_y = _mm_min_ps(v, min_y);
+        max_y = _mm_max_ps(v, max_y);
+
+        v = _mm_loadu_ps(soa->z + i);
+        min_z = _mm_min_ps(v, min_z);
+        max_z = _mm_max_ps(v, max_z);
+    }
+
+    _mm_storeu_ps(lanes, min_x);
+    _mm_storeu_ps(lanes + 4, max_x);
+    fold_bounds(lanes, 4, &min[0], &max[0]);
+
+    _mm_storeu_ps(lanes, min_y);
+    _mm_storeu_ps(lanes + 4, max_y);
+    fold_bounds(lanes, 4, &min[1], &max[1]);
+
+    _mm_storeu_ps(lanes, min_z);
+    _mm_storeu_ps(lanes + 4, max_z);
+    fold_bounds(lanes, 4, &min[2], &max[2]);
+
+    return i;
+}
+
+
+SIMD_TARGET("avx2")
+static uint32_t bounds_avx2(const struct point_soa *soa, float *min, float *max) {
+    float lanes[16];
+    uint32_t i;
+    __m256 v;
+    __m256 min_x = _mm256_set1_ps(min[0]);
+    __m256 min_y = _mm256_set1_ps(min[1]);
+    __m256 min_z = _mm256_set1_ps(min[2]);
+    __m256 max_x = _mm256_set1_ps(max[0]);
+    __m256 max_y = _mm256_set1_ps(max[1]);
+    __m256 max_z = _mm256_set1_ps(max[2]);
+
+    for (i = 0; i + 8 <= soa->num_points; i += 8) {
+        v = _mm256_loadu_ps(soa->x + i);
+        min_x = _mm256_min_ps(v, min_x);
+        max_x = _mm256_max_ps(v, max_x);
+
+        v = _mm256_loadu_ps(soa->y + i);
+        min_y = _mm256_min_ps(v, min_y);
+        max_y = _mm256_max_ps(v, max_y);
+
+        v = _mm256_loadu_ps(soa->z + i);
+        min_z = _mm256_min_ps(v, min_z);
+        max_z = _mm256_max_ps(v, max_z);
+    }
+
+    _mm256_storeu_ps(lanes, min_x);
+    _mm256_storeu_ps(lanes + 8, max_x);
+    fold_bounds(lanes, 8, &min[0], &max[0]);
+
+    _mm256_storeu_ps(lanes, min_y);
+    _mm256_storeu_ps(lanes + 8, max_y);
+    fold_bounds(lanes, 8, &min[1], &max[1]);
+
+    _mm256_storeu_ps(lanes, min_z);
+    _mm256_storeu_ps(lanes + 8, max_z);
+    fold_bounds(lanes, 8, &min[2], &max[2]);
+
+    return i;
+}
+
+
+SIMD_TARGET("sse2")
+static uint32_t sphere_sse2(const struct point_soa *soa, vector center, float *sphere) {
+    float lanes[4];
+    uint32_t i;
+    int k;
+    __m128 dx;
+    __m128 dy;
+    __m128 dz;
+    __m128 dist;
+    __m128 max = _mm_setzero_ps();
+    __m128 cx = _mm_set1_ps(center.x);
+    __m128 cy = _mm_set1_ps(center.y);
+    __m128 cz = _mm_set1_ps(center.z);
+
+    for (i = 0; i + 4 <= soa->num_points; i += 4) {
+        dx = _mm_sub_ps(_mm_loadu_ps(soa->x + i), cx);
+        dy = _mm_sub_ps(_mm_loadu_ps(soa->y + i), cy);
+        dz = _mm_sub_ps(_mm_loadu_ps(soa->z + i), cz);
+
+        dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        max = _mm_max_ps(dist, max);
+    }
+
+    _mm_storeu_ps(lanes, max);
+    for (k = 0; k < 4; k++) {
+        if (lanes[k] > *sphere)
+            *sphere = lanes[k];
+    }
+
+    return i;
+}
+
+
+SIMD_TARGET("avx2")
+static uint32_t sphere_avx2(const struct point_soa *soa, vector center, float *sphere) {
+    float lanes[8];
+    uint32_t i;
+    int k;
+    __m256 dx;
+    __m256 dy;
+    __m256 dz;
+    __m256 dist;
+    __m256 max = _mm256_setzero_ps();
+    __m256 cx = _mm256_set1_ps(center.x);
+    __m256 cy = _mm256_set1_ps(center.y);
+    __m256 cz = _mm256_set1_ps(center.z);
+
+    for (i = 0; i + 8 <= soa->num_points; i += 8) {
+        dx = _mm256_sub_ps(_mm256_loadu_ps(soa->x + i), cx);
+        dy = _mm256_sub_ps(_mm256_loadu_ps(soa->y + i), cy);
+        dz = _mm256_sub_ps(_mm256_loadu_ps(soa->z + i), cz);
+
+        dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        max = _mm256_max_ps(dist, max);
+    }
+
+    _mm256_storeu_ps(lanes, max);
+    for (k = 0; k < 8; k++) {
+        if (lanes[k] > *sphere)
+            *sphere = lanes[k];
+    }
+
+    return i;
+}
+
+
+SIMD_TARGET("sse2")
+static void mass_sse2_add(__m128d *acc, __m128d m, __m128d x, __m128d y, __m128d z) {
+    acc[0] = _mm_add_pd(acc[0], m);
+    acc[1] = _mm_add_pd(acc[1], _mm_mul_pd(m, x));
+    acc[2] = _mm_add_pd(acc[2], _mm_mul_pd(m, y));
+    acc[3] = _mm_add_pd(acc[3], _mm_mul_pd(m, z));
+}
+
+
+SIMD_TARGET("sse2")
+static uint32_t mass_sse2(const struct point_soa *soa, const float *mass, double sums[4][GEOMETRYLANES]) {
+    uint32_t i;
+    int k;
+    __m128 m;
+    __m128 x;
+    __m128 y;
+    __m128 z;
+    __m128d lo[4];
+    __m128d hi[4];
+
+    for (k = 0; k < 4; k++) {
+        lo[k] = _mm_loadu_pd(&sums[k][0]);
+        hi[k] = _mm_loadu_pd(&sums[k][2]);
+    }
+
+    for (i = 0; i + 4 <= soa->num_points; i += 4) {
+        m = _mm_loadu_ps(mass + i);
+        x = _mm_loadu_ps(soa->x + i);
+        y = _mm_loadu_ps(soa->y + i);
+        z = _mm_loadu_ps(soa->z + i);
+
+        mass_sse2_add(lo, _mm_cvtps_pd(m), _mm_cvtps_pd(x), _mm_cvtps_pd(y), _mm_cvtps_pd(z));
+        mass_sse2_add(hi, _mm_cvtps_pd(_mm_movehl_ps(m, m)), _mm_cvtps_pd(_mm_movehl_ps(x, x)),
+                _mm_cvtps_pd(_mm_movehl_ps(y, y)), _mm_cvtps_pd(_mm_movehl_ps(z, z)));
+    }
+
+    for (k = 0; k < 4; k++) {
+        _mm_storeu_pd(&sums[k][0], lo[k]);
+        _mm_storeu_pd(&sums[k][2], hi[k]);
+    }
+
+    return i;
+}
+
+
+SIMD_TARGET("avx2")
+static void mass_avx2_add(__m256d *acc, __m256d m, __m256d x, __m256d y, __m256d z) {
+    acc[0] = _mm256_add_pd(acc[0], m);
+    acc[1] = _mm256_add_pd(acc[1], _mm256_mul_pd(m, x));
+    acc[2] = _mm256_add_pd(acc[2], _mm256_mul_pd(m, y));
+    acc[3] = _mm256_add_pd(acc[3], _mm256_mul_pd(m, z));
+}
+
+
+SIMD_TARGET("avx2")
+static uint32_t mass_avx2(const struct point_soa *soa, const float *mass, double sums[4][GEOMETRYLANES]) {
+    uint32_t i;
+    int k;
+    __m256 m;
+    __m256 x;
+    __m256 y;
+    __m256 z;
+    __m256d acc[4];
+
+    for (k = 0; k < 4; k++)
+        acc[k] = _mm256_loadu_pd(sums[k]);
+
+    for (i = 0; i + 8 <= soa->num_points; i += 8) {
+        m = _mm256_loadu_ps(mass + i);
+        x = _mm256_loadu_ps(soa->x + i);
+        y = _mm256_loadu_ps(soa->y + i);
+        z = _mm256_loadu_ps(soa->z + i);
+
+        mass_avx2_add(acc,
+                _mm256_cvtps_pd(_mm256_castps256_ps128(m)), _mm256_cvtps_pd(_mm256_castps256_ps128(x)),
+                _mm256_cvtps_pd(_mm256_castps256_ps128(y)), _mm256_cvtps_pd(_mm256_castps256_ps128(z)));
+        mass_avx2_add(acc,
+                _mm256_cvtps_pd(_mm256_extractf128_ps(m, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)),
+                _mm256_cvtps_pd(_mm256_extractf128_ps(y, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(z, 1)));
+    }
+
+    for (k = 0; k < 4; k++)
+        _mm256_storeu_pd(sums[k], acc[k]);
+
+    return i;
+}
+
+
+SIMD_TARGET("sse2")
+static void inertia_sse2_add(__m128d *acc, __m128d m, __m128d dx, __m128d dy, __m128d dz) {
+    __m128d xx = _mm_mul_pd(dx, dx);
+    __m128d yy = _mm_mul_pd(dy, dy);
+    __m128d zz = _mm_mul_pd(dz, dz);
+
+    acc[0] = _mm_add_pd(acc[0], _mm_mul_pd(m, _mm_add_pd(yy, zz)));
+    acc[1] = _mm_add_pd(acc[1], _mm_mul_pd(m, _mm_add_pd(xx, zz)));
+    acc[2] = _mm_add_pd(acc[2], _mm_mul_pd(m, _mm_add_pd(xx, yy)));
+    acc[3] = _mm_add_pd(acc[3], _mm_mul_pd(_mm_mul_pd(m, dx), dy));
+    acc[4] = _mm_add_pd(acc[4], _mm_mul_pd(_mm_mul_pd(m, dx), dz));
+    acc[5] = _mm_add_pd(acc[5], _mm_mul_pd(_mm_mul_pd(m, dy), dz));
+}
+
+
+SIMD_TARGET("sse2")
+static uint32_t inertia_sse2(const struct point_soa *soa, const float *mass, vector centre,
+        double sums[6][GEOMETRYLANES]) {
+    uint32_t i;
+    int k;
+    __m128 m;
+    __m128 dx;
+    __m128 dy;
+    __m128 dz;
+    __m128 cx = _mm_set1_ps(centre.x);
+    __m128 cy = _mm_set1_ps(centre.y);
+    __m128 cz = _mm_set1_ps(centre.z);
+    __m128d lo[6];
+    __m128d hi[6];
+
+    for (k = 0; k < 6; k++) {
+        lo[k] = _mm_loadu_pd(&sums[k][0]);
+        hi[k] = _mm_loadu_pd(&sums[k][2]);
+    }
+
+    for (i = 0; i + 4 <= soa->num_points; i += 4) {
+        m = _mm_loadu_ps(mass + i);
+        dx = _mm_sub_ps(_mm_loadu_ps(soa->x + i), cx);
+        dy = _mm_sub_ps(_mm_loadu_ps(soa->y + i), cy);
+        dz = _mm_sub_ps(_mm_loadu_ps(soa->z + i), cz);
+
+        inertia_sse2_add(lo, _mm_cvtps_pd(m), _mm_cvtps_pd(dx), _mm_cvtps_pd(dy), _mm_cvtps_pd(dz));
+        inertia_sse2_add(hi, _mm_cvtps_pd(_mm_movehl_ps(m, m)), _mm_cvtps_pd(_mm_movehl_ps(dx, dx)),
+                _mm_cvtps_pd(_mm_movehl_ps(dy, dy)), _mm_cvtps_pd(_mm_movehl_ps(dz, dz)));
+    }
+
+    for (k = 0; k < 6; k++) {
+        _mm_storeu_pd(&sums[k][0], lo[k]);
+        _mm_storeu_pd(&sums[k][2], hi[k]);
+    }
+
+    return i;
+}
+
+
+SIMD_TARGET("avx2")
+static void inertia_avx2_add(__m256d *acc, __m256d m, __m256d dx, __m256d dy, __m256d dz) {
+    __m256d xx = _mm256_mul_pd(dx, dx);
+    __m256d yy = _mm256_mul_pd(dy, dy);
+    __m256d zz = _mm256_mul_pd(dz, dz);
+
+    acc[0] = _mm256_add_pd(acc[0], _mm256_mul_pd(m, _mm256_add_pd(yy, zz)));
+    acc[1] = _mm256_add_pd(acc[1], _mm256_mul_pd(m, _mm256_add_pd(xx, zz)));
+    acc[2] = _mm256_add_pd(acc[2], _mm256_mul_pd(m, _mm256_add_pd(xx, yy)));
+    acc[3] = _mm256_add_pd(acc[3], _mm256_mul_pd(_mm256_mul_pd(m, dx), dy));
+    acc[4] = _mm256_add_pd(acc[4], _mm256_mul_pd(_mm256_mul_pd(m, dx), dz));
+    acc[5] = _mm256_add_pd(acc[5], _mm256_mul_pd(_mm256_mul_pd(m, dy), dz));
+}
+
+
+SIMD_TARGET("avx2")
+static uint32_t inertia_avx2(const struct point_soa *soa, const float *mass, vector centre,
+        double sums[6][GEOMETRYLANES]) {
+    uint32_t i;
+    int k;
+    __m256 m;
+    __m256 dx;
+    __m256 dy;
+    __m256 dz;
+    __m256 cx = _mm256_set1_ps(centre.x);
+    __m256 cy = _mm256_set1_ps(centre.y);
+    __m256 cz = _mm256_set1_ps(centre.z);
+    __m256d acc[6];
+
+    for (k = 0; k < 6; k++)
+        acc[k] = _mm256_loadu_pd(sums[k]);
+
+    for (i = 0; i + 8 <= soa->num_points; i += 8) {
+        m = _mm256_loadu_ps(mass + i);
+        dx = _mm256_sub_ps(_mm256_loadu_ps(soa->x + i), cx);
+        dy = _mm256_sub_ps(_mm256_loadu_ps(soa->y + i), cy);
+        dz = _mm256_sub_ps(_mm256_loadu_ps(soa->z + i), cz);
+
+        inertia_avx2_add(acc,
+                _mm256_cvtps_pd(_mm256_castps256_ps128(m)), _mm256_cvtps_pd(_mm256_castps256_ps128(dx)),
+                _mm256_cvtps_pd(_mm256_castps256_ps128(dy)), _mm256_cvtps_pd(_mm256_castps256_ps128(dz)));
+        inertia_avx2_add(acc,
+                _mm256_cvtps_pd(_mm256_extractf128_ps(m, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(dx, 1)),
+                _mm256_cvtps_pd(_mm256_extractf128_ps(dy, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(dz, 1)));
+    }
+
+    for (k = 0; k < 6; k++)
+        _mm256_storeu_pd(sums[k], acc[k]);
+
+    return i;
+}
+
+#endif
+
+
+void geometry_bounds(const struct point_soa *soa, vector *min, vector *max) {
+    /*
+     * Calculates the bounding box of the given points, there has to be at
+     * least one.
+     */
+
+    float lo[3];
+    float hi[3];
+    uint32_t i;
+
+    lo[0] = hi[0] = soa->x[0];
+    lo[1] = hi[1] = soa->y[0];
+    lo[2] = hi[2] = soa->z[0];
+
+    i = 0;
+#ifdef SIMD_X86
+    switch (simd_level()) {
+        case SIMD_AVX2: i = bounds_avx2(soa, lo, hi); break;
+        case SIMD_SSE2: i = bounds_sse2(soa, lo, hi); break;
+    }
+#endif
+    bounds_scalar(soa, i, lo, hi);
+
+    min->x = lo[0];
+    min->y = lo[1];
+    min->z = lo[2];
+    max->x = hi[0];
+    max->y = hi[1];
+    max->z = hi[2];
+}
+
+
+float geometry_sphere(const struct point_soa *soa, vector center) {
+    /*
+     * Returns the radius of the smallest sphere around center that
+     * contains all of the given points.
+     */
+
+    float sphere;
+    uint32_t i;
+
+    sphere = 0;
+
+    i = 0;
+#ifdef SIMD_X86
+    switch (simd_level()) {
+        case SIMD_AVX2: i = sphere_avx2(soa, center, &sphere); break;
+        case SIMD_SSE2: i = sphere_sse2(soa, center, &sphere); break;
+    }
+#endif
+    sphere = sphere_scalar(soa, i, center, sphere);
+
+    // the root is monotonic, so taking it once at the end is enough
+    return (float)sqrt((double)sphere);
+}
+
+
+float geometry_mass(const struct point_soa *soa, const float *mass, vector *centre) {
+    /*
+     * Returns the total of the given per-point masses and stores the centre
+     * of mass, or the origin if there is no mass.
+     */
+
+    double sums[4][GEOMETRYLANES];
+    double total;
+    uint32_t i;
+
+    memset(sums, 0, sizeof(sums));
+
+    i = 0;
+#ifdef SIMD_X86
+    switch (simd_level()) {
+        case SIMD_AVX2: i = mass_avx2(soa, mass, sums); break;
+        case SIMD_SSE2: i = mass_sse2(soa, mass, sums); break;
+    }
+#endif
+    mass_scalar(soa, mass, i, sums);
+
+    total = fold_lanes(sums[0]);
+    if (total > 0) {
+        centre->x = (float)(fold_lanes(sums[1]) / total);
+        centre->y = (float)(fold_lanes(sums[2]) / total);
+        centre->z = (float)(fold_lanes(sums[3]) / total);
+    } else {
+        *centre = empty_vector;
+    }
+
+    return (float)total;
+}
+
+
+matrix geometry_inertia(const struct point_soa *soa, const float *mass, vector centre) {
+    /*
+     * Returns the inertia tensor of the given point masses around centre.
+     */
+
+    double sums[6][GEOMETRYLANES];
+    matrix inertia;
+    uint32_t i;
+
+    memset(sums, 0, sizeof(sums));
+
+    i = 0;
+#ifdef SIMD_X86
+    switch (simd_level()) {
+        case SIMD_AVX2: i = inertia_avx2(soa, mass, centre, sums); break;
+        case SIMD_SSE2: i = inertia_sse2(soa, mass, centre, sums); break;
+    }
+#endif
+    inertia_scalar(soa, mass, i, centre, sums);
+
+    inertia.m00 = (float)fold_lanes(sums[0]);
+    inertia.m11 = (float)fold_lanes(sums[1]);
+    inertia.m22 = (float)fold_lanes(sums[2]);
+    inertia.m01 = inertia.m10 = (float)-fold_lanes(sums[3]);
+    inertia.m02 = inertia.m20 = (float)-fold_lanes(sums[4]);
+    inertia.m12 = inertia.m21 = (float)-fold_lanes(sums[5]);
+
+    return inertia;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vector.h"
+#include "matrix.h"
+
+
+/*
+ * The mass kernels sum into this many interleaved partial sums (point i
+ * goes to lane i % GEOMETRYLANES) which are only added up at the end, so
+ * the scalar and SIMD kernels produce the exact same result.
+ */
+#define GEOMETRYLANES 4
+
+
+struct point_soa {
+    uint32_t num_points;
+    float *x;
+    float *y;
+    float *z;
+};
+
+
+void point_soa_init(struct point_soa *soa, const void *points, uint32_t num_points, size_t stride);
+
+void point_soa_free(struct point_soa *soa);
+
+void geometry_bounds(const struct point_soa *soa, vector *min, vector *max);
+
+float geometry_sphere(const struct point_soa *soa, vector center);
+
+float geometry_mass(const struct point_soa *soa, const float *mass, vector *centre);
+
+matrix geometry_inertia(const struct point_soa *soa, const float *mass, vector centre);
@@ -42,68 +42,199 @@
 
 #include "args.h"
 #include "utils.h"
+#include "filesystem.h"
+#include "threads.h"
+#include "simd.h"
+#include "dxt.h"
+#include "downsample.h"
 #include "paa2img.h"
+#include "batch.h"
 #include "img2paa.h"
 
 
-int img2dxt1(unsigned char *input, unsigned char *output, int width, int height) {
+int mipmap_dxt_job(int index, void *chain_ptr) {
     /*
-     * Converts image data to DXT1 data.
-     *
-     * Returns 0 on success and a positive integer on failure.
+     * Compresses the block row with the given index, counting the rows of
+     * all mipmaps in order. Each block row of the output only depends on
+     * the same 4 pixel rows of the input.
      */
 
+    struct mipmap_chain *chain;
+    struct mipmap *mipmap;
     unsigned char img_block[64];
-    unsigned char dxt_block[8];
+    unsigned char dxt_block[16];
+    size_t block_size;
+    int alpha;
     int i;
     int j;
 
-    for (i = 0; i < height; i += 4) {
-        for (j = 0; j < width; j += 4) {
-            memcpy(img_block +  0, input + (i + 0) * width * 4 + j * 4, 16);
-            memcpy(img_block + 16, input + (i + 1) * width * 4 + j * 4, 16);
-            memcpy(img_block + 32, input + (i + 2) * width * 4 + j * 4, 16);
-            memcpy(img_block + 48, input + (i + 3) * width * 4 + j * 4, 16);
+    chain = (struct mipmap_chain *)chain_ptr;
+    for (i = chain->num_mipmaps - 1; chain->mipmaps[i].first_row > index; i--);
+    mipmap = &chain->mipmaps[i];
 
-            stb_compress_dxt_block(dxt_block, (const unsigned char *)img_block, 0, STB_DXT_HIGHQUAL);
+    alpha = chain->paatype == DXT5;
+    block_size = alpha ? 16 : 8;
+    i = (index - mipmap->first_row) * 4;
 
-            memcpy(output + (i / 4) * (width / 4) * sizeof(dxt_block) + (j / 4) * sizeof(dxt_block), dxt_block, sizeof(dxt_block));
-        }
+    for (j = 0; j < mipmap->width; j += 4) {
+        memcpy(img_block +  0, mipmap->imgdata + (i + 0) * mipmap->width * 4 + j * 4, 16);
+        memcpy(img_block + 16, mipmap->imgdata + (i + 1) * mipmap->width * 4 + j * 4, 16);
+        memcpy(img_block + 32, mipmap->imgdata + (i + 2) * mipmap->width * 4 + j * 4, 16);
+        memcpy(img_block + 48, mipmap->imgdata + (i + 3) * mipmap->width * 4 + j * 4, 16);
+
+        dxt_compress_block(dxt_block, (const unsigned char *)img_block, alpha, chain->quality, chain->simd);
+
+        memcpy(mipmap->outputdata + (i / 4) * (mipmap->width / 4) * block_size + (j / 4) * block_size,
+                dxt_block, block_size);
     }
 
     return 0;
 }
 
 
-int img2dxt5(unsigned char *input, unsigned char *output, int width, int height) {
+int mipmap_lzo_job(int index, void *chain_ptr) {
     /*
-     * Converts image data to DXT5 data.
+     * LZO compresses the DXT data of the mipmap with the given index in
+     * place, if it is large enough to be worth it.
      *
      * Returns 0 on success and a positive integer on failure.
      */
 
-    unsigned char img_block[64];
-    unsigned char dxt_block[16];
+    struct mipmap_chain *chain;
+    struct mipmap *mipmap;
+    unsigned char *workmem;
+    unsigned char *tmp;
+    lzo_uint out_len;
+
+    chain = (struct mipmap_chain *)chain_ptr;
+    mipmap = &chain->mipmaps[index];
+
+    mipmap->compressed = chain->compress && mipmap->datalen > LZO1X_MEM_COMPRESS;
+    if (!mipmap->compressed)
+        return 0;
+
+    tmp = (unsigned char *)safe_malloc(mipmap->datalen);
+    workmem = (unsigned char *)safe_malloc(LZO1X_MEM_COMPRESS);
+
+    memcpy(tmp, mipmap->outputdata, mipmap->datalen);
+
+    if (lzo1x_1_compress(tmp, mipmap->datalen, mipmap->outputdata, &out_len, workmem) != LZO_E_OK) {
+        free(workmem);
+        free(tmp);
+        return 1;
+    }
+
+    free(workmem);
+    free(tmp);
+
+    mipmap->datalen = out_len;
+
+    return 0;
+}
+
+
+bool is_color_texture(char *path) {
+    /*
+     * Checks whether the texture at the given path holds color, going by
+     * the suffix of its name (_co, _ca, _lco or _sky). Everything else, like
+     * normal (_nohq) and specular (_smdi) maps, is treated as data.
+     */
+
+    char *suffixes[] = {"_co", "_ca", "_lco", "_sky"};
+    char name[2048];
+    char *ext;
     int i;
-    int j;
 
-    for (i = 0; i < height; i += 4) {
-        for (j = 0; j < width; j += 4) {
-            memcpy(img_block +  0, input + (i + 0) * width * 4 + j * 4, 16);
-            memcpy(img_block + 16, input + (i + 1) * width * 4 + j * 4, 16);
-            memcpy(img_block + 32, input + (i + 2) * width * 4 + j * 4, 16);
-            memcpy(img_block + 48, input + (i + 3) * width * 4 + j * 4, 16);
+    if (strrchr(path, PATHSEP) != NULL)
+        path = strrchr(path, PATHSEP) + 1;
+
+    strncpy(name, path, sizeof(name) - 1);
+    name[sizeof(name) - 1] = 0;
+
+    ext = strrchr(name, '.');
+    if (ext != NULL)
+        *ext = 0;
+
+    for (i = 0; i < sizeof(suffixes) / sizeof(*suffixes); i++) {
+        if (strlen(name) >= strlen(suffixes[i]) &&
+                stricmp(name + strlen(name) - strlen(suffixes[i]), suffixes[i]) == 0)
+            return true;
+    }
+
+    return false;
+}
+
 
-            stb_compress_dxt_block(dxt_block, (const unsigned char *)img_block, 1, STB_DXT_HIGHQUAL);
+int build_mipmaps(struct mipmap_chain *chain, unsigned char *imgdata, uint16_t width, uint16_t height) {
+    /*
+     * Fills the chain with the given image and every mipmap below it, down
+     * to 4 pixels in either dimension or the first size that isn't a
+     * multiple of 4. The chain takes ownership of the image data.
+     *
+     * Mipmaps that halve both dimensions exactly average 2x2 blocks; for
+     * color textures in linear light, with colors weighted by alpha for
+     * DXT5. Any other size is resized with stb_image_resize.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
 
-            memcpy(output + (i / 4) * (width / 4) * sizeof(dxt_block) + (j / 4) * sizeof(dxt_block), dxt_block, sizeof(dxt_block));
+    struct mipmap *mipmap;
+    int i;
+
+    chain->num_rows = 0;
+
+    downsample_init();
+
+    for (i = 0; i < MAXMIPMAPS; i++) {
+        mipmap = &chain->mipmaps[i];
+        mipmap->width = width;
+        mipmap->height = height;
+        mipmap->outputdata = NULL;
+        mipmap->first_row = chain->num_rows;
+        chain->num_rows += height / 4;
+        chain->num_mipmaps = i + 1;
+
+        if (i == 0) {
+            mipmap->imgdata = imgdata;
+        } else if (chain->mipmaps[i - 1].width == width * 2 && chain->mipmaps[i - 1].height == height * 2) {
+            mipmap->imgdata = (unsigned char *)safe_malloc(width * height * 4);
+            downsample_2x2(chain->mipmaps[i - 1].imgdata, width * 2, height * 2, mipmap->imgdata,
+                    chain->color, chain->color && chain->paatype == DXT5, chain->simd);
+        } else {
+            mipmap->imgdata = (unsigned char *)safe_malloc(width * height * 4);
+            if (!stbir_resize_uint8(chain->mipmaps[i - 1].imgdata, chain->mipmaps[i - 1].width,
+                    chain->mipmaps[i - 1].height, 0, mipmap->imgdata, width, height, 0, 4))
+                return 1;
         }
+
+        mipmap->datalen = width * height;
+        if (chain->paatype == DXT1)
+            mipmap->datalen /= 2;
+
+        width /= 2;
+        height /= 2;
+
+        // DXT blocks have to tile the mipmap, so the chain ends at odd sizes
+        if (width < 4 || height < 4 || width % 4 != 0 || height % 4 != 0)
+            break;
     }
 
     return 0;
 }
 
 
+void mipmap_chain_free(struct mipmap_chain *chain) {
+    int i;
+
+    for (i = 0; i < chain->num_mipmaps; i++) {
+        free(chain->mipmaps[i].imgdata);
+        free(chain->mipmaps[i].outputdata);
+    }
+
+    chain->num_mipmaps = 0;
+}
+
+
 int calculate_average_color(unsigned char *imgdata, int num_pixels, unsigned char color[4]) {
     uint32_t total_color[4];
     int i;
@@ -140,35 +271,39 @@ int calculate_maximum_color(unsigned char *imgdata, int num_pixels, unsigned cha
 }
 
 
-int img2paa(char *source, char *target) {
+int img2paa(char *source, char *target, int num_threads) {
     /*
      * Converts source image to target PAA.
      *
+     * The conversion runs in stages: the whole mipmap chain is built up
+     * front, then the block rows of all mipmaps are DXT compressed and the
+     * mipmaps LZO compressed on num_threads threads, and finally everything
+     * is written in order. With --verbose the time spent in each is printed.
+     *
      * Returns 0 on success and a positive integer on failure.
      */
 
     extern struct arguments args;
 
+    struct mipmap_chain chain;
+    struct mipmap *mipmap;
     FILE *f_target;
     uint32_t offsets[16];
-    uint32_t datalen;
     uint16_t paatype;
     uint16_t width;
     uint16_t height;
     long fp_offsets;
     int num_channels;
+    int quality;
     int w;
     int h;
     int i;
-    lzo_uint in_len;
-    lzo_uint out_len;
-    bool compressed;
+    int *results;
+    double times[5];
     unsigned char *imgdata;
     unsigned char *tmp;
-    unsigned char *workmem;
-    unsigned char *outputdata;
     unsigned char color[4];
-    
+
     if (!args.paatype) {
         paatype = 0;
     } else if (stricmp("DXT1", args.paatype) == 0) {
@@ -192,6 +327,17 @@ int img2paa(char *source, char *target) {
         return 4;
     }
 
+    quality = DXT_NORMAL;
+    if (args.quality) {
+        quality = dxt_quality(args.quality);
+        if (quality < 0) {
+            errorf("Unrecognized quality \"%s\".\n", args.quality);
+            return 4;
+        }
+    }
+
+    times[0] = get_milliseconds();
+
     imgdata = stbi_load(source, &w, &h, &num_channels, 4);
     if (!imgdata) {
         errorf("Failed to load image.\n");
@@ -228,10 +374,72 @@ int img2paa(char *source, char *target) {
     stbi_image_free(imgdata);
     imgdata = tmp;
 
+    // MipMaps
+    chain.paatype = paatype;
+    chain.quality = quality;
+    chain.simd = simd_level();
+    chain.color = is_color_texture(target);
+    chain.compress = args.compress;
+    chain.num_mipmaps = 0;
+
+    times[1] = get_milliseconds();
+
+    if (build_mipmaps(&chain, imgdata, width, height)) {
+        errorf("Failed to resize image.\n");
+        mipmap_chain_free(&chain);
+        return 7;
+    }
+
+    times[2] = get_milliseconds();
+
+    // Convert to output format
+    for (i = 0; i < chain.num_mipmaps; i++)
+        chain.mipmaps[i].outputdata = (unsigned char *)safe_malloc(chain.mipmaps[i].datalen);
+
+    dxt_init();
+
+    results = (int *)safe_malloc(sizeof(int) * MAX(chain.num_rows, chain.num_mipmaps));
+
+    run_parallel(chain.num_rows, num_threads, mipmap_dxt_job, &chain, results);
+
+    for (i = 0; i < chain.num_rows; i++) {
+        if (results[i]) {
+            errorf("Failed to convert image data to %s.\n", (paatype == DXT1) ? "DXT1" : "DXT5");
+            free(results);
+            mipmap_chain_free(&chain);
+            return 5;
+        }
+    }
+
+    times[3] = get_milliseconds();
+
+    // LZO compression
+    if (chain.compress && lzo_init() != LZO_E_OK) {
+        errorf("Failed to initialize LZO for compression.\n");
+        free(results);
+        mipmap_chain_free(&chain);
+        return 6;
+    }
+
+    run_parallel(chain.num_mipmaps, num_threads, mipmap_lzo_job, &chain, results);
+
+    for (i = 0; i < chain.num_mipmaps; i++) {
+        if (results[i]) {
+            errorf("Failed to compress image data.\n");
+            free(results);
+            mipmap_chain_free(&chain);
+            return 6;
+        }
+    }
+
+    free(results);
+
+    times[4] = get_milliseconds();
+
     f_target = fopen(target, "wb");
     if (!f_target) {
         errorf("Failed to open target file.\n");
-        free(imgdata);
+        mipmap_chain_free(&chain);
         return 3;
     }
 
@@ -258,99 +466,17 @@ int img2paa(char *source, char *target) {
     // Palette
     fwrite("\x00\x00", 2, 1, f_target);
 
-    // MipMaps
-    for (i = 0; i < 15; i++) {
-        datalen = width * height;
-        if (paatype == DXT1)
-            datalen /= 2;
-
-        outputdata = (unsigned char *)safe_malloc(datalen);
-
-        // Convert to output format
-        switch (paatype) {
-            case DXT1:
-                if (img2dxt1(imgdata, outputdata, width, height)) {
-                    errorf("Failed to convert image data to DXT1.\n");
-                    free(outputdata);
-                    free(imgdata);
-                    return 5;
-                }
-                break;
-            case DXT5:
-                if (img2dxt5(imgdata, outputdata, width, height)) {
-                    errorf("Failed to convert image data to DXT5.\n");
-                    free(outputdata);
-                    free(imgdata);
-                    return 5;
-                }
-                break;
-            default:
-                free(outputdata);
-                free(imgdata);
-                return 5;
-        }
-
-        // LZO compression
-        compressed = args.compress && datalen > LZO1X_MEM_COMPRESS;
-
-        if (compressed) {
-            tmp = (unsigned char *)safe_malloc(datalen);
-            workmem = (unsigned char *)safe_malloc(LZO1X_MEM_COMPRESS);
-            in_len = datalen;
-
-            memcpy(tmp, outputdata, datalen);
-
-            if (lzo_init() != LZO_E_OK) {
-                errorf("Failed to initialize LZO for compression.\n");
-                free(workmem);
-                free(tmp);
-                free(outputdata);
-                free(imgdata);
-                return 6;
-	    }
-            if (lzo1x_1_compress(tmp, in_len, outputdata, &out_len, workmem) != LZO_E_OK) {
-                errorf("Failed to compress image data.\n");
-                free(workmem);
-                free(tmp);
-                free(outputdata);
-                free(imgdata);
-                return 6;
-            }
-
-            free(workmem);
-            free(tmp);
-
-            datalen = out_len;
-        }
-
-        // Write to file
+    for (i = 0; i < chain.num_mipmaps; i++) {
+        mipmap = &chain.mipmaps[i];
         offsets[i] = ftell(f_target);
-        if (compressed)
+
+        width = mipmap->width;
+        if (mipmap->compressed)
             width += 32768;
         fwrite(&width, sizeof(width), 1, f_target);
-        if (compressed)
-            width -= 32768;
-        fwrite(&height, sizeof(height), 1, f_target);
-        fwrite(&datalen, 3, 1, f_target);
-        fwrite(outputdata, datalen, 1, f_target);
-
-        free(outputdata);
-
-        // Resize image for next MipMap
-        width /= 2;
-        height /= 2;
-
-        if (width < 4 || height < 4) { break; }
-
-        tmp = (unsigned char *)safe_malloc(width * height * 4);
-        if (!stbir_resize_uint8(imgdata, width * 2, height * 2, 0, tmp, width, height, 0, 4)) {
-            errorf("Failed to resize image.\n");
-            free(tmp);
-            free(imgdata);
-            return 7;
-        }
-        free(imgdata);
-        imgdata = tmp;
+        fwrite(&mipmap->height, sizeof(mipmap->height), 1, f_target);
+        fwrite(&mipmap->datalen, 3, 1, f_target);
+        fwrite(mipmap->outputdata, mipmap->datalen, 1, f_target);
     }
 
     offsets[i] = ftell(f_target);
@@ -363,8 +489,18 @@ int img2paa(char *source, char *target) {
     fwrite(offsets, sizeof(offsets), 1, f_target);
 
     fclose(f_target);
-    free(imgdata);
-    
+
+    if (args.verbose) {
+        infof("%s: %i mipmaps, %i block rows, %i job(s)\n", source, chain.num_mipmaps, chain.num_rows, num_threads);
+        infof("    load:     %8.1f ms\n", times[1] - times[0]);
+        infof("    mipmaps:  %8.1f ms\n", times[2] - times[1]);
+        infof("    dxt:      %8.1f ms\n", times[3] - times[2]);
+        infof("    lzo:      %8.1f ms\n", times[4] - times[3]);
+        infof("    write:    %8.1f ms\n", get_milliseconds() - times[4]);
+    }
+
+    mipmap_chain_free(&chain);
+
     return 0;
 }
 
@@ -372,14 +508,24 @@ int img2paa(char *source, char *target) {
 int cmd_img2paa() {
     extern struct arguments args;
 
+    char *extensions[] = { "png", "tga", "jpg", "jpeg", "bmp", NULL };
+
     if (args.num_positionals != 3)
         return 128;
 
+    if (args.recursive) {
+        // the tables are shared by all threads
+        dxt_init();
+        downsample_init();
+
+        return convert_directory(args.positionals[1], args.positionals[2], extensions, "paa", img2paa);
+    }
+
     // check if target already exists
     if (access(args.positionals[2], F_OK) != -1 && !args.force) {
         errorf("File %s already exists and --force was not set.\n", args.positionals[2]);
         return 1;
     }
 
-    return img2paa(args.positionals[1], args.positionals[2]);
+    return img2paa(args.positionals[1], args.positionals[2], get_num_jobs());
 }
@@ -19,10 +19,45 @@
 #pragma once
 
 
-int img2dxt1(unsigned char *input, unsigned char *output, int width, int height);
+#include <stdint.h>
+#include <stdbool.h>
 
-int img2dxt5(unsigned char *input, unsigned char *output, int width, int height);
 
-int img2paa(char *source, char *target);
+#define MAXMIPMAPS 15
+
+
+struct mipmap {
+    uint16_t width;
+    uint16_t height;
+    uint32_t datalen;
+    bool compressed;
+    int first_row;
+    unsigned char *imgdata;
+    unsigned char *outputdata;
+};
+
+struct mipmap_chain {
+    uint16_t paatype;
+    int quality;
+    int simd;
+    bool color;
+    bool compress;
+    int num_rows;
+    int num_mipmaps;
+    struct mipmap mipmaps[MAXMIPMAPS];
+};
+
+
+int mipmap_dxt_job(int index, void *chain_ptr);
+
+int mipmap_lzo_job(int index, void *chain_ptr);
+
+bool is_color_texture(char *path);
+
+int build_mipmaps(struct mipmap_chain *chain, unsigned char *imgdata, uint16_t width, uint16_t height);
+
+void mipmap_chain_free(struct mipmap_chain *chain);
+
+int img2paa(char *source, char *target, int num_threads);
 
 int cmd_img2paa();
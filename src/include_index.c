@@ -0,0 +1,530 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fts.h>
+#endif
+
+#include "filesystem.h"
+#include "utils.h"
+#include "include_index.h"
+
+
+pthread_mutex_t include_index_lock = PTHREAD_MUTEX_INITIALIZER;
+struct include_index *include_indices = NULL;
+
+
+void include_index_insert(struct include_index *index, char *virtual_path, char *real_path) {
+    /*
+     * Adds the path to the index. If the virtual path is already taken, the
+     * first file found is kept, as that is the one a full walk would return.
+     */
+
+    struct include_entry *old_entries;
+    uint32_t old_size;
+    uint32_t hash;
+    uint32_t i;
+    uint32_t j;
+
+    if ((index->num_entries + 1) * 2 > index->size) {
+        old_entries = index->entries;
+        old_size = index->size;
+
+        index->size = (old_size == 0) ? INDEXINTERVAL : old_size * 2;
+        index->entries = (struct include_entry *)safe_malloc(sizeof(struct include_entry) * index->size);
+        memset(index->entries, 0, sizeof(struct include_entry) * index->size);
+
+        for (i = 0; i < old_size; i++) {
+            if (old_entries[i].virtual_path == NULL)
+                continue;
+            for (j = old_entries[i].hash & (index->size - 1); index->entries[j].virtual_path != NULL;
+                    j = (j + 1) & (index->size - 1));
+            index->entries[j] = old_entries[i];
+        }
+
+        free(old_entries);
+    }
+
+    hash = hash_string(virtual_path, strlen(virtual_path));
+
+    for (i = hash & (index->size - 1); index->entries[i].virtual_path != NULL; i = (i + 1) & (index->size - 1)) {
+        if (index->entries[i].hash == hash && strcmp(index->entries[i].virtual_path, virtual_path) == 0)
+            return;
+    }
+
+    index->entries[i].hash = hash;
+    index->entries[i].virtual_path = safe_strdup(virtual_path);
+    index->entries[i].real_path = safe_strdup(real_path);
+    index->num_entries++;
+
+    if (strpbrk(virtual_path, "\t\n") != NULL || strpbrk(real_path, "\t\n") != NULL)
+        index->persistable = false;
+}
+
+
+char *include_index_find(struct include_index *index, char *virtual_path) {
+    /*
+     * Returns the real path for the given virtual path (without leading
+     * backslash) or NULL if there is none.
+     */
+
+    uint32_t hash;
+    uint32_t i;
+
+    if (index->size == 0)
+        return NULL;
+
+    hash = hash_string(virtual_path, strlen(virtual_path));
+
+    for (i = hash & (index->size - 1); index->entries[i].virtual_path != NULL; i = (i + 1) & (index->size - 1)) {
+        if (index->entries[i].hash == hash && strcmp(index->entries[i].virtual_path, virtual_path) == 0)
+            return index->entries[i].real_path;
+    }
+
+    return NULL;
+}
+
+
+void include_index_stamp(struct include_index *index, char *path, int64_t mtime) {
+    if (index->num_stamps % STAMPINTERVAL == 0)
+        index->stamps = (struct include_stamp *)safe_realloc(index->stamps,
+                sizeof(struct include_stamp) * (index->num_stamps + STAMPINTERVAL));
+
+    index->stamps[index->num_stamps].mtime = mtime;
+    index->stamps[index->num_stamps].path = safe_strdup(path);
+    index->num_stamps++;
+
+    if (strpbrk(path, "\t\n") != NULL)
+        index->persistable = false;
+}
+
+
+void include_index_clear(struct include_index *index) {
+    uint32_t i;
+
+    for (i = 0; i < index->size; i++) {
+        free(index->entries[i].virtual_path);
+        free(index->entries[i].real_path);
+    }
+    free(index->entries);
+
+    for (i = 0; i < index->num_stamps; i++)
+        free(index->stamps[i].path);
+    free(index->stamps);
+
+    index->num_entries = 0;
+    index->size = 0;
+    index->entries = NULL;
+    index->num_stamps = 0;
+    index->stamps = NULL;
+}
+
+
+int64_t get_mtime(char *path) {
+    struct stat st;
+
+    if (stat(path, &st))
+        return -1;
+
+    return (int64_t)st.st_mtime;
+}
+
+
+char *read_prefix(struct include_index *index, char *folder) {
+    /*
+     * Reads the $PBOPREFIX$ file in the given folder, if there is one.
+     * Returns a newly allocated string without trailing newline and
+     * backslash, or NULL.
+     */
+
+    char prefixpath[2048];
+    char prefix[2048];
+    FILE *f_prefix;
+
+    snprintf(prefixpath, sizeof(prefixpath), "%s%c$PBOPREFIX$", folder, PATHSEP);
+
+    f_prefix = fopen(prefixpath, "rb");
+    if (!f_prefix)
+        return NULL;
+
+    prefix[0] = 0;
+    fgets(prefix, sizeof(prefix), f_prefix);
+    fclose(f_prefix);
+
+    if (index->persistable)
+        include_index_stamp(index, prefixpath, get_mtime(prefixpath));
+
+    if (prefix[0] != 0 && prefix[strlen(prefix) - 1] == '\n')
+        prefix[strlen(prefix) - 1] = 0;
+    if (prefix[0] != 0 && prefix[strlen(prefix) - 1] == '\r')
+        prefix[strlen(prefix) - 1] = 0;
+    if (prefix[0] != 0 && prefix[strlen(prefix) - 1] == '\\')
+        prefix[strlen(prefix) - 1] = 0;
+
+    return safe_strdup(prefix);
+}
+
+
+void include_index_add_file(struct include_index *index, char *path, char *prefix, size_t prefix_root_length) {
+    /*
+     * Adds the file at path, which lives somewhere below the folder with the
+     * given prefix (the first prefix_root_length characters of the path).
+     */
+
+    char virtual_path[2048];
+    int i;
+
+    strncpy(virtual_path, prefix, sizeof(virtual_path) - 1);
+    virtual_path[sizeof(virtual_path) - 1] = 0;
+    strncat(virtual_path, path + prefix_root_length, sizeof(virtual_path) - strlen(virtual_path) - 1);
+
+    for (i = 0; i < strlen(virtual_path); i++) {
+        if (virtual_path[i] == '/')
+            virtual_path[i] = '\\';
+    }
+
+    // compensate for missing leading slash in PBOPREFIX
+    if (virtual_path[0] == '\\')
+        include_index_insert(index, virtual_path + 1, path);
+    else
+        include_index_insert(index, virtual_path, path);
+}
+
+
+#ifdef _WIN32
+void build_include_index_recursive(struct include_index *index, char *cwd, char *prefix, size_t prefix_root_length) {
+    WIN32_FIND_DATA file;
+    HANDLE handle = NULL;
+    char mask[2048];
+    char *own_prefix;
+
+    own_prefix = read_prefix(index, cwd);
+    if (own_prefix != NULL) {
+        prefix = own_prefix;
+        prefix_root_length = strlen(cwd);
+    }
+
+    if (index->persistable)
+        include_index_stamp(index, cwd, get_mtime(cwd));
+
+    snprintf(mask, sizeof(mask), "%s\\*", cwd);
+
+    handle = FindFirstFile(mask, &file);
+    if (handle == INVALID_HANDLE_VALUE) {
+        free(own_prefix);
+        return;
+    }
+
+    do {
+        if (strcmp(file.cFileName, ".") == 0 || strcmp(file.cFileName, "..") == 0)
+            continue;
+
+        if (strcmp(file.cFileName, ".git") == 0)
+            continue;
+
+        snprintf(mask, sizeof(mask), "%s\\%s", cwd, file.cFileName);
+        if (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            build_include_index_recursive(index, mask, prefix, prefix_root_length);
+        else if (prefix != NULL)
+            include_index_add_file(index, mask, prefix, prefix_root_length);
+    } while (FindNextFile(handle, &file));
+
+    FindClose(handle);
+    free(own_prefix);
+}
+#endif
+
+
+int build_include_index(struct include_index *index) {
+    /*
+     * Walks the include folder once and maps the path of every file as seen
+     * through the closest $PBOPREFIX$ above it to the actual path.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+#ifdef _WIN32
+    char root[2048];
+
+    GetFullPathName(index->includefolder, sizeof(root), root, NULL);
+    build_include_index_recursive(index, root, NULL, 0);
+#else
+    FTS *tree;
+    FTSENT *f;
+    char *argv[] = { index->includefolder, NULL };
+    char **prefixes = NULL;
+    size_t *prefix_root_lengths = NULL;
+    int num_levels = 0;
+    int level;
+
+    tree = fts_open(argv, FTS_LOGICAL | FTS_NOSTAT, NULL);
+    if (tree == NULL)
+        return 1;
+
+    while ((f = fts_read(tree))) {
+        if (!strcmp(f->fts_name, ".git")) {
+            fts_set(tree, f, FTS_SKIP);
+            continue;
+        }
+
+        switch (f->fts_info) {
+            case FTS_D:
+                if (f->fts_level >= num_levels) {
+                    prefixes = (char **)safe_realloc(prefixes, sizeof(char *) * (f->fts_level + 1));
+                    prefix_root_lengths = (size_t *)safe_realloc(prefix_root_lengths,
+                            sizeof(size_t) * (f->fts_level + 1));
+                    num_levels = f->fts_level + 1;
+                }
+                prefixes[f->fts_level] = read_prefix(index, f->fts_path);
+                prefix_root_lengths[f->fts_level] = f->fts_pathlen;
+                if (index->persistable)
+                    include_index_stamp(index, f->fts_path, get_mtime(f->fts_path));
+                continue;
+            case FTS_DP:
+                free(prefixes[f->fts_level]);
+                prefixes[f->fts_level] = NULL;
+                continue;
+            case FTS_DNR:
+            case FTS_ERR:
+            case FTS_NS:
+            case FTS_DC:
+                continue;
+        }
+
+        for (level = f->fts_level - 1; level >= 0 && prefixes[level] == NULL; level--);
+        if (level < 0)
+            continue;
+
+        include_index_add_file(index, f->fts_path, prefixes[level], prefix_root_lengths[level]);
+    }
+
+    fts_close(tree);
+
+    free(prefixes);
+    free(prefix_root_lengths);
+#endif
+
+    return 0;
+}
+
+
+void get_index_cache_path(struct include_index *index, char *cache_dir, char *path, size_t buffsize) {
+    char absolute[2048];
+
+#ifdef _WIN32
+    GetFullPathName(index->includefolder, sizeof(absolute), absolute, NULL);
+#else
+    if (realpath(index->includefolder, absolute) == NULL)
+        strncpy(absolute, index->includefolder, sizeof(absolute));
+#endif
+
+    snprintf(path, buffsize, "%s%c%08x.armake.idx", cache_dir, PATHSEP,
+            hash_string(absolute, strlen(absolute)));
+}
+
+
+int read_include_index(struct include_index *index, char *cache_path) {
+    /*
+     * Loads a persisted index, which is only used if none of the folders and
+     * prefix files it was built from have been modified since.
+     *
+     * Returns 0 on success, a positive integer if the index has to be
+     * rebuilt.
+     */
+
+    FILE *f;
+    char *line = NULL;
+    char *path;
+    char *real_path;
+    char header[2048];
+    size_t buffsize = 0;
+    ssize_t len;
+    long long mtime;
+    int success = 0;
+
+    f = fopen(cache_path, "rb");
+    if (!f)
+        return 1;
+
+    snprintf(header, sizeof(header), "armake include index %s\t%s\n", VERSION, index->includefolder);
+
+    if (getline(&line, &buffsize, f) < 0 || strcmp(line, header) != 0) {
+        success = 2;
+        goto cleanup;
+    }
+
+    while ((len = getline(&line, &buffsize, f)) > 0) {
+        if (line[len - 1] == '\n')
+            line[--len] = 0;
+
+        if (len < 3 || line[1] != '\t' || (path = strchr(line + 2, '\t')) == NULL) {
+            success = 3;
+            goto cleanup;
+        }
+        *(path++) = 0;
+
+        if (line[0] == 'S') {
+            mtime = strtoll(line + 2, NULL, 10);
+            if (get_mtime(path) != mtime) {
+                success = 4;
+                goto cleanup;
+            }
+            include_index_stamp(index, path, mtime);
+        } else if (line[0] == 'F') {
+            real_path = path;
+            include_index_insert(index, line + 2, real_path);
+        } else {
+            success = 5;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    free(line);
+    fclose(f);
+
+    return success;
+}
+
+
+int write_include_index(struct include_index *index, char *cache_path, time_t build_start) {
+    /*
+     * Persists the index. The index is written to a temporary file first and
+     * then moved into place, so concurrent armake calls never see half of it.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    FILE *f;
+    char temp_path[2048];
+    uint32_t i;
+
+    // folders modified during the walk might not be covered by the index
+    for (i = 0; i < index->num_stamps; i++) {
+        if (index->stamps[i].mtime < 0 || index->stamps[i].mtime >= (int64_t)build_start - 1)
+            return 1;
+    }
+
+    snprintf(temp_path, sizeof(temp_path), "%s.%i", cache_path, (int)getpid());
+
+    f = fopen(temp_path, "wb");
+    if (!f)
+        return 2;
+
+    fprintf(f, "armake include index %s\t%s\n", VERSION, index->includefolder);
+
+    for (i = 0; i < index->num_stamps; i++)
+        fprintf(f, "S\t%lld\t%s\n", (long long)index->stamps[i].mtime, index->stamps[i].path);
+
+    for (i = 0; i < index->size; i++) {
+        if (index->entries[i].virtual_path != NULL)
+            fprintf(f, "F\t%s\t%s\n", index->entries[i].virtual_path, index->entries[i].real_path);
+    }
+
+    if (fclose(f)) {
+        remove_file(temp_path);
+        return 3;
+    }
+
+#ifdef _WIN32
+    if (!MoveFileEx(temp_path, cache_path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(temp_path, cache_path)) {
+#endif
+        remove_file(temp_path);
+        return 4;
+    }
+
+    return 0;
+}
+
+
+struct include_index *get_include_index(char *includefolder) {
+    /*
+     * Returns the index for the given include folder, building it on first
+     * use. If the environment variable INCLUDEINDEX names a folder, indices
+     * are persisted there and reused by later calls as long as the include
+     * folder didn't change.
+     *
+     * Returns NULL if the folder could not be indexed.
+     */
+
+    struct include_index *index;
+    char *cache_dir;
+    char cache_path[2048];
+    time_t build_start;
+
+    pthread_mutex_lock(&include_index_lock);
+
+    for (index = include_indices; index != NULL; index = index->next) {
+        if (strcmp(index->includefolder, includefolder) == 0)
+            goto done;
+    }
+
+    cache_dir = getenv("INCLUDEINDEX");
+
+    index = (struct include_index *)safe_malloc(sizeof(struct include_index));
+    memset(index, 0, sizeof(struct include_index));
+    index->includefolder = safe_strdup(includefolder);
+    index->persistable = (cache_dir != NULL && cache_dir[0] != 0);
+
+    if (index->persistable) {
+        get_index_cache_path(index, cache_dir, cache_path, sizeof(cache_path));
+        if (read_include_index(index, cache_path) == 0)
+            goto add;
+        include_index_clear(index);
+        index->persistable = true;
+    }
+
+    build_start = time(NULL);
+
+    if (build_include_index(index)) {
+        include_index_clear(index);
+        free(index->includefolder);
+        free(index);
+        index = NULL;
+        goto done;
+    }
+
+    if (index->persistable) {
+        create_folders(cache_dir);
+        write_include_index(index, cache_path, build_start);
+    }
+
+add:
+    index->next = include_indices;
+    include_indices = index;
+
+done:
+    pthread_mutex_unlock(&include_index_lock);
+
+    return index;
+}
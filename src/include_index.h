@@ -0,0 +1,56 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+
+#define INDEXINTERVAL 1024
+#define STAMPINTERVAL 256
+
+
+struct include_entry {
+    uint32_t hash;
+    char *virtual_path;
+    char *real_path;
+};
+
+struct include_stamp {
+    int64_t mtime;
+    char *path;
+};
+
+struct include_index {
+    char *includefolder;
+    uint32_t num_entries;
+    uint32_t size;
+    struct include_entry *entries;
+    bool persistable;
+    uint32_t num_stamps;
+    struct include_stamp *stamps;
+    struct include_index *next;
+};
+
+
+struct include_index *get_include_index(char *includefolder);
+
+char *include_index_find(struct include_index *index, char *virtual_path);
@@ -34,22 +34,23 @@
 #include "filesystem.h"
 #include "keygen.h"
 #include "sign.h"
+#include "simd.h"
 
 
 void print_usage() {
     printf("armake\n"
            "\n"
            "Usage:\n"
-           "    armake binarize [-f] [-w <wname>] [-i <includefolder>] <source> [<target>]\n"
-           "    armake build [-f] [-p] [-w <wname>] [-i <includefolder>] [-x <xlist>] [-k <privatekey>] [-s <signature>] [-e <headerextension>] <folder> <pbo>\n"
+           "    armake binarize [-f] [-m] [-j <jobs>] [-c <cachedir>] [-w <wname>] [-i <includefolder>] <source> [<target>]\n"
+           "    armake build [-f] [-p] [-m] [-j <jobs>] [-c <cachedir>] [-w <wname>] [-i <includefolder>] [-x <xlist>] [-k <privatekey>] [-s <signature>] [-e <headerextension>] <folder> <pbo>\n"
            "    armake inspect <pbo>\n"
            "    armake unpack [-f] [-i <includepattern>] [-x <excludepattern>] <pbo> <folder>\n"
            "    armake cat <pbo> <name>\n"
            "    armake derapify [-f] [-d <indentation>] [<source> [<target>]]\n"
            "    armake keygen [-f] <keyname>\n"
            "    armake sign [-f] [-s <signature>] <privatekey> <pbo>\n"
-           "    armake paa2img [-f] <source> <target>\n"
-           "    armake img2paa [-f] [-z] [-t <paatype>] <source> <target>\n"
+           "    armake paa2img [-f] [-r] [-j <jobs>] <source> <target>\n"
+           "    armake img2paa [-f] [-z] [-r] [-V] [-j <jobs>] [-t <paatype>] [-q <quality>] <source> <target>\n"
            "    armake (-h | --help)\n"
            "    armake (-v | --version)\n"
            "\n"
@@ -68,6 +69,14 @@ void print_usage() {
            "Options:\n"
            "    -f --force      Overwrite the target file/folder if it already exists.\n"
            "    -p --packonly   Don't binarize models, configs etc.\n"
+           "    -m --optimize-meshes\n"
+           "                    Reorder the faces of binarized models for the vertex\n"
+           "                    cache and print the ACMR before and after.\n"
+           "    -j --jobs       Number of files to binarize in parallel, 1 by default.\n"
+           "                        For binarize: number of threads converting P3D LODs.\n"
+           "                        For img2paa: number of threads compressing mipmaps.\n"
+           "                        With --recursive: number of files converted in parallel.\n"
+           "    -c --cache      Folder to cache binarized files in (see below).\n"
            "    -w --warning    Warning to disable (repeatable).\n"
            "    -i --include    Folder to search for includes, defaults to CWD (repeatable).\n"
            "                        For unpack: pattern to include in output folder (repeatable).\n"
@@ -81,6 +90,11 @@ void print_usage() {
            "    -z --compress   Compress final PAA where possible.\n"
            "    -t --type       PAA type. One of: DXT1, DXT3, DXT5, ARGB4444, ARGB1555, AI88\n"
            "                        Currently only DXT1 and DXT5 are implemented.\n"
+           "    -q --quality    DXT encoder quality. One of: fast, normal (default), best\n"
+           "    -V --verbose    Print the time spent in each stage of img2paa.\n"
+           "    -r --recursive  For img2paa/paa2img: convert all images in the source folder\n"
+           "                        to the target folder. Targets that aren't older than\n"
+           "                        their source are skipped unless --force is set.\n"
            "    -h --help       Show usage information and exit.\n"
            "    -v --version    Print the version number and exit.\n"
            "\n"
@@ -97,7 +111,18 @@ void print_usage() {
            "    happen and use armake's instead, pass the environment variable NATIVEBIN.\n"
            "\n"
            "    Since binarize.exe's output is usually excessively verbose, it is hidden\n"
-           "    by default. Pass BIOUTPUT to display it.\n");
+           "    by default. Pass BIOUTPUT to display it.\n"
+           "\n"
+           "Include index:\n"
+           "    Include folders are indexed once per call to resolve absolute includes.\n"
+           "    Set the environment variable INCLUDEINDEX to a folder to keep these\n"
+           "    indices between calls. They are rebuilt when the include folders change.\n"
+           "\n"
+           "Binarization cache:\n"
+           "    If a cache folder is given with --cache or the environment variable\n"
+           "    BINARIZECACHE, binarized files are stored there by the hash of their\n"
+           "    source. A cached file is reused as long as the source and every file\n"
+           "    read to binarize it (includes, model.cfg, materials) are unchanged.\n");
 }
 
 
@@ -120,14 +145,20 @@ int read_args(int argc, char *argv[]) {
     const struct arg_option bool_options[] = {
         { "-f", "--force", &args.force, NULL },
         { "-p", "--packonly", &args.packonly, NULL },
-        { "-z", "--compress", &args.compress, NULL }
+        { "-z", "--compress", &args.compress, NULL },
+        { "-m", "--optimize-meshes", &args.optimizemeshes, NULL },
+        { "-V", "--verbose", &args.verbose, NULL },
+        { "-r", "--recursive", &args.recursive, NULL }
     };
 
     const struct arg_option single_options[] = {
         { "-k", "--key", &args.privatekey, NULL },
         { "-s", "--signature", &args.signature, NULL },
         { "-d", "--indent", &args.indent, NULL },
-        { "-t", "--type", &args.paatype, NULL }
+        { "-t", "--type", &args.paatype, NULL },
+        { "-q", "--quality", &args.quality, NULL },
+        { "-j", "--jobs", &args.jobs, NULL },
+        { "-c", "--cache", &args.cache, NULL }
     };
 
     const struct arg_option multi_options[] = {
@@ -242,6 +273,12 @@ int main(int argc, char *argv[]) {
     if (args.num_positionals == 0 || args.num_positionals > 3)
         goto error;
 
+    if (args.jobs != NULL && atoi(args.jobs) < 1)
+        goto error;
+
+    // detect the instruction set once, before any worker threads start
+    simd_init();
+
     if (strcmp(args.positionals[0], "binarize") == 0)
         success = cmd_binarize();
     else if (strcmp(args.positionals[0], "build") == 0)
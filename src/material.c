@@ -23,8 +23,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "args.h"
+#include "cache.h"
 #include "filesystem.h"
 #include "rapify.h"
 #include "preprocess.h"
@@ -91,21 +93,156 @@ const struct shader_ref vertexshaders[20] = {
 };
 
 
+pthread_mutex_t material_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// materials read so far, indexed by the id of their path in the key table
+bool material_cache_initialized = false;
+struct string_table material_cache_keys;
+struct material_cache_entry *material_cache = NULL;
+uint32_t material_cache_size = 0;
+
+
+void copy_material(struct material *target, struct material *source) {
+    /*
+     * Copies the given material including its stages, but keeps the path
+     * of the target.
+     */
+
+    char path[2048];
+
+    strcpy(path, target->path);
+    *target = *source;
+    strcpy(target->path, path);
+
+    target->textures = (struct stage_texture *)safe_malloc(sizeof(struct stage_texture) * source->num_textures);
+    memcpy(target->textures, source->textures, sizeof(struct stage_texture) * source->num_textures);
+
+    target->transforms = (struct stage_transform *)safe_malloc(sizeof(struct stage_transform) * source->num_transforms);
+    memcpy(target->transforms, source->transforms, sizeof(struct stage_transform) * source->num_transforms);
+}
+
+
+int material_cache_lookup(char *path, struct material *material) {
+    /*
+     * Fills in the given material from the cache if it holds an entry for
+     * path whose files haven't been modified since. The files are recorded
+     * as dependencies of the current binarization, like on a real read.
+     *
+     * Returns 0 on a hit and 1 otherwise.
+     */
+
+    struct material_cache_entry *entry;
+    uint32_t id;
+    uint32_t i;
+
+    pthread_mutex_lock(&material_cache_lock);
+
+    if (!material_cache_initialized) {
+        pthread_mutex_unlock(&material_cache_lock);
+        return 1;
+    }
+
+    id = string_table_add(&material_cache_keys, path);
+    if (id >= material_cache_size || !material_cache[id].valid) {
+        pthread_mutex_unlock(&material_cache_lock);
+        return 1;
+    }
+
+    entry = &material_cache[id];
+
+    for (i = 0; i < entry->num_dependencies; i++) {
+        if (get_file_mtime(entry->dependencies[i]) != entry->mtimes[i]) {
+            pthread_mutex_unlock(&material_cache_lock);
+            return 1;
+        }
+    }
+
+    copy_material(material, &entry->material);
+
+    for (i = 0; i < entry->num_dependencies; i++)
+        cache_add_dependency(entry->dependencies[i]);
+
+    pthread_mutex_unlock(&material_cache_lock);
+
+    return 0;
+}
+
+
+void material_cache_store(char *path, struct material *material, struct cache_entry *dependencies) {
+    /*
+     * Stores a copy of the given material under path, replacing any older
+     * entry. Takes over the list of files the material was read from.
+     */
+
+    struct material_cache_entry *entry;
+    uint32_t size;
+    uint32_t id;
+    uint32_t i;
+
+    pthread_mutex_lock(&material_cache_lock);
+
+    if (!material_cache_initialized) {
+        string_table_init(&material_cache_keys);
+        material_cache_initialized = true;
+    }
+
+    id = string_table_add(&material_cache_keys, path);
+    if (id >= material_cache_size) {
+        size = (id / MATERIALINTERVAL + 1) * MATERIALINTERVAL;
+        material_cache = (struct material_cache_entry *)safe_realloc(material_cache,
+                sizeof(struct material_cache_entry) * size);
+        memset(material_cache + material_cache_size, 0,
+                sizeof(struct material_cache_entry) * (size - material_cache_size));
+        material_cache_size = size;
+    }
+
+    entry = &material_cache[id];
+
+    if (entry->valid) {
+        free(entry->material.textures);
+        free(entry->material.transforms);
+        for (i = 0; i < entry->num_dependencies; i++)
+            free(entry->dependencies[i]);
+        free(entry->dependencies);
+        free(entry->mtimes);
+    }
+
+    strncpy(entry->material.path, path, sizeof(entry->material.path) - 1);
+    copy_material(&entry->material, material);
+
+    entry->num_dependencies = dependencies->num_dependencies;
+    entry->dependencies = dependencies->dependencies;
+    entry->mtimes = (int64_t *)safe_malloc(sizeof(int64_t) * MAX(entry->num_dependencies, 1));
+    for (i = 0; i < entry->num_dependencies; i++)
+        entry->mtimes[i] = get_file_mtime(entry->dependencies[i]);
+
+    dependencies->num_dependencies = 0;
+    dependencies->dependencies = NULL;
+
+    entry->valid = true;
+
+    pthread_mutex_unlock(&material_cache_lock);
+}
+
+
 int read_material(struct material *material) {
     /*
      * Reads the material information for the given material struct.
      * Returns 0 on success and a positive integer on failure.
      */
 
-    extern char *current_target;
     FILE *f;
     char actual_path[2048];
-    char rapified_path[2048];
     char config_path[2048];
+    char key[2048];
     char temp[2048];
     char shader[2048];
     int i;
+    int success;
     struct color default_color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    struct buffer rapified;
+    struct cache_entry *recording;
+    struct cache_entry dependencies;
 
     if (material->path[0] != '\\') {
         strcpy(temp, "\\");
@@ -114,6 +251,11 @@ int read_material(struct material *material) {
         strcpy(temp, material->path);
     }
 
+    // the same materials are used by most LODs and often by many models
+    strcpy(key, temp);
+    if (!material_cache_lookup(key, material))
+        return 0;
+
     // Write default values
     material->type = MATERIALTYPE;
     material->depr_1 = 1;
@@ -155,21 +297,31 @@ int read_material(struct material *material) {
 
     current_target = temp;
 
-    strcpy(rapified_path, actual_path);
-    strcat(rapified_path, ".armake.bin"); // it is assumed that this doesn't exist
+    // Rapify file into memory, collecting the files it is made of
+    memset(&dependencies, 0, sizeof(dependencies));
+    recording = cache_get_recording();
+    cache_start_recording(&dependencies);
+
+    cache_add_dependency(actual_path);
+    success = rapify_to_buffer(actual_path, &rapified);
 
-    // Rapify file
-    if (rapify_file(actual_path, rapified_path)) {
+    cache_start_recording(recording);
+    for (i = 0; i < dependencies.num_dependencies; i++)
+        cache_add_dependency(dependencies.dependencies[i]);
+
+    if (success) {
         lwarningf(current_target, -1, "Failed to rapify %s.\n", actual_path);
+        cache_entry_free(&dependencies);
         return 2;
     }
 
     current_target = material->path;
 
-    // Open rapified file
-    f = fopen(rapified_path, "rb");
+    f = open_memory_file(rapified.data, rapified.length);
     if (!f) {
         lwarningf(current_target, -1, "Failed to open rapified material.\n");
+        buffer_free(&rapified);
+        cache_entry_free(&dependencies);
         return 3;
     }
 
@@ -257,10 +409,10 @@ int read_material(struct material *material) {
 
     // Clean up
     fclose(f);
-    if (remove_file(rapified_path)) {
-        lwarningf(current_target, -1, "Failed to remove temporary material.\n");
-        return 4;
-    }
+    buffer_free(&rapified);
+
+    material_cache_store(key, material, &dependencies);
+    cache_entry_free(&dependencies);
 
     return 0;
 }
@@ -21,6 +21,7 @@
 
 #define MATERIALTYPE 11
 #define MAXSTAGES 16
+#define MATERIALINTERVAL 32
 
 
 #include "utils.h"
@@ -74,5 +75,13 @@ struct material {
     struct stage_texture dummy_texture;
 };
 
+struct material_cache_entry {
+    bool valid;
+    struct material material;
+    uint32_t num_dependencies;
+    char **dependencies;
+    int64_t *mtimes;
+};
+
 
 int read_material(struct material *material);
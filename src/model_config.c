@@ -23,8 +23,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "filesystem.h"
+#include "cache.h"
 #include "rapify.h"
 #include "utils.h"
 #include "derapify.h"
@@ -48,6 +50,8 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
     char containing[2048];
     char value_path[2048];
     char value[2048];
+    char **anim_names;
+    uint32_t num_anim_names;
 
     // Run the function for the parent class first
     fseek(f, 16, SEEK_SET);
@@ -84,28 +88,31 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
         return -1;
 
     // Now go through all the animations
-    char anim_names[MAXANIMS][512];
-    for (i = 0; i < MAXANIMS; i++)
-        anim_names[i][0] = 0;
-
-    success = read_classes(f, config_path, (char *)anim_names, MAXANIMS, 512);
-    if (success)
+    anim_names = NULL;
+    num_anim_names = 0;
+    success = read_classes(f, config_path, &skeleton->strings, &anim_names, &num_anim_names);
+    if (success) {
+        free(anim_names);
         return success;
+    }
 
-    for (i = 0; i < MAXANIMS; i++) {
-        if (strlen(anim_names[i]) == 0)
-            break;
-
-        for (j = 0; j < MAXANIMS; j++) {
-            if (strlen(skeleton->animations[j].name) == 0)
-                break;
+    for (i = 0; i < num_anim_names; i++) {
+        for (j = 0; j < skeleton->num_animations; j++) {
             if (strcmp(skeleton->animations[j].name, anim_names[i]) == 0)
                 break;
         }
-        if (j == MAXANIMS)
-            return 1;
 
         if (j == skeleton->num_animations) {
+            if (skeleton->num_animations % ANIMATIONINTERVAL == 0)
+                skeleton->animations = (struct animation *)safe_realloc(skeleton->animations,
+                        sizeof(struct animation) * (skeleton->num_animations + ANIMATIONINTERVAL));
+
+            memset(&skeleton->animations[j], 0, sizeof(struct animation));
+            skeleton->animations[j].selection = skeleton->strings.strings[0];
+            skeleton->animations[j].source = skeleton->strings.strings[0];
+            skeleton->animations[j].axis = skeleton->strings.strings[0];
+            skeleton->animations[j].begin = skeleton->strings.strings[0];
+            skeleton->animations[j].end = skeleton->strings.strings[0];
             skeleton->num_animations++;
         } else {
             for (k = j; k < skeleton->num_animations - 1; k++) {
@@ -114,7 +121,7 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
             j = skeleton->num_animations - 1;
         }
 
-        strcpy(skeleton->animations[j].name, anim_names[i]);
+        skeleton->animations[j].name = anim_names[i];
 
         // Read anim type
         sprintf(value_path, "%s >> %s >> type", config_path, anim_names[i]);
@@ -153,11 +160,11 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
         }
 
         // Read optional values
-        skeleton->animations[j].source[0] = 0;
-        skeleton->animations[j].selection[0] = 0;
-        skeleton->animations[j].axis[0] = 0;
-        skeleton->animations[j].begin[0] = 0;
-        skeleton->animations[j].end[0] = 0;
+        skeleton->animations[j].source = skeleton->strings.strings[0];
+        skeleton->animations[j].selection = skeleton->strings.strings[0];
+        skeleton->animations[j].axis = skeleton->strings.strings[0];
+        skeleton->animations[j].begin = skeleton->strings.strings[0];
+        skeleton->animations[j].end = skeleton->strings.strings[0];
         skeleton->animations[j].min_value = 0.0f;
         skeleton->animations[j].max_value = 1.0f;
         skeleton->animations[j].min_phase = 0.0f;
@@ -175,24 +182,44 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
 #define ERROR_READING(key) lwarningf(current_target, -1, "Error reading %s for %s.\n", key, anim_names[i]);
 
         sprintf(value_path, "%s >> %s >> source", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].source, sizeof(skeleton->animations[j].source)) > 0)
+        success = read_string(f, value_path, value, sizeof(value));
+        if (success > 0) {
             ERROR_READING("source")
+        } else if (success == 0) {
+            skeleton->animations[j].source = string_table_intern(&skeleton->strings, value);
+        }
 
         sprintf(value_path, "%s >> %s >> selection", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].selection, sizeof(skeleton->animations[j].selection)) > 0)
+        success = read_string(f, value_path, value, sizeof(value));
+        if (success > 0) {
             ERROR_READING("selection")
+        } else if (success == 0) {
+            skeleton->animations[j].selection = string_table_intern(&skeleton->strings, value);
+        }
 
         sprintf(value_path, "%s >> %s >> axis", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].axis, sizeof(skeleton->animations[j].axis)) > 0)
+        success = read_string(f, value_path, value, sizeof(value));
+        if (success > 0) {
             ERROR_READING("axis")
+        } else if (success == 0) {
+            skeleton->animations[j].axis = string_table_intern(&skeleton->strings, value);
+        }
 
         sprintf(value_path, "%s >> %s >> begin", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].begin, sizeof(skeleton->animations[j].begin)) > 0)
+        success = read_string(f, value_path, value, sizeof(value));
+        if (success > 0) {
             ERROR_READING("begin")
+        } else if (success == 0) {
+            skeleton->animations[j].begin = string_table_intern(&skeleton->strings, value);
+        }
 
         sprintf(value_path, "%s >> %s >> end", config_path, anim_names[i]);
-        if (read_string(f, value_path, skeleton->animations[j].end, sizeof(skeleton->animations[j].end)) > 0)
+        success = read_string(f, value_path, value, sizeof(value));
+        if (success > 0) {
             ERROR_READING("end")
+        } else if (success == 0) {
+            skeleton->animations[j].end = string_table_intern(&skeleton->strings, value);
+        }
 
         sprintf(value_path, "%s >> %s >> minValue", config_path, anim_names[i]);
         if (read_float(f, value_path, &skeleton->animations[j].min_value) > 0)
@@ -254,45 +281,359 @@ int read_animations(FILE *f, char *config_path, struct skeleton *skeleton) {
         }
     }
 
+    free(anim_names);
+
     return 0;
 }
 
 
-int sort_bones(struct bone *src, struct bone *tgt, int tgt_index, char *parent) {
-    int i;
-    int j;
+int sort_bones(struct bone *src, uint32_t num_bones, struct bone *tgt, uint32_t tgt_index, char *parent) {
+    /*
+     * Copies the bones with the given parent and their children into tgt,
+     * which has room for num_bones bones, so that every bone comes after
+     * its parent. Bones with a missing parent are appended at the end.
+     *
+     * Returns the number of bones in tgt.
+     */
 
-    for (i = 0; i < MAXBONES; i++) {
-        if (strlen(src[i].name) == 0)
-            continue;
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 0; i < num_bones && tgt_index < num_bones; i++) {
         if (strcmp(src[i].parent, parent) != 0)
             continue;
 
-        memcpy(&tgt[tgt_index++], &src[i], sizeof(struct bone));
-        tgt_index = sort_bones(src, tgt, tgt_index, src[i].name);
+        tgt[tgt_index++] = src[i];
+        tgt_index = sort_bones(src, num_bones, tgt, tgt_index, src[i].name);
     }
 
     if (strlen(parent) > 0)
         return tgt_index;
 
     // copy the remaining bones
-    for (i = 0; i < MAXBONES; i++) {
-        if (strlen(src[i].name) == 0)
-            break;
-        for (j = 0; j < MAXBONES; j++) {
+    for (i = 0; i < num_bones && tgt_index < num_bones; i++) {
+        if (strlen(src[i].parent) == 0)
+            continue;
+        for (j = 0; j < tgt_index; j++) {
             if (strcmp(src[i].parent, tgt[j].name) == 0)
                 break;
         }
-        if (j == MAXBONES) {
-            memcpy(&tgt[tgt_index], &src[i], sizeof(struct bone));
-            tgt_index++;
-        }
+        if (j == tgt_index)
+            tgt[tgt_index++] = src[i];
     }
 
     return tgt_index;
 }
 
 
+void skeleton_init(struct skeleton *skeleton) {
+    /*
+     * Initializes an empty skeleton, which stays empty for models without a
+     * model config entry.
+     */
+
+    memset(skeleton, 0, sizeof(struct skeleton));
+    string_table_init(&skeleton->strings);
+}
+
+
+void skeleton_free(struct skeleton *skeleton) {
+    free(skeleton->bones);
+    free(skeleton->sections);
+    free(skeleton->animations);
+    string_table_free(&skeleton->strings);
+}
+
+
+pthread_mutex_t model_config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// model configs read so far, indexed by the id of their path in the path table
+bool model_configs_initialized = false;
+struct string_table model_config_paths;
+struct model_config **model_configs = NULL;
+uint32_t model_configs_size = 0;
+
+
+int read_skeleton_bones(FILE *f, char *name, struct string_table *bone_names, struct skeleton_bones *result) {
+    /*
+     * Reads the bones of the given CfgSkeletons entry, sorted by parent and
+     * converted to lower case. The names are interned in bone_names.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    uint32_t i;
+    uint32_t num_sorted;
+    uint32_t num_entries;
+    int success;
+    int32_t temp;
+    char config_path[2048];
+    char parent[512];
+    char buffer[2048];
+    char **bones;
+    struct string_table strings;
+    struct bone *bones_unsorted;
+    struct bone *bones_sorted;
+
+    result->is_discrete = false;
+    result->num_bones = 0;
+    result->bones = NULL;
+
+    string_table_init(&strings);
+    bones = NULL;
+    num_entries = 0;
+
+    parent[0] = 0;
+    sprintf(config_path, "CfgSkeletons >> %s >> skeletonInherit", name);
+    success = read_string(f, config_path, parent, sizeof(parent));
+    if (success > 0)
+        goto error;
+
+    sprintf(config_path, "CfgSkeletons >> %s >> isDiscrete", name);
+    success = read_int(f, config_path, &temp);
+    if (success == 0)
+        result->is_discrete = (temp > 0);
+
+    if (strlen(parent) > 0) { // @todo: more than 1 parent
+        sprintf(config_path, "CfgSkeletons >> %s >> skeletonBones", parent);
+        success = read_string_array(f, config_path, &strings, &bones, &num_entries);
+        if (success > 0)
+            goto error;
+    }
+
+    sprintf(config_path, "CfgSkeletons >> %s >> skeletonBones", name);
+    success = read_string_array(f, config_path, &strings, &bones, &num_entries);
+    if (success > 0)
+        goto error;
+
+    // Entries alternate between bone name and parent name
+    bones_unsorted = (struct bone *)safe_malloc(sizeof(struct bone) * (num_entries / 2 + 1));
+    for (i = 0; i < num_entries; i += 2) {
+        if (bones[i][0] == 0)
+            break;
+        bones_unsorted[i / 2].name = bones[i];
+        bones_unsorted[i / 2].parent = (i + 1 < num_entries) ? bones[i + 1] : strings.strings[0];
+        result->num_bones++;
+    }
+
+    // Sort bones by parent
+    bones_sorted = (struct bone *)safe_malloc(sizeof(struct bone) * MAX(result->num_bones, 1));
+    num_sorted = sort_bones(bones_unsorted, result->num_bones, bones_sorted, 0, "");
+
+    // Convert to lower case, bones that couldn't be sorted are left empty
+    result->bones = (struct bone *)safe_malloc(sizeof(struct bone) * MAX(result->num_bones, 1));
+    for (i = 0; i < result->num_bones; i++) {
+        if (i >= num_sorted) {
+            result->bones[i].name = bone_names->strings[0];
+            result->bones[i].parent = bone_names->strings[0];
+            continue;
+        }
+
+        strcpy(buffer, bones_sorted[i].name);
+        lower_case(buffer);
+        result->bones[i].name = string_table_intern(bone_names, buffer);
+
+        strcpy(buffer, bones_sorted[i].parent);
+        lower_case(buffer);
+        result->bones[i].parent = string_table_intern(bone_names, buffer);
+    }
+
+    free(bones_sorted);
+    free(bones_unsorted);
+    free(bones);
+    string_table_free(&strings);
+
+    return 0;
+
+error:
+    free(bones);
+    string_table_free(&strings);
+
+    return success;
+}
+
+
+void free_model_config(struct model_config *config) {
+    uint32_t i;
+
+    buffer_free(&config->rapified);
+
+    if (config->skeleton_bones != NULL) {
+        for (i = 0; i < config->skeletons.num_strings; i++)
+            free(config->skeleton_bones[i].bones);
+        free(config->skeleton_bones);
+    }
+
+    string_table_free(&config->models);
+    string_table_free(&config->skeletons);
+    string_table_free(&config->bone_names);
+
+    for (i = 0; i < config->num_dependencies; i++)
+        free(config->dependencies[i]);
+    free(config->dependencies);
+    free(config->mtimes);
+
+    free(config);
+}
+
+
+struct model_config *load_model_config(char *path) {
+    /*
+     * Rapifies the given model config and indexes its CfgModels and
+     * CfgSkeletons entries. Skeletons that fail to parse only produce an
+     * error once a model uses them.
+     *
+     * Returns NULL on failure.
+     */
+
+    FILE *f;
+    int success;
+    uint32_t i;
+    uint32_t id;
+    uint32_t num_classes;
+    char **classes;
+    char name[512];
+    struct string_table class_names;
+    struct model_config *config;
+    struct cache_entry *recording;
+    struct cache_entry dependencies;
+
+    config = (struct model_config *)safe_malloc(sizeof(struct model_config));
+
+    // Rapify file into memory, collecting the files it is made of
+    memset(&dependencies, 0, sizeof(dependencies));
+    recording = cache_get_recording();
+    cache_start_recording(&dependencies);
+
+    cache_add_dependency(path);
+    success = rapify_to_buffer(path, &config->rapified);
+
+    cache_start_recording(recording);
+    for (i = 0; i < dependencies.num_dependencies; i++)
+        cache_add_dependency(dependencies.dependencies[i]);
+
+    if (success) {
+        cache_entry_free(&dependencies);
+        free(config);
+        return NULL;
+    }
+
+    config->num_dependencies = dependencies.num_dependencies;
+    config->dependencies = dependencies.dependencies;
+    config->mtimes = (int64_t *)safe_malloc(sizeof(int64_t) * MAX(config->num_dependencies, 1));
+    for (i = 0; i < config->num_dependencies; i++)
+        config->mtimes[i] = get_file_mtime(config->dependencies[i]);
+
+    string_table_init(&config->models);
+    string_table_init(&config->skeletons);
+    string_table_init(&config->bone_names);
+    config->skeleton_bones = NULL;
+
+    f = open_memory_file(config->rapified.data, config->rapified.length);
+    if (!f) {
+        free_model_config(config);
+        return NULL;
+    }
+
+    string_table_init(&class_names);
+
+    // Model entries, ids are only used to check if a model has one
+    classes = NULL;
+    num_classes = 0;
+    read_classes(f, "CfgModels", &class_names, &classes, &num_classes);
+    for (i = 0; i < num_classes; i++) {
+        strcpy(name, classes[i]);
+        lower_case(name);
+        string_table_add(&config->models, name);
+    }
+
+    // Skeletons, parsed up front since most models of a folder share them
+    num_classes = 0;
+    read_classes(f, "CfgSkeletons", &class_names, &classes, &num_classes);
+    for (i = 0; i < num_classes; i++) {
+        strcpy(name, classes[i]);
+        lower_case(name);
+        string_table_add(&config->skeletons, name);
+    }
+
+    free(classes);
+    string_table_free(&class_names);
+
+    config->skeleton_bones = (struct skeleton_bones *)safe_malloc(
+            sizeof(struct skeleton_bones) * config->skeletons.num_strings);
+    memset(config->skeleton_bones, 0, sizeof(struct skeleton_bones) * config->skeletons.num_strings);
+
+    // id 0 is the empty string
+    for (id = 1; id < config->skeletons.num_strings; id++) {
+        config->skeleton_bones[id].error = read_skeleton_bones(f,
+                config->skeletons.strings[id], &config->bone_names, &config->skeleton_bones[id]);
+    }
+
+    fclose(f);
+
+    return config;
+}
+
+
+struct model_config *get_model_config(char *path) {
+    /*
+     * Returns the model config at the given path, reading it only if it
+     * hasn't been read before or its files were modified since. The files
+     * are recorded as dependencies of the current binarization either way.
+     *
+     * Replaced model configs are never freed, as other threads might still
+     * be reading them. Returns NULL on failure.
+     */
+
+    struct model_config *config;
+    uint32_t id;
+    uint32_t size;
+    uint32_t i;
+
+    pthread_mutex_lock(&model_config_lock);
+
+    if (!model_configs_initialized) {
+        string_table_init(&model_config_paths);
+        model_configs_initialized = true;
+    }
+
+    id = string_table_add(&model_config_paths, path);
+    if (id >= model_configs_size) {
+        size = (id / MODELCONFIGINTERVAL + 1) * MODELCONFIGINTERVAL;
+        model_configs = (struct model_config **)safe_realloc(model_configs,
+                sizeof(struct model_config *) * size);
+        memset(model_configs + model_configs_size, 0, sizeof(struct model_config *) * (size - model_configs_size));
+        model_configs_size = size;
+    }
+
+    config = model_configs[id];
+    for (i = 0; config != NULL && i < config->num_dependencies; i++) {
+        if (get_file_mtime(config->dependencies[i]) != config->mtimes[i])
+            config = NULL;
+    }
+
+    if (config != NULL) {
+        for (i = 0; i < config->num_dependencies; i++)
+            cache_add_dependency(config->dependencies[i]);
+
+        pthread_mutex_unlock(&model_config_lock);
+        return config;
+    }
+
+    pthread_mutex_unlock(&model_config_lock);
+
+    config = load_model_config(path);
+    if (config == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&model_config_lock);
+    model_configs[id] = config;
+    pthread_mutex_unlock(&model_config_lock);
+
+    return config;
+}
+
+
 int read_model_config(char *path, struct skeleton *skeleton) {
     /*
      * Reads the model config information for the given model path. If no
@@ -300,17 +641,16 @@ int read_model_config(char *path, struct skeleton *skeleton) {
      * and a positive integer on failure.
      */
 
-    extern char *current_target;
     FILE *f;
-    int i;
     int success;
+    uint32_t id;
+    uint32_t j;
     char model_config_path[2048];
-    char rapified_path[2048];
     char config_path[2048];
     char model_name[512];
-    char bones[MAXBONES * 2][512] = {};
     char buffer[512];
-    struct bone *bones_tmp;
+    struct model_config *config;
+    struct skeleton_bones *bones;
 
     current_target = path;
 
@@ -321,15 +661,15 @@ int read_model_config(char *path, struct skeleton *skeleton) {
     else
         strcpy(model_config_path, "model.cfg");
 
-    strcpy(rapified_path, model_config_path);
-    strcat(rapified_path, ".armake.bin"); // it is assumed that this doesn't exist
+    // a model config added later has to invalidate cached models too
+    cache_add_dependency(model_config_path);
 
     if (access(model_config_path, F_OK) == -1)
         return -1;
 
-    // Rapify file
-    success = rapify_file(model_config_path, rapified_path);
-    if (success) {
+    // all models of a folder share the same model config
+    config = get_model_config(model_config_path);
+    if (config == NULL) {
         errorf("Failed to rapify model config.\n");
         return 1;
     }
@@ -345,24 +685,16 @@ int read_model_config(char *path, struct skeleton *skeleton) {
 
     lower_case(model_name);
 
-    // Open rapified file
-    f = fopen(rapified_path, "rb");
+    // Check if model entry even exists
+    if (string_table_find(&config->models, model_name) == NOSTRING)
+        return 0;
+
+    f = open_memory_file(config->rapified.data, config->rapified.length);
     if (!f) {
         errorf("Failed to open model config.\n");
         return 2;
     }
 
-    // Check if model entry even exists
-    sprintf(config_path, "CfgModels >> %s", model_name);
-    fseek(f, 16, SEEK_SET);
-    success = seek_config_path(f, config_path);
-    if (success > 0) {
-        errorf("Failed to find model config entry.\n");
-        return success;
-    } else if (success < 0) {
-        goto clean_up;
-    }
-
     if (strchr(model_name, '_') == NULL)
         lnwarningf(path, -1, "model-without-prefix", "Model has a model config entry but doesn't seem to have a prefix (missing _).\n");
 
@@ -374,72 +706,33 @@ int read_model_config(char *path, struct skeleton *skeleton) {
         return success;
     }
 
-    // Read bones
+    // Copy bones
     if (strlen(skeleton->name) > 0) {
-        sprintf(config_path, "CfgSkeletons >> %s >> skeletonInherit", skeleton->name);
-        success = read_string(f, config_path, buffer, sizeof(buffer));
-        if (success > 0) {
-            errorf("Failed to read bones.\n");
-            return success;
-        }
+        strcpy(buffer, skeleton->name);
+        lower_case(buffer);
+
+        skeleton->is_discrete = false;
 
-        int32_t temp;
-        sprintf(config_path, "CfgSkeletons >> %s >> isDiscrete", skeleton->name);
-        success = read_int(f, config_path, &temp);
-        if (success == 0)
-            skeleton->is_discrete = (temp > 0);
-        else
-            skeleton->is_discrete = false;
-
-        i = 0;
-        if (strlen(buffer) > 0) { // @todo: more than 1 parent
-            sprintf(config_path, "CfgSkeletons >> %s >> skeletonBones", buffer);
-            success = read_string_array(f, config_path, (char *)bones, MAXBONES * 2, 512);
-            if (success > 0) {
+        id = string_table_find(&config->skeletons, buffer);
+        if (id != NOSTRING) {
+            bones = &config->skeleton_bones[id];
+            if (bones->error) {
                 errorf("Failed to read bones.\n");
-                return success;
-            } else if (success == 0) {
-                for (i = 0; i < MAXBONES * 2; i += 2) {
-                    if (bones[i][0] == 0)
-                        break;
-                }
+                return bones->error;
             }
-        }
 
-        sprintf(config_path, "CfgSkeletons >> %s >> skeletonBones", skeleton->name);
-        success = read_string_array(f, config_path, (char *)bones + i * 512, MAXBONES * 2 - i, 512);
-        if (success > 0) {
-            errorf("Failed to read bones.\n");
-            return success;
-        }
-
-        for (i = 0; i < MAXBONES * 2; i += 2) {
-            if (bones[i][0] == 0)
-                break;
-            strcpy(skeleton->bones[i / 2].name, bones[i]);
-            strcpy(skeleton->bones[i / 2].parent, bones[i + 1]);
-            skeleton->num_bones++;
-        }
-
-        // Sort bones by parent
-        bones_tmp = (struct bone *)safe_malloc(sizeof(struct bone) * MAXBONES);
-        memset(bones_tmp, 0, sizeof(struct bone) * MAXBONES);
-
-        sort_bones(skeleton->bones, bones_tmp, 0, "");
-        memcpy(skeleton->bones, bones_tmp, sizeof(struct bone) * MAXBONES);
-
-        free(bones_tmp);
-
-        // Convert to lower case
-        for (i = 0; i < MAXBONES; i++) {
-            if (strlen(skeleton->bones[i].name) == 0)
-                break;
-            lower_case(skeleton->bones[i].name);
-            lower_case(skeleton->bones[i].parent);
+            skeleton->is_discrete = bones->is_discrete;
+            skeleton->num_bones = bones->num_bones;
+            skeleton->bones = (struct bone *)safe_malloc(sizeof(struct bone) * MAX(bones->num_bones, 1));
+            for (j = 0; j < bones->num_bones; j++) {
+                skeleton->bones[j].name = string_table_intern(&skeleton->strings, bones->bones[j].name);
+                skeleton->bones[j].parent = string_table_intern(&skeleton->strings, bones->bones[j].parent);
+            }
         }
     }
 
     // Read sections
+    buffer[0] = 0;
     sprintf(config_path, "CfgModels >> %s >> sectionsInherit", model_name);
     success = read_string(f, config_path, buffer, sizeof(buffer));
     if (success > 0) {
@@ -447,31 +740,22 @@ int read_model_config(char *path, struct skeleton *skeleton) {
         return success;
     }
 
-    i = 0;
     if (strlen(buffer) > 0) {
         sprintf(config_path, "CfgModels >> %s >> sections", buffer);
-        success = read_string_array(f, config_path, (char *)skeleton->sections, MAXSECTIONS, 512);
+        success = read_string_array(f, config_path, &skeleton->strings, &skeleton->sections, &skeleton->num_sections);
         if (success > 0) {
             errorf("Failed to read sections.\n");
             return success;
-        } else if (success == 0) {
-            for (i = 0; i < MAXSECTIONS; i++) {
-                if (skeleton->sections[i][0] == 0)
-                    break;
-            }
         }
     }
 
     sprintf(config_path, "CfgModels >> %s >> sections", model_name);
-    success = read_string_array(f, config_path, (char *)skeleton->sections + i * 512, MAXSECTIONS - i, 512);
+    success = read_string_array(f, config_path, &skeleton->strings, &skeleton->sections, &skeleton->num_sections);
     if (success > 0) {
         errorf("Failed to read sections.\n");
         return success;
     }
 
-    for (i = 0; i < MAXSECTIONS && skeleton->sections[i][0] != 0; i++)
-        skeleton->num_sections++;
-
     // Read animations
     skeleton->num_animations = 0;
     sprintf(config_path, "CfgModels >> %s >> Animations", model_name);
@@ -498,13 +782,7 @@ int read_model_config(char *path, struct skeleton *skeleton) {
     sprintf(config_path, "CfgModels >> %s >> tBody", model_name);
     read_float(f, config_path, &skeleton->t_body);
 
-clean_up:
-    // Clean up
     fclose(f);
-    if (remove_file(rapified_path)) {
-        errorf("Failed to remove temporary model config.\n");
-        return 3;
-    }
 
     return 0;
 }
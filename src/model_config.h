@@ -19,9 +19,8 @@
 #pragma once
 
 
-#define MAXBONES 512
-#define MAXSECTIONS 1024
-#define MAXANIMS 1024
+#define ANIMATIONINTERVAL 32
+#define MODELCONFIGINTERVAL 16
 
 #define TYPE_ROTATION      0
 #define TYPE_ROTATION_X    1
@@ -40,20 +39,22 @@
 
 
 #include "vector.h"
+#include "utils.h"
 
+// names point into the string table of the skeleton or model config
 struct bone {
-    char name[512];
-    char parent[512];
+    char *name;
+    char *parent;
 };
 
 struct animation {
     uint32_t type;
-    char name[512];
-    char selection[512];
-    char source[512];
-    char axis[512];
-    char begin[512];
-    char end[512];
+    char *name;
+    char *selection;
+    char *source;
+    char *axis;
+    char *begin;
+    char *end;
     float min_value;
     float max_value;
     float min_phase;
@@ -75,12 +76,13 @@ struct animation {
 
 struct skeleton {
     char name[512];
+    struct string_table strings;
     uint32_t num_bones;
-    struct bone bones[MAXBONES];
+    struct bone *bones;
     uint32_t num_sections;
-    char sections[MAXSECTIONS][512];
+    char **sections;
     uint32_t num_animations;
-    struct animation animations[MAXANIMS];
+    struct animation *animations;
     bool is_discrete;
     float ht_min;
     float ht_max;
@@ -90,5 +92,27 @@ struct skeleton {
     float t_body;
 };
 
+struct skeleton_bones {
+    int error;
+    bool is_discrete;
+    uint32_t num_bones;
+    struct bone *bones;
+};
+
+struct model_config {
+    struct buffer rapified;
+    struct string_table models;
+    struct string_table skeletons;
+    struct string_table bone_names;
+    struct skeleton_bones *skeleton_bones;
+    uint32_t num_dependencies;
+    char **dependencies;
+    int64_t *mtimes;
+};
+
+
+void skeleton_init(struct skeleton *skeleton);
+
+void skeleton_free(struct skeleton *skeleton);
 
 int read_model_config(char *path, struct skeleton *skeleton);
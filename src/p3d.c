@@ -38,210 +38,311 @@
 #include "material.h"
 #include "vector.h"
 #include "matrix.h"
+#include "cache.h"
+#include "threads.h"
+#include "vertexcache.h"
 #include "p3d.h"
 
 
-int read_lods(FILE *f_source, struct mlod_lod *mlod_lods, uint32_t num_lods) {
+void *mlod_read(struct mlod_cursor *cursor, size_t length) {
     /*
-     * Reads all LODs (starting at the current position of f_source) into
-     * the given LODs array.
-     *
-     * Returns number of read lods on success and a negative integer on
-     * failure.
+     * Returns a pointer to the next length bytes of the MLOD data and moves
+     * the cursor past them, or NULL if the data is too short.
      */
 
-    char buffer[256];
-    int i;
-    int j;
-    int fp_tmp;
-    int fp_taggs;
-    bool empty;
-    uint32_t tagg_len;
+    void *ptr;
 
-    fseek(f_source, 0, SEEK_SET);
+    if (length > cursor->size - cursor->pos)
+        return NULL;
 
-    fread(buffer, 4, 1, f_source);
-    buffer[4] = 0;
-    if (stricmp(buffer, "MLOD"))
-        return -1;
+    ptr = cursor->data + cursor->pos;
+    cursor->pos += length;
 
-    fseek(f_source, 12, SEEK_SET);
+    return ptr;
+}
 
-    for (i = 0; i < num_lods; i++) {
-        fread(buffer, 4, 1, f_source);
-        if (strncmp(buffer, "P3DM", 4) != 0)
-            return -1;
 
-        fseek(f_source, 8, SEEK_CUR);
-        fread(&mlod_lods[i].num_points, 4, 1, f_source);
-        fread(&mlod_lods[i].num_facenormals, 4, 1, f_source);
-        fread(&mlod_lods[i].num_faces, 4, 1, f_source);
-        fseek(f_source, 4, SEEK_CUR);
-
-        empty = mlod_lods[i].num_points == 0;
-
-        if (empty) {
-            mlod_lods[i].num_points = 1;
-            mlod_lods[i].points = (struct point *)safe_malloc(sizeof(struct point));
-            mlod_lods[i].points[0].x = 0.0f;
-            mlod_lods[i].points[0].y = 0.0f;
-            mlod_lods[i].points[0].z = 0.0f;
-            mlod_lods[i].points[0].point_flags = 0;
-        } else {
-            mlod_lods[i].points = (struct point *)safe_malloc(sizeof(struct point) * mlod_lods[i].num_points);
-            for (j = 0; j < mlod_lods[i].num_points; j++)
-                fread(&mlod_lods[i].points[j], sizeof(struct point), 1, f_source);
-        }
+char *mlod_read_string(struct mlod_cursor *cursor) {
+    /*
+     * Returns the zero-terminated string at the cursor and moves the cursor
+     * past it, or NULL if it isn't terminated before the end of the data.
+     */
 
-        mlod_lods[i].facenormals = (struct triplet *)safe_malloc(sizeof(struct triplet) * mlod_lods[i].num_facenormals);
-        for (j = 0; j < mlod_lods[i].num_facenormals; j++)
-            fread(&mlod_lods[i].facenormals[j], sizeof(struct triplet), 1, f_source);
+    char *string = cursor->data + cursor->pos;
+    char *end;
 
-        mlod_lods[i].faces = (struct mlod_face *)safe_malloc(sizeof(struct mlod_face) * mlod_lods[i].num_faces);
-        for (j = 0; j < mlod_lods[i].num_faces; j++) {
-            fread(&mlod_lods[i].faces[j], 72, 1, f_source);
+    end = (char *)memchr(string, 0, cursor->size - cursor->pos);
+    if (end == NULL)
+        return NULL;
 
-            fp_tmp = ftell(f_source);
-            fread(mlod_lods[i].faces[j].texture_name,
-                sizeof(mlod_lods[i].faces[j].texture_name), 1, f_source);
-            fseek(f_source, fp_tmp + strlen(mlod_lods[i].faces[j].texture_name) + 1, SEEK_SET);
+    cursor->pos += end - string + 1;
 
-            fp_tmp = ftell(f_source);
-            fread(mlod_lods[i].faces[j].material_name,
-                sizeof(mlod_lods[i].faces[j].material_name), 1, f_source);
-            fseek(f_source, fp_tmp + strlen(mlod_lods[i].faces[j].material_name) + 1, SEEK_SET);
+    return string;
+}
 
-            strcpy(mlod_lods[i].faces[j].section_names, "");
-        }
 
-        fread(buffer, 4, 1, f_source);
-        if (strncmp(buffer, "TAGG", 4) != 0)
-            return -2;
+int mlod_copy(struct mlod_cursor *cursor, void *target, size_t length) {
+    void *ptr = mlod_read(cursor, length);
 
-        mlod_lods[i].mass = 0;
-        mlod_lods[i].num_sharp_edges = 0;
-        mlod_lods[i].sharp_edges = 0;
-        mlod_lods[i].selections = 0;
+    if (ptr == NULL)
+        return 1;
 
-        for (j = 0; j < MAXPROPERTIES; j++) {
-            mlod_lods[i].properties[j].name[0] = 0;
-            mlod_lods[i].properties[j].value[0] = 0;
-        }
+    memcpy(target, ptr, length);
 
-        fp_taggs = ftell(f_source);
+    return 0;
+}
 
-        // count selections
-        mlod_lods[i].num_selections = 0;
-        while (true) {
-            fseek(f_source, 1, SEEK_CUR);
 
-            fp_tmp = ftell(f_source);
-            fread(&buffer, sizeof(buffer), 1, f_source);
-            fseek(f_source, fp_tmp + strlen(buffer) + 1, SEEK_SET);
+void free_mlod_lod(struct mlod_lod *mlod_lod) {
+    uint32_t i;
 
-            fread(&tagg_len, 4, 1, f_source);
-            fp_tmp = ftell(f_source) + tagg_len;
+    free(mlod_lod->points);
+    point_soa_free(&mlod_lod->positions);
+    free(mlod_lod->facenormals);
+    free(mlod_lod->faces);
+    free(mlod_lod->mass);
+    free(mlod_lod->sharp_edges);
 
-            if (buffer[0] != '#')
-                mlod_lods[i].num_selections++;
+    for (i = 0; i < mlod_lod->num_selections; i++) {
+        free(mlod_lod->selections[i].points);
+        free(mlod_lod->selections[i].faces);
+    }
 
-            fseek(f_source, fp_tmp, SEEK_SET);
+    free(mlod_lod->selections);
+}
 
-            if (strcmp(buffer, "#EndOfFile#") == 0)
-                break;
-        }
 
-        mlod_lods[i].selections = (struct mlod_selection *)safe_malloc(sizeof(struct mlod_selection) * mlod_lods[i].num_selections);
-        for (j = 0; j < mlod_lods[i].num_selections; j++)
-            mlod_lods[i].selections[j].name[0] = 0;
+int read_lod(struct mlod_cursor *cursor, struct mlod_lod *mlod_lod, struct string_table *strings) {
+    /*
+     * Reads a single LOD starting at the cursor. Texture and material names
+     * are interned into the given string table.
+     *
+     * Returns 0 on success and a negative integer on failure. The LOD has
+     * to be freed either way.
+     */
 
-        fseek(f_source, fp_taggs, SEEK_SET);
+    char *magic;
+    char *name;
+    char *string;
+    void *data;
+    uint32_t tagg_len;
+    uint32_t j;
+    bool empty;
+    struct mlod_selection *selection;
+
+    mlod_lod->num_points = 0;
+    mlod_lod->num_facenormals = 0;
+    mlod_lod->num_faces = 0;
+    mlod_lod->num_sharp_edges = 0;
+    mlod_lod->num_selections = 0;
+    mlod_lod->points = NULL;
+    mlod_lod->positions.num_points = 0;
+    mlod_lod->positions.x = NULL;
+    mlod_lod->facenormals = NULL;
+    mlod_lod->faces = NULL;
+    mlod_lod->mass = NULL;
+    mlod_lod->sharp_edges = NULL;
+    mlod_lod->selections = NULL;
+    mlod_lod->strings = strings;
+
+    for (j = 0; j < MAXPROPERTIES; j++) {
+        mlod_lod->properties[j].name[0] = 0;
+        mlod_lod->properties[j].value[0] = 0;
+    }
 
-        while (true) {
-            fseek(f_source, 1, SEEK_CUR);
+    magic = mlod_read(cursor, 4);
+    if (magic == NULL || strncmp(magic, "P3DM", 4) != 0)
+        return -1;
 
-            fp_tmp = ftell(f_source);
-            fread(&buffer, sizeof(buffer), 1, f_source);
-            fseek(f_source, fp_tmp + strlen(buffer) + 1, SEEK_SET);
+    if (mlod_read(cursor, 8) == NULL ||
+            mlod_copy(cursor, &mlod_lod->num_points, 4) ||
+            mlod_copy(cursor, &mlod_lod->num_facenormals, 4) ||
+            mlod_copy(cursor, &mlod_lod->num_faces, 4) ||
+            mlod_read(cursor, 4) == NULL)
+        return -1;
 
-            fread(&tagg_len, 4, 1, f_source);
-            fp_tmp = ftell(f_source) + tagg_len;
+    // sanity check the counts before allocating anything for them
+    if (mlod_lod->num_points > (cursor->size - cursor->pos) / sizeof(struct point) ||
+            mlod_lod->num_facenormals > (cursor->size - cursor->pos) / sizeof(struct triplet) ||
+            mlod_lod->num_faces > (cursor->size - cursor->pos) / 72) {
+        mlod_lod->num_points = 0;
+        mlod_lod->num_facenormals = 0;
+        mlod_lod->num_faces = 0;
+        return -1;
+    }
 
-            if (buffer[0] != '#') {
-                for (j = 0; j < mlod_lods[i].num_selections; j++) {
-                    if (mlod_lods[i].selections[j].name[0] == 0)
-                        break;
-                }
+    empty = mlod_lod->num_points == 0;
 
-                strcpy(mlod_lods[i].selections[j].name, buffer);
+    if (empty) {
+        mlod_lod->num_points = 1;
+        mlod_lod->points = (struct point *)safe_malloc(sizeof(struct point));
+        mlod_lod->points[0].x = 0.0f;
+        mlod_lod->points[0].y = 0.0f;
+        mlod_lod->points[0].z = 0.0f;
+        mlod_lod->points[0].point_flags = 0;
+    } else {
+        mlod_lod->points = (struct point *)safe_malloc(sizeof(struct point) * mlod_lod->num_points);
+        if (mlod_copy(cursor, mlod_lod->points, sizeof(struct point) * mlod_lod->num_points))
+            return -1;
+    }
 
-                if (empty) {
-                    mlod_lods[i].selections[j].points = (uint8_t *)safe_malloc(1);
-                    mlod_lods[i].selections[j].points[0] = 0;
-                } else {
-                    mlod_lods[i].selections[j].points = (uint8_t *)safe_malloc(mlod_lods[i].num_points);
-                    fread(mlod_lods[i].selections[j].points, mlod_lods[i].num_points, 1, f_source);
-                }
+    point_soa_init(&mlod_lod->positions, &mlod_lod->points[0].x, mlod_lod->num_points, sizeof(struct point));
 
-                mlod_lods[i].selections[j].faces = (uint8_t *)safe_malloc(mlod_lods[i].num_faces);
-                fread(mlod_lods[i].selections[j].faces, mlod_lods[i].num_faces, 1, f_source);
-            }
+    mlod_lod->facenormals = (struct triplet *)safe_malloc(sizeof(struct triplet) * mlod_lod->num_facenormals);
+    if (mlod_copy(cursor, mlod_lod->facenormals, sizeof(struct triplet) * mlod_lod->num_facenormals))
+        return -1;
 
-            if (strcmp(buffer, "#Mass#") == 0) {
-                if (empty) {
-                    mlod_lods[i].mass = (float *)safe_malloc(sizeof(float));
-                    mlod_lods[i].mass[0] = 0.0f;
-                } else {
-                    mlod_lods[i].mass = (float *)safe_malloc(sizeof(float) * mlod_lods[i].num_points);
-                    fread(mlod_lods[i].mass, sizeof(float) * mlod_lods[i].num_points, 1, f_source);
-                }
-            }
+    mlod_lod->faces = (struct mlod_face *)safe_malloc(sizeof(struct mlod_face) * mlod_lod->num_faces);
+    for (j = 0; j < mlod_lod->num_faces; j++) {
+        if (mlod_copy(cursor, &mlod_lod->faces[j], 72))
+            return -1;
 
-            if (strcmp(buffer, "#SharpEdges#") == 0) {
-                mlod_lods[i].num_sharp_edges = tagg_len / (2 * sizeof(uint32_t));
-                mlod_lods[i].sharp_edges = (uint32_t *)safe_malloc(tagg_len);
-                fread(mlod_lods[i].sharp_edges, tagg_len, 1, f_source);
-            }
+        if ((string = mlod_read_string(cursor)) == NULL)
+            return -1;
+        mlod_lod->faces[j].texture_name = string_table_add(strings, string);
 
-            if (strcmp(buffer, "#Property#") == 0) {
-                for (j = 0; j < MAXPROPERTIES; j++) {
-                    if (mlod_lods[i].properties[j].name[0] == 0)
-                        break;
-                }
-                if (j == MAXPROPERTIES)
-                    return -3;
+        if ((string = mlod_read_string(cursor)) == NULL)
+            return -1;
+        mlod_lod->faces[j].material_name = string_table_add(strings, string);
 
-                fread(mlod_lods[i].properties[j].name, 64, 1, f_source);
-                fread(mlod_lods[i].properties[j].value, 64, 1, f_source);
-            }
+        mlod_lod->faces[j].section_names = 0;
+    }
 
-            fseek(f_source, fp_tmp, SEEK_SET);
+    magic = mlod_read(cursor, 4);
+    if (magic == NULL || strncmp(magic, "TAGG", 4) != 0)
+        return -2;
 
-            if (strcmp(buffer, "#EndOfFile#") == 0)
-                break;
-        }
+    while (true) {
+        if (mlod_read(cursor, 1) == NULL ||
+                (name = mlod_read_string(cursor)) == NULL ||
+                mlod_copy(cursor, &tagg_len, 4) ||
+                (data = mlod_read(cursor, tagg_len)) == NULL)
+            return -2;
 
-        fread(&mlod_lods[i].resolution, 4, 1, f_source);
+        if (name[0] != '#') {
+            if (mlod_lod->num_selections % SELECTIONINTERVAL == 0)
+                mlod_lod->selections = (struct mlod_selection *)safe_realloc(mlod_lod->selections,
+                        sizeof(struct mlod_selection) * (mlod_lod->num_selections + SELECTIONINTERVAL));
 
-        if (mlod_lods[i].resolution >= LOD_EDIT_START && mlod_lods[i].resolution < LOD_EDIT_END) {
-            free(mlod_lods[i].points);
-            free(mlod_lods[i].facenormals);
-            free(mlod_lods[i].faces);
-            free(mlod_lods[i].mass);
-            free(mlod_lods[i].sharp_edges);
-
-            for (j = 0; j < mlod_lods[i].num_selections; j++) {
-                free(mlod_lods[i].selections[j].points);
-                free(mlod_lods[i].selections[j].faces);
+            selection = &mlod_lod->selections[mlod_lod->num_selections++];
+            strncpy(selection->name, name, sizeof(selection->name) - 1);
+            selection->name[sizeof(selection->name) - 1] = 0;
+
+            if (empty) {
+                selection->points = (uint8_t *)safe_malloc(1);
+                selection->points[0] = 0;
+            } else {
+                selection->points = (uint8_t *)safe_malloc(mlod_lod->num_points);
+            }
+            selection->faces = (uint8_t *)safe_malloc(mlod_lod->num_faces);
+
+            if (tagg_len < (empty ? 0 : mlod_lod->num_points) + mlod_lod->num_faces)
+                return -2;
+
+            if (!empty)
+                memcpy(selection->points, data, mlod_lod->num_points);
+            memcpy(selection->faces, (char *)data + (empty ? 0 : mlod_lod->num_points), mlod_lod->num_faces);
+        } else if (strcmp(name, "#Mass#") == 0) {
+            free(mlod_lod->mass);
+            if (empty) {
+                mlod_lod->mass = (float *)safe_malloc(sizeof(float));
+                mlod_lod->mass[0] = 0.0f;
+            } else {
+                if (tagg_len < sizeof(float) * mlod_lod->num_points)
+                    return -2;
+                mlod_lod->mass = (float *)safe_malloc(sizeof(float) * mlod_lod->num_points);
+                memcpy(mlod_lod->mass, data, sizeof(float) * mlod_lod->num_points);
             }
+        } else if (strcmp(name, "#SharpEdges#") == 0) {
+            free(mlod_lod->sharp_edges);
+            mlod_lod->num_sharp_edges = tagg_len / (2 * sizeof(uint32_t));
+            mlod_lod->sharp_edges = (uint32_t *)safe_malloc(tagg_len);
+            memcpy(mlod_lod->sharp_edges, data, tagg_len);
+        } else if (strcmp(name, "#Property#") == 0) {
+            for (j = 0; j < MAXPROPERTIES; j++) {
+                if (mlod_lod->properties[j].name[0] == 0)
+                    break;
+            }
+            if (j == MAXPROPERTIES)
+                return -3;
+            if (tagg_len < 128)
+                return -2;
+
+            memcpy(mlod_lod->properties[j].name, data, 64);
+            memcpy(mlod_lod->properties[j].value, (char *)data + 64, 64);
+        } else if (strcmp(name, "#EndOfFile#") == 0) {
+            break;
+        }
+    }
+
+    if (mlod_copy(cursor, &mlod_lod->resolution, 4))
+        return -2;
+
+    return 0;
+}
+
+
+int read_lods(FILE *f_source, struct mlod_lod *mlod_lods, uint32_t num_lods, struct string_table *strings) {
+    /*
+     * Reads all LODs into the given LODs array. The whole file is read into
+     * memory once and parsed from there. Face texture and material names
+     * are stored as ids into the given string table, which has to be
+     * initialized already.
+     *
+     * Returns number of read lods on success and a negative integer on
+     * failure.
+     */
+
+    struct mlod_cursor cursor;
+    char magic[5];
+    long size;
+    int success;
+    int i;
+
+    fseek(f_source, 0, SEEK_END);
+    size = ftell(f_source);
+    fseek(f_source, 0, SEEK_SET);
 
-            free(mlod_lods[i].selections);
+    if (size < 12)
+        return -1;
+
+    cursor.data = (char *)safe_malloc(size);
+    cursor.size = size;
+    cursor.pos = 0;
+
+    if (fread(cursor.data, size, 1, f_source) != 1) {
+        free(cursor.data);
+        return -1;
+    }
+
+    memcpy(magic, cursor.data, 4);
+    magic[4] = 0;
+    if (stricmp(magic, "MLOD")) {
+        free(cursor.data);
+        return -1;
+    }
+
+    cursor.pos = 12;
+
+    for (i = 0; i < num_lods; i++) {
+        success = read_lod(&cursor, &mlod_lods[i], strings);
+        if (success) {
+            for (; i >= 0; i--)
+                free_mlod_lod(&mlod_lods[i]);
+            free(cursor.data);
+            return success;
+        }
+
+        if (mlod_lods[i].resolution >= LOD_EDIT_START && mlod_lods[i].resolution < LOD_EDIT_END) {
+            free_mlod_lod(&mlod_lods[i]);
 
             i--;
             num_lods--;
         }
     }
 
+    free(cursor.data);
+
     return num_lods;
 }
 
@@ -254,11 +355,9 @@ void get_bounding_box(struct mlod_lod *mlod_lods, uint32_t num_lods,
      */
 
     bool first;
-    float x;
-    float y;
-    float z;
+    vector lod_min;
+    vector lod_max;
     int i;
-    int j;
 
     memset(bbox_min, 0, sizeof(struct triplet));
     memset(bbox_max, 0, sizeof(struct triplet));
@@ -272,28 +371,27 @@ void get_bounding_box(struct mlod_lod *mlod_lods, uint32_t num_lods,
         if (!float_equal(mlod_lods[i].resolution, LOD_GEOMETRY, 0.01) && geometry_only)
             continue;
 
-        for (j = 0; j < mlod_lods[i].num_points; j++) {
-            x = mlod_lods[i].points[j].x;
-            y = mlod_lods[i].points[j].y;
-            z = mlod_lods[i].points[j].z;
+        if (mlod_lods[i].positions.num_points == 0)
+            continue;
+
+        geometry_bounds(&mlod_lods[i].positions, &lod_min, &lod_max);
 
-            if (first || x < bbox_min->x)
-                bbox_min->x = x;
-            if (first || x > bbox_max->x)
-                bbox_max->x = x;
+        if (first || lod_min.x < bbox_min->x)
+            bbox_min->x = lod_min.x;
+        if (first || lod_max.x > bbox_max->x)
+            bbox_max->x = lod_max.x;
 
-            if (first || y < bbox_min->y)
-                bbox_min->y = y;
-            if (first || y > bbox_max->y)
-                bbox_max->y = y;
+        if (first || lod_min.y < bbox_min->y)
+            bbox_min->y = lod_min.y;
+        if (first || lod_max.y > bbox_max->y)
+            bbox_max->y = lod_max.y;
 
-            if (first || z < bbox_min->z)
-                bbox_min->z = z;
-            if (first || z > bbox_max->z)
-                bbox_max->z = z;
+        if (first || lod_min.z < bbox_min->z)
+            bbox_min->z = lod_min.z;
+        if (first || lod_max.z > bbox_max->z)
+            bbox_max->z = lod_max.z;
 
-            first = false;
-        }
+        first = false;
     }
 }
 
@@ -303,30 +401,14 @@ float get_sphere(struct mlod_lod *mlod_lod, vector center) {
      * Calculate and return the bounding sphere for the given LOD.
      */
 
-    long i;
-    float sphere;
-    float dist;
-    vector point;
-
-    sphere = 0;
-    for (i = 0; i < mlod_lod->num_points; i++) {
-        point = *((vector*)&mlod_lod->points[i].x);
-        dist = vector_length(vector_sub(point, center));
-        if (dist > sphere)
-            sphere = dist;
-    }
-
-    return sphere;
+    return geometry_sphere(&mlod_lod->positions, center);
 }
 
 
 void get_mass_data(struct mlod_lod *mlod_lods, uint32_t num_lods, struct model_info *model_info) {
     int i;
     float mass;
-    vector sum;
-    vector pos;
     matrix inertia;
-    matrix r_tilda;
     struct mlod_lod *mass_lod;
 
     // mass is primarily stored in geometry
@@ -336,7 +418,7 @@ void get_mass_data(struct mlod_lod *mlod_lods, uint32_t num_lods, struct model_i
     }
 
     // alternatively use the PhysX LOD
-    if (i >= num_lods || mlod_lods[i].num_points == 0) {
+    if (i >= num_lods || mlod_lods[i].num_points == 0 || mlod_lods[i].mass == NULL) {
         for (i = 0; i < num_lods; i++) {
             if (float_equal(mlod_lods[i].resolution, LOD_PHYSX, 0.01))
                 break;
@@ -344,7 +426,7 @@ void get_mass_data(struct mlod_lod *mlod_lods, uint32_t num_lods, struct model_i
     }
 
     // mass data available?
-    if (i >= num_lods || mlod_lods[i].num_points == 0) {
+    if (i >= num_lods || mlod_lods[i].num_points == 0 || mlod_lods[i].mass == NULL) {
         model_info->mass = 0;
         model_info->mass_reciprocal = 1;
         model_info->inv_inertia = identity_matrix;
@@ -353,22 +435,8 @@ void get_mass_data(struct mlod_lod *mlod_lods, uint32_t num_lods, struct model_i
     }
 
     mass_lod = &mlod_lods[i];
-    sum = empty_vector;
-    mass = 0;
-    for (i = 0; i < mass_lod->num_points; i++) {
-        pos = *((vector *)&mass_lod->points[i].x);
-        mass += mass_lod->mass[i];
-        sum = vector_add(sum, vector_mult_scalar(mass_lod->mass[i], pos));
-    }
-
-    model_info->centre_of_mass = (mass > 0) ? vector_mult_scalar(1 / mass, sum) : empty_vector;
-
-    inertia = empty_matrix;
-    for (i = 0; i < mass_lod->num_points; i++) {
-        pos = *((vector *)&mass_lod->points[i].x);
-        r_tilda = vector_tilda(vector_sub(pos, model_info->centre_of_mass));
-        inertia = matrix_sub(inertia, matrix_mult_scalar(mass_lod->mass[i], matrix_mult(r_tilda, r_tilda)));
-    }
+    mass = geometry_mass(&mass_lod->positions, mass_lod->mass, &model_info->centre_of_mass);
+    inertia = geometry_inertia(&mass_lod->positions, mass_lod->mass, model_info->centre_of_mass);
 
     // apply calculations to modelinfo
     model_info->mass = mass;
@@ -478,7 +546,7 @@ void build_model_info(struct mlod_lod *mlod_lods, uint32_t num_lods, struct mode
     model_info->shadow_offset = 1.0f; //@todo
 
     model_info->skeleton = (struct skeleton *)safe_malloc(sizeof(struct skeleton));
-    memset(model_info->skeleton, 0, sizeof(struct skeleton));
+    skeleton_init(model_info->skeleton);
 
     model_info->map_type = 22; //@todo
     model_info->n_floats = 0;
@@ -537,11 +605,9 @@ uint32_t add_point(struct odol_lod *odol_lod, struct mlod_lod *mlod_lod, struct
     uint32_t j;
     uint32_t weight_index;
 
-    // Check if there already is a vertex that satisfies the requirements
-    for (i = 0; i < odol_lod->num_points; i++) {
-        if (odol_lod->vertex_to_point[i] != point_index_mlod)
-            continue;
-
+    // Check if there already is a vertex that satisfies the requirements,
+    // only vertices of the same MLOD point are candidates
+    for (i = odol_lod->point_first_vertex[point_index_mlod]; i != NOPOINT; i = odol_lod->vertex_next[i]) {
         // normals and uvs don't matter for non-visual lods
         if (mlod_lod->resolution < LOD_GEOMETRY) {
             if (!float_equal(odol_lod->normals[i].x, normal->x, 0.0001) ||
@@ -565,18 +631,8 @@ uint32_t add_point(struct odol_lod *odol_lod, struct mlod_lod *mlod_lod, struct
     if (odol_lod->vertexboneref != 0 && model_info->skeleton->num_bones > 0) {
         memset(&odol_lod->vertexboneref[odol_lod->num_points], 0, sizeof(struct odol_vertexboneref));
 
-        for (i = model_info->skeleton->num_bones - 1; (int32_t)i >= 0; i--) {
-            for (j = 0; j < mlod_lod->num_selections; j++) {
-                if (stricmp(model_info->skeleton->bones[i].name,
-                        mlod_lod->selections[j].name) == 0)
-                    break;
-            }
-
-            if (j == mlod_lod->num_selections)
-                continue;
-
-            if (mlod_lod->selections[j].points[point_index_mlod] == 0)
-                continue;
+        for (j = odol_lod->point_bones_start[point_index_mlod]; j < odol_lod->point_bones_start[point_index_mlod + 1]; j++) {
+            i = odol_lod->point_bones[j].bone;
 
             if (odol_lod->vertexboneref[odol_lod->num_points].num_bones == 4) {
                 lwarningf(current_target, -1, "Vertex %u of LOD %f is part of more than 4 bones.\n", point_index_mlod, mlod_lod->resolution);
@@ -592,7 +648,7 @@ uint32_t add_point(struct odol_lod *odol_lod, struct mlod_lod *mlod_lod, struct
             odol_lod->vertexboneref[odol_lod->num_points].num_bones++;
 
             odol_lod->vertexboneref[odol_lod->num_points].weights[weight_index][0] = odol_lod->skeleton_to_subskeleton[i].links[0];
-            odol_lod->vertexboneref[odol_lod->num_points].weights[weight_index][1] = mlod_lod->selections[j].points[point_index_mlod];
+            odol_lod->vertexboneref[odol_lod->num_points].weights[weight_index][1] = odol_lod->point_bones[j].weight;
 
             // convert weight
             if (odol_lod->vertexboneref[odol_lod->num_points].weights[weight_index][1] == 0x01)
@@ -606,6 +662,13 @@ uint32_t add_point(struct odol_lod *odol_lod, struct mlod_lod *mlod_lod, struct
     }
 
     odol_lod->vertex_to_point[odol_lod->num_points] = point_index_mlod;
+
+    odol_lod->vertex_next[odol_lod->num_points] = NOPOINT;
+    if (odol_lod->point_first_vertex[point_index_mlod] == NOPOINT)
+        odol_lod->point_first_vertex[point_index_mlod] = odol_lod->num_points;
+    else
+        odol_lod->vertex_next[odol_lod->point_to_vertex[point_index_mlod]] = odol_lod->num_points;
+
     odol_lod->point_to_vertex[point_index_mlod] = odol_lod->num_points;
 
     odol_lod->num_points++;
@@ -653,23 +716,262 @@ int compare_face_lookup(const void *a, const void *b, void *faces_ptr) {
     if (compare != 0)
         return compare;
 
-    return strcmp(faces[a_index].section_names, faces[b_index].section_names);
+    return (int)faces[a_index].section_names - (int)faces[b_index].section_names;
 }
 
 
-bool is_alpha(struct mlod_face *face) {
+int compare_strings(const void *a, const void *b) {
+    return strcmp(*((char **)a), *((char **)b));
+}
+
+
+bool is_alpha(char *texture_name) {
     // @todo check actual texture maybe?
-    if (strstr(face->texture_name, "_ca.paa") != NULL)
+    if (strstr(texture_name, "_ca.paa") != NULL)
         return true;
-    if (strstr(face->texture_name, "ca)") != NULL)
+    if (strstr(texture_name, "ca)") != NULL)
         return true;
     return false;
 }
 
 
+void set_section_names(struct mlod_lod *mlod_lod, struct skeleton *skeleton) {
+    /*
+     * Faces are grouped into sections by the skeleton sections they are
+     * part of. The names of those are joined per face and interned, and
+     * each face gets the rank of its joined names in sorted order, so faces
+     * can be sorted by comparing integers.
+     */
+
+    struct string_table names;
+    struct buffer buffer;
+    uint32_t *sections;
+    uint32_t *ranks;
+    uint32_t num_sections;
+    char **sorted;
+    uint32_t i;
+    uint32_t j;
+
+    sections = (uint32_t *)safe_malloc(sizeof(uint32_t) * MAX(mlod_lod->num_selections, 1));
+    num_sections = 0;
+
+    for (i = 0; i < mlod_lod->num_selections; i++) {
+        for (j = 0; j < skeleton->num_sections; j++) {
+            if (strcmp(mlod_lod->selections[i].name, skeleton->sections[j]) == 0) {
+                sections[num_sections++] = i;
+                break;
+            }
+        }
+    }
+
+    string_table_init(&names);
+    buffer_init(&buffer, 512);
+
+    for (i = 0; i < mlod_lod->num_faces; i++) {
+        buffer.length = 0;
+        for (j = 0; j < num_sections; j++) {
+            if (mlod_lod->selections[sections[j]].faces[i] == 0)
+                continue;
+            buffer_append_byte(&buffer, ':');
+            buffer_append(&buffer, mlod_lod->selections[sections[j]].name,
+                    strlen(mlod_lod->selections[sections[j]].name));
+        }
+        buffer_append_byte(&buffer, 0);
+
+        mlod_lod->faces[i].section_names = string_table_add(&names, buffer.data);
+    }
+
+    sorted = (char **)safe_malloc(sizeof(char *) * names.num_strings);
+    ranks = (uint32_t *)safe_malloc(sizeof(uint32_t) * names.num_strings);
+
+    memcpy(sorted, names.strings, sizeof(char *) * names.num_strings);
+    qsort(sorted, names.num_strings, sizeof(char *), compare_strings);
+
+    for (i = 0; i < names.num_strings; i++)
+        ranks[string_table_add(&names, sorted[i])] = i;
+
+    for (i = 0; i < mlod_lod->num_faces; i++)
+        mlod_lod->faces[i].section_names = ranks[mlod_lod->faces[i].section_names];
+
+    free(sorted);
+    free(ranks);
+    free(sections);
+    buffer_free(&buffer);
+    string_table_free(&names);
+}
+
+
+void build_point_bones(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod, struct skeleton *skeleton) {
+    /*
+     * Collects the bones every MLOD point is weighted to, so add_point
+     * doesn't have to look up the selection of every bone per vertex.
+     * The bones of point p are point_bones[point_bones_start[p]] up to
+     * point_bones[point_bones_start[p + 1]], in descending bone order.
+     */
+
+    int32_t *bone_selections;
+    uint32_t num_points;
+    uint32_t i;
+    uint32_t j;
+    uint32_t p;
+
+    num_points = odol_lod->num_points_mlod;
+
+    // the first selection named after each bone, if any
+    bone_selections = (int32_t *)safe_malloc(sizeof(int32_t) * MAX(skeleton->num_bones, 1));
+    for (i = 0; i < skeleton->num_bones; i++) {
+        bone_selections[i] = -1;
+        for (j = 0; j < mlod_lod->num_selections; j++) {
+            if (stricmp(skeleton->bones[i].name, mlod_lod->selections[j].name) == 0) {
+                bone_selections[i] = j;
+                break;
+            }
+        }
+    }
+
+    odol_lod->point_bones_start = (uint32_t *)safe_malloc(sizeof(uint32_t) * (num_points + 1));
+    memset(odol_lod->point_bones_start, 0, sizeof(uint32_t) * (num_points + 1));
+
+    // count first, then fill in
+    for (i = 0; i < skeleton->num_bones; i++) {
+        if (bone_selections[i] < 0)
+            continue;
+        for (p = 0; p < num_points; p++) {
+            if (mlod_lod->selections[bone_selections[i]].points[p] != 0)
+                odol_lod->point_bones_start[p + 1]++;
+        }
+    }
+
+    for (p = 0; p < num_points; p++)
+        odol_lod->point_bones_start[p + 1] += odol_lod->point_bones_start[p];
+
+    odol_lod->point_bones = (struct point_bone *)safe_malloc(sizeof(struct point_bone) *
+            MAX(odol_lod->point_bones_start[num_points], 1));
+
+    for (i = skeleton->num_bones - 1; (int32_t)i >= 0; i--) {
+        if (bone_selections[i] < 0)
+            continue;
+        for (p = 0; p < num_points; p++) {
+            if (mlod_lod->selections[bone_selections[i]].points[p] == 0)
+                continue;
+            odol_lod->point_bones[odol_lod->point_bones_start[p]].bone = i;
+            odol_lod->point_bones[odol_lod->point_bones_start[p]].weight = mlod_lod->selections[bone_selections[i]].points[p];
+            odol_lod->point_bones_start[p]++;
+        }
+    }
+
+    // filling in moved every start to the next point's start
+    for (p = num_points; p > 0; p--)
+        odol_lod->point_bones_start[p] = odol_lod->point_bones_start[p - 1];
+    odol_lod->point_bones_start[0] = 0;
+
+    free(bone_selections);
+}
+
+
+void optimize_face_order(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod) {
+    /*
+     * Reorders the faces within each section for the post-transform vertex
+     * cache, the sections themselves stay as they are. Vertices are added
+     * in order of first use afterwards, so the vertex buffer follows the new
+     * face order as well. Cache misses are counted on MLOD points, since
+     * the ODOL vertices don't exist yet.
+     */
+
+    uint32_t i;
+    uint32_t j;
+    uint32_t k;
+    uint32_t start;
+    uint32_t end;
+    uint32_t point;
+    uint32_t num_vertices;
+    uint32_t num_triangles;
+    uint32_t misses;
+    uint32_t misses_before;
+    uint32_t misses_after;
+    uint32_t misses_optimized;
+    uint32_t *local_points;
+    uint32_t *face_start;
+    uint32_t *indices;
+    uint32_t *order;
+    uint32_t *faces;
+    struct mlod_face *face;
+
+    local_points = (uint32_t *)safe_malloc(sizeof(uint32_t) * MAX(mlod_lod->num_points, 1));
+    face_start = (uint32_t *)safe_malloc(sizeof(uint32_t) * (odol_lod->num_faces + 1));
+    indices = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_faces * 4);
+    order = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_faces);
+    faces = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_faces);
+
+    for (i = 0; i < mlod_lod->num_points; i++)
+        local_points[i] = NOPOINT;
+
+    num_triangles = 0;
+    misses_before = 0;
+    misses_after = 0;
+
+    for (start = 0; start < odol_lod->num_faces; start = end) {
+        for (end = start + 1; end < odol_lod->num_faces; end++) {
+#ifdef _WIN32
+            if (compare_face_lookup((void *)mlod_lod->faces, &odol_lod->face_lookup[end], &odol_lod->face_lookup[start]))
+#else
+            if (compare_face_lookup(&odol_lod->face_lookup[end], &odol_lod->face_lookup[start], (void *)mlod_lod->faces))
+#endif
+                break;
+        }
+
+        // Number the points of the section from 0
+        num_vertices = 0;
+        k = 0;
+        for (i = start; i < end; i++) {
+            face = &mlod_lod->faces[odol_lod->face_lookup[i]];
+            face_start[i - start] = k;
+            for (j = 0; j < face->face_type; j++) {
+                point = face->table[j].points_index;
+                if (local_points[point] == NOPOINT)
+                    local_points[point] = num_vertices++;
+                indices[k++] = local_points[point];
+            }
+            num_triangles += face->face_type - 2;
+        }
+        face_start[end - start] = k;
+
+        misses = vertex_cache_misses(end - start, face_start, indices, num_vertices, NULL);
+        misses_before += misses;
+
+        vertex_cache_optimize(end - start, face_start, indices, num_vertices, order);
+
+        // Keep the original order if it was better already
+        misses_optimized = vertex_cache_misses(end - start, face_start, indices, num_vertices, order);
+        if (misses_optimized < misses) {
+            misses = misses_optimized;
+            for (i = 0; i < end - start; i++)
+                faces[i] = odol_lod->face_lookup[start + order[i]];
+            memcpy(&odol_lod->face_lookup[start], faces, sizeof(uint32_t) * (end - start));
+        }
+
+        misses_after += misses;
+
+        for (i = start; i < end; i++) {
+            face = &mlod_lod->faces[odol_lod->face_lookup[i]];
+            for (j = 0; j < face->face_type; j++)
+                local_points[face->table[j].points_index] = NOPOINT;
+        }
+    }
+
+    infof("%s: LOD %f: ACMR %.3f -> %.3f\n", current_target, mlod_lod->resolution,
+            (float)misses_before / MAX(num_triangles, 1), (float)misses_after / MAX(num_triangles, 1));
+
+    free(local_points);
+    free(face_start);
+    free(indices);
+    free(order);
+    free(faces);
+}
+
+
 void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
         struct model_info *model_info) {
-    extern char *current_target;
     unsigned long i;
     unsigned long j;
     unsigned long k;
@@ -678,7 +980,9 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     unsigned long face_end;
     size_t size;
     char *ptr;
-    char textures[MAXTEXTURES][512];
+    uint32_t textures[MAXTEXTURES];
+    uint32_t materials[MAXMATERIALS];
+    char **strings = mlod_lod->strings->strings;
     char *temp;
     bool *tileU;
     bool *tileV;
@@ -706,20 +1010,8 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     odol_lod->min_pos = empty_vector;
     odol_lod->max_pos = empty_vector;
 
-    for (i = 0; i < mlod_lod->num_points; i++) {
-        if (i == 0 || mlod_lod->points[i].x < odol_lod->min_pos.x)
-            odol_lod->min_pos.x = mlod_lod->points[i].x;
-        if (i == 0 || mlod_lod->points[i].y < odol_lod->min_pos.y)
-            odol_lod->min_pos.y = mlod_lod->points[i].y;
-        if (i == 0 || mlod_lod->points[i].z < odol_lod->min_pos.z)
-            odol_lod->min_pos.z = mlod_lod->points[i].z;
-        if (i == 0 || mlod_lod->points[i].x > odol_lod->max_pos.x)
-            odol_lod->max_pos.x = mlod_lod->points[i].x;
-        if (i == 0 || mlod_lod->points[i].y > odol_lod->max_pos.y)
-            odol_lod->max_pos.y = mlod_lod->points[i].y;
-        if (i == 0 || mlod_lod->points[i].z > odol_lod->max_pos.z)
-            odol_lod->max_pos.z = mlod_lod->points[i].z;
-    }
+    if (mlod_lod->positions.num_points > 0)
+        geometry_bounds(&mlod_lod->positions, &odol_lod->min_pos, &odol_lod->max_pos);
 
     odol_lod->autocenter_pos = vector_mult_scalar(0.5, vector_add(odol_lod->min_pos, odol_lod->max_pos));
 
@@ -729,13 +1021,12 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     odol_lod->num_textures = 0;
     odol_lod->num_materials = 0;
     odol_lod->materials = (struct material *)safe_malloc(sizeof(struct material) * MAXMATERIALS);
-    memset(textures, 0, sizeof(textures));
     memset(odol_lod->materials, 0, sizeof(struct material) * MAXMATERIALS);
 
     size = 0;
     for (i = 0; i < mlod_lod->num_faces; i++) {
         for (j = 0; j < odol_lod->num_textures; j++) {
-            if (strcmp(mlod_lod->faces[i].texture_name, textures[j]) == 0)
+            if (mlod_lod->faces[i].texture_name == textures[j])
                 break;
         }
 
@@ -747,29 +1038,30 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
         }
 
         if (j >= odol_lod->num_textures) {
-            strcpy(textures[j], mlod_lod->faces[i].texture_name);
-            size += strlen(textures[j]) + 1;
+            textures[j] = mlod_lod->faces[i].texture_name;
+            size += strlen(strings[textures[j]]) + 1;
             odol_lod->num_textures++;
         }
 
-        for (j = 0; j < MAXMATERIALS && odol_lod->materials[j].path[0] != 0; j++) {
-            if (strcmp(mlod_lod->faces[i].material_name, odol_lod->materials[j].path) == 0)
+        for (j = 0; j < MAXMATERIALS && j < odol_lod->num_materials; j++) {
+            if (mlod_lod->faces[i].material_name == materials[j])
                 break;
         }
 
-        mlod_lod->faces[i].material_index = (strlen(mlod_lod->faces[i].material_name) > 0) ? j : -1;
+        mlod_lod->faces[i].material_index = (mlod_lod->faces[i].material_name != 0) ? j : -1;
 
         if (j >= MAXMATERIALS) {
             lwarningf(current_target, -1, "Maximum amount of materials per LOD (%i) exceeded.", MAXMATERIALS);
             break;
         }
 
-        if (odol_lod->materials[j].path[0] != 0 || mlod_lod->faces[i].material_name[0] == 0)
+        if (j < odol_lod->num_materials || mlod_lod->faces[i].material_name == 0)
             continue;
 
         temp = current_target;
 
-        strcpy(odol_lod->materials[j].path, mlod_lod->faces[i].material_name);
+        materials[j] = mlod_lod->faces[i].material_name;
+        strncpy(odol_lod->materials[j].path, strings[materials[j]], sizeof(odol_lod->materials[j].path) - 1);
         odol_lod->num_materials++;
         read_material(&odol_lod->materials[j]);
 
@@ -779,8 +1071,8 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     odol_lod->textures = (char *)safe_malloc(size);
     ptr = odol_lod->textures;
     for (i = 0; i < odol_lod->num_textures; i++) {
-        strncpy(ptr, textures[i], strlen(textures[i]) + 1);
-        ptr += strlen(textures[i]) + 1;
+        strncpy(ptr, strings[textures[i]], strlen(strings[textures[i]]) + 1);
+        ptr += strlen(strings[textures[i]]) + 1;
     }
 
     odol_lod->num_faces = mlod_lod->num_faces;
@@ -794,21 +1086,29 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
 
     odol_lod->point_to_vertex = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_points_mlod);
     odol_lod->vertex_to_point = (uint32_t *)safe_malloc(sizeof(uint32_t) * (odol_lod->num_faces * 4 + odol_lod->num_points_mlod));
+    odol_lod->point_first_vertex = (uint32_t *)safe_malloc(sizeof(uint32_t) * odol_lod->num_points_mlod);
+    odol_lod->vertex_next = (uint32_t *)safe_malloc(sizeof(uint32_t) * (odol_lod->num_faces * 4 + odol_lod->num_points_mlod));
     odol_lod->face_lookup = (uint32_t *)safe_malloc(sizeof(uint32_t) * mlod_lod->num_faces);
 
     for (i = 0; i < mlod_lod->num_faces; i++)
         odol_lod->face_lookup[i] = i;
 
-    for (i = 0; i < odol_lod->num_points_mlod; i++)
+    for (i = 0; i < odol_lod->num_points_mlod; i++) {
         odol_lod->point_to_vertex[i] = NOPOINT;
+        odol_lod->point_first_vertex[i] = NOPOINT;
+    }
 
     odol_lod->uv_coords = (struct uv_pair *)safe_malloc(sizeof(struct uv_pair) * (odol_lod->num_faces * 4 + odol_lod->num_points_mlod));
     odol_lod->points = (struct triplet *)safe_malloc(sizeof(struct triplet) * (odol_lod->num_faces * 4 + odol_lod->num_points_mlod));
     odol_lod->normals = (struct triplet *)safe_malloc(sizeof(struct triplet) * (odol_lod->num_faces * 4 + odol_lod->num_points_mlod));
 
     odol_lod->vertexboneref = 0;
-    if (model_info->skeleton->num_bones > 0)
+    odol_lod->point_bones_start = NULL;
+    odol_lod->point_bones = NULL;
+    if (model_info->skeleton->num_bones > 0) {
         odol_lod->vertexboneref = (struct odol_vertexboneref *)safe_malloc(sizeof(struct odol_vertexboneref) * (odol_lod->num_faces * 4 + odol_lod->num_points_mlod));
+        build_point_bones(mlod_lod, odol_lod, model_info->skeleton);
+    }
 
     // Set face flags
     tileU = (bool *)safe_malloc(odol_lod->num_textures);
@@ -816,7 +1116,7 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     memset(tileU, 0, odol_lod->num_textures);
     memset(tileV, 0, odol_lod->num_textures);
     for (i = 0; i < mlod_lod->num_faces; i++) {
-        if (strlen(mlod_lod->faces[i].texture_name) == 0)
+        if (mlod_lod->faces[i].texture_name == 0)
             continue;
         if (tileU[mlod_lod->faces[i].texture_index] && tileV[mlod_lod->faces[i].texture_index])
             continue;
@@ -830,7 +1130,7 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
     for (i = 0; i < mlod_lod->num_faces; i++) {
         if (mlod_lod->faces[i].face_flags & (FLAG_NOCLAMP | FLAG_CLAMPU | FLAG_CLAMPV))
             continue;
-        if (strlen(mlod_lod->faces[i].texture_name) == 0) {
+        if (mlod_lod->faces[i].texture_name == 0) {
             mlod_lod->faces[i].face_flags |= FLAG_NOCLAMP;
             continue;
         }
@@ -842,26 +1142,15 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
         if (tileU[mlod_lod->faces[i].texture_index] && tileU[mlod_lod->faces[i].texture_index])
             mlod_lod->faces[i].face_flags |= FLAG_NOCLAMP;
 
-        if (is_alpha(&mlod_lod->faces[i]))
+        if (is_alpha(strings[mlod_lod->faces[i].texture_name]))
             mlod_lod->faces[i].face_flags |= FLAG_ISALPHA;
     }
     free(tileU);
     free(tileV);
 
-    for (i = 0; i < mlod_lod->num_selections; i++) {
-        for (j = 0; j < model_info->skeleton->num_sections; j++) {
-            if (strcmp(mlod_lod->selections[i].name, model_info->skeleton->sections[j]) == 0)
-                break;
-        }
-        if (j < model_info->skeleton->num_sections) {
-            for (k = 0; k < mlod_lod->num_faces; k++) {
-                if (mlod_lod->selections[i].faces[k] > 0) {
-                    strcat(mlod_lod->faces[k].section_names, ":");
-                    strcat(mlod_lod->faces[k].section_names, mlod_lod->selections[i].name);
-                }
-            }
-        }
+    set_section_names(mlod_lod, model_info->skeleton);
 
+    for (i = 0; i < mlod_lod->num_selections; i++) {
         if (strncmp(mlod_lod->selections[i].name, "proxy:", 6) != 0)
             continue;
 
@@ -883,6 +1172,9 @@ void convert_lod(struct mlod_lod *mlod_lod, struct odol_lod *odol_lod,
 #endif
     }
 
+    if (args.optimizemeshes && odol_lod->num_faces > 0)
+        optimize_face_order(mlod_lod, odol_lod);
+
     // Write face vertices
     face_end = 0;
     memset(odol_lod->uv_scale, 0, sizeof(struct uv_pair) * 2);
@@ -1264,94 +1556,94 @@ void write_model_info(FILE *f_target, uint32_t num_lods, struct model_info *mode
 }
 
 
-void write_odol_section(FILE *f_target, struct odol_section *odol_section) {
-    fwrite(&odol_section->face_index_start,     sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_section->face_index_end,       sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_section->min_bone_index,       sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_section->bones_count,          sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_section->mat_dummy,            sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_section->common_texture_index, sizeof(uint16_t), 1, f_target);
-    fwrite(&odol_section->common_face_flags,    sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_section->material_index,       sizeof(int32_t), 1, f_target);
+void write_odol_section(struct buffer *target, struct odol_section *odol_section) {
+    buffer_append(target, &odol_section->face_index_start, sizeof(uint32_t));
+    buffer_append(target, &odol_section->face_index_end, sizeof(uint32_t));
+    buffer_append(target, &odol_section->min_bone_index, sizeof(uint32_t));
+    buffer_append(target, &odol_section->bones_count, sizeof(uint32_t));
+    buffer_append(target, &odol_section->mat_dummy, sizeof(uint32_t));
+    buffer_append(target, &odol_section->common_texture_index, sizeof(uint16_t));
+    buffer_append(target, &odol_section->common_face_flags, sizeof(uint32_t));
+    buffer_append(target, &odol_section->material_index, sizeof(int32_t));
     if (odol_section->material_index == -1)
-        fputc(0, f_target);
-    fwrite(&odol_section->num_stages,           sizeof(uint32_t), 1, f_target);
-    fwrite(odol_section->area_over_tex,         sizeof(float), odol_section->num_stages, f_target);
-    fwrite(&odol_section->unknown_long,         sizeof(uint32_t), 1, f_target);
+        buffer_append_byte(target, 0);
+    buffer_append(target, &odol_section->num_stages, sizeof(uint32_t));
+    buffer_append(target, odol_section->area_over_tex, sizeof(float) * odol_section->num_stages);
+    buffer_append(target, &odol_section->unknown_long, sizeof(uint32_t));
 }
 
 
-void write_odol_selection(FILE *f_target, struct odol_selection *odol_selection) {
-    fwrite(odol_selection->name, strlen(odol_selection->name) + 1, 1, f_target);
+void write_odol_selection(struct buffer *target, struct odol_selection *odol_selection) {
+    buffer_append(target, odol_selection->name, strlen(odol_selection->name) + 1);
 
-    fwrite(&odol_selection->num_faces, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_selection->num_faces, sizeof(uint32_t));
     if (odol_selection->num_faces > 0) {
-        fputc(0, f_target);
-        fwrite(odol_selection->faces, sizeof(uint32_t) * odol_selection->num_faces, 1, f_target);
+        buffer_append_byte(target, 0);
+        buffer_append(target, odol_selection->faces, sizeof(uint32_t) * odol_selection->num_faces);
     }
 
-    fwrite(&odol_selection->always_0, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_selection->always_0, sizeof(uint32_t));
 
-    fwrite(&odol_selection->is_sectional, 1, 1, f_target);
-    fwrite(&odol_selection->num_sections, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_selection->is_sectional, 1);
+    buffer_append(target, &odol_selection->num_sections, sizeof(uint32_t));
     if (odol_selection->num_sections > 0) {
-        fputc(0, f_target);
-        fwrite(odol_selection->sections, sizeof(uint32_t) * odol_selection->num_sections, 1, f_target);
+        buffer_append_byte(target, 0);
+        buffer_append(target, odol_selection->sections, sizeof(uint32_t) * odol_selection->num_sections);
     }
 
-    fwrite(&odol_selection->num_vertices, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_selection->num_vertices, sizeof(uint32_t));
     if (odol_selection->num_vertices > 0) {
-        fputc(0, f_target);
-        fwrite(odol_selection->vertices, sizeof(uint32_t) * odol_selection->num_vertices, 1, f_target);
+        buffer_append_byte(target, 0);
+        buffer_append(target, odol_selection->vertices, sizeof(uint32_t) * odol_selection->num_vertices);
     }
 
-    fwrite(&odol_selection->num_vertex_weights, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_selection->num_vertex_weights, sizeof(uint32_t));
     if (odol_selection->num_vertex_weights > 0) {
-        fputc(0, f_target);
-        fwrite(odol_selection->vertex_weights, sizeof(uint8_t) * odol_selection->num_vertex_weights, 1, f_target);
+        buffer_append_byte(target, 0);
+        buffer_append(target, odol_selection->vertex_weights, sizeof(uint8_t) * odol_selection->num_vertex_weights);
     }
 }
 
 
-void write_material(FILE *f_target, struct material *material) {
+void write_material(struct buffer *target, struct material *material) {
     int i;
 
-    fwrite( material->path, strlen(material->path) + 1, 1, f_target);
-    fwrite(&material->type, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->emissive, sizeof(struct color), 1, f_target);
-    fwrite(&material->ambient, sizeof(struct color), 1, f_target);
-    fwrite(&material->diffuse, sizeof(struct color), 1, f_target);
-    fwrite(&material->forced_diffuse, sizeof(struct color), 1, f_target);
-    fwrite(&material->specular, sizeof(struct color), 1, f_target);
-    fwrite(&material->specular2, sizeof(struct color), 1, f_target);
-    fwrite(&material->specular_power, sizeof(float), 1, f_target);
-    fwrite(&material->pixelshader_id, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->vertexshader_id, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->depr_1, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->depr_2, sizeof(uint32_t), 1, f_target);
-    fwrite( material->surface, strlen(material->surface) + 1, 1, f_target);
-    fwrite(&material->depr_3, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->render_flags, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->num_textures, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->num_transforms, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, material->path, strlen(material->path) + 1);
+    buffer_append(target, &material->type, sizeof(uint32_t));
+    buffer_append(target, &material->emissive, sizeof(struct color));
+    buffer_append(target, &material->ambient, sizeof(struct color));
+    buffer_append(target, &material->diffuse, sizeof(struct color));
+    buffer_append(target, &material->forced_diffuse, sizeof(struct color));
+    buffer_append(target, &material->specular, sizeof(struct color));
+    buffer_append(target, &material->specular2, sizeof(struct color));
+    buffer_append(target, &material->specular_power, sizeof(float));
+    buffer_append(target, &material->pixelshader_id, sizeof(uint32_t));
+    buffer_append(target, &material->vertexshader_id, sizeof(uint32_t));
+    buffer_append(target, &material->depr_1, sizeof(uint32_t));
+    buffer_append(target, &material->depr_2, sizeof(uint32_t));
+    buffer_append(target, material->surface, strlen(material->surface) + 1);
+    buffer_append(target, &material->depr_3, sizeof(uint32_t));
+    buffer_append(target, &material->render_flags, sizeof(uint32_t));
+    buffer_append(target, &material->num_textures, sizeof(uint32_t));
+    buffer_append(target, &material->num_transforms, sizeof(uint32_t));
 
     for (i = 0; i < material->num_textures; i++) {
-        fwrite(&material->textures[i].texture_filter, sizeof(uint32_t), 1, f_target);
-        fwrite( material->textures[i].path, strlen(material->textures[i].path) + 1, 1, f_target);
-        fwrite(&material->textures[i].transform_index, sizeof(uint32_t), 1, f_target);
-        fwrite(&material->dummy_texture.type11_bool, sizeof(bool), 1, f_target);
+        buffer_append(target, &material->textures[i].texture_filter, sizeof(uint32_t));
+        buffer_append(target, material->textures[i].path, strlen(material->textures[i].path) + 1);
+        buffer_append(target, &material->textures[i].transform_index, sizeof(uint32_t));
+        buffer_append(target, &material->dummy_texture.type11_bool, sizeof(bool));
     }
 
-    fwrite( material->transforms, sizeof(struct stage_transform), material->num_transforms, f_target);
+    buffer_append(target, material->transforms, sizeof(struct stage_transform) * material->num_transforms);
 
-    fwrite(&material->dummy_texture.texture_filter, sizeof(uint32_t), 1, f_target);
-    fwrite( material->dummy_texture.path, strlen(material->dummy_texture.path) + 1, 1, f_target);
-    fwrite(&material->dummy_texture.transform_index, sizeof(uint32_t), 1, f_target);
-    fwrite(&material->dummy_texture.type11_bool, sizeof(bool), 1, f_target);
+    buffer_append(target, &material->dummy_texture.texture_filter, sizeof(uint32_t));
+    buffer_append(target, material->dummy_texture.path, strlen(material->dummy_texture.path) + 1);
+    buffer_append(target, &material->dummy_texture.transform_index, sizeof(uint32_t));
+    buffer_append(target, &material->dummy_texture.type11_bool, sizeof(bool));
 }
 
 
-void write_odol_lod(FILE *f_target, struct odol_lod *odol_lod) {
+void write_odol_lod(struct buffer *target, struct odol_lod *odol_lod) {
     short u, v;
     int x, y, z;
     long i;
@@ -1361,97 +1653,97 @@ void write_odol_lod(FILE *f_target, struct odol_lod *odol_lod) {
     float u_relative;
     float v_relative;
 
-    fwrite(&odol_lod->num_proxies, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_proxies, sizeof(uint32_t));
     for (i = 0; i < odol_lod->num_proxies; i++) {
-        fwrite( odol_lod->proxies[i].name, strlen(odol_lod->proxies[i].name) + 1, 1, f_target);
-        fwrite(&odol_lod->proxies[i].transform_x, sizeof(struct triplet), 1, f_target);
-        fwrite(&odol_lod->proxies[i].transform_y, sizeof(struct triplet), 1, f_target);
-        fwrite(&odol_lod->proxies[i].transform_z, sizeof(struct triplet), 1, f_target);
-        fwrite(&odol_lod->proxies[i].transform_n, sizeof(struct triplet), 1, f_target);
-        fwrite(&odol_lod->proxies[i].proxy_id, sizeof(uint32_t), 1, f_target);
-        fwrite(&odol_lod->proxies[i].selection_index, sizeof(uint32_t), 1, f_target);
-        fwrite(&odol_lod->proxies[i].bone_index, sizeof(int32_t), 1, f_target);
-        fwrite(&odol_lod->proxies[i].section_index, sizeof(uint32_t), 1, f_target);
+        buffer_append(target, odol_lod->proxies[i].name, strlen(odol_lod->proxies[i].name) + 1);
+        buffer_append(target, &odol_lod->proxies[i].transform_x, sizeof(struct triplet));
+        buffer_append(target, &odol_lod->proxies[i].transform_y, sizeof(struct triplet));
+        buffer_append(target, &odol_lod->proxies[i].transform_z, sizeof(struct triplet));
+        buffer_append(target, &odol_lod->proxies[i].transform_n, sizeof(struct triplet));
+        buffer_append(target, &odol_lod->proxies[i].proxy_id, sizeof(uint32_t));
+        buffer_append(target, &odol_lod->proxies[i].selection_index, sizeof(uint32_t));
+        buffer_append(target, &odol_lod->proxies[i].bone_index, sizeof(int32_t));
+        buffer_append(target, &odol_lod->proxies[i].section_index, sizeof(uint32_t));
     }
 
-    fwrite(&odol_lod->num_bones_subskeleton, sizeof(uint32_t), 1, f_target);
-    fwrite( odol_lod->subskeleton_to_skeleton, sizeof(uint32_t) * odol_lod->num_bones_subskeleton, 1, f_target);
+    buffer_append(target, &odol_lod->num_bones_subskeleton, sizeof(uint32_t));
+    buffer_append(target, odol_lod->subskeleton_to_skeleton, sizeof(uint32_t) * odol_lod->num_bones_subskeleton);
 
-    fwrite(&odol_lod->num_bones_skeleton, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_bones_skeleton, sizeof(uint32_t));
     for (i = 0; i < odol_lod->num_bones_skeleton; i++) {
-        fwrite(&odol_lod->skeleton_to_subskeleton[i].num_links, sizeof(uint32_t), 1, f_target);
-        fwrite( odol_lod->skeleton_to_subskeleton[i].links, sizeof(uint32_t) * odol_lod->skeleton_to_subskeleton[i].num_links, 1, f_target);
+        buffer_append(target, &odol_lod->skeleton_to_subskeleton[i].num_links, sizeof(uint32_t));
+        buffer_append(target, odol_lod->skeleton_to_subskeleton[i].links, sizeof(uint32_t) * odol_lod->skeleton_to_subskeleton[i].num_links);
     }
 
-    fwrite(&odol_lod->num_points, sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_lod->face_area, sizeof(float), 1, f_target);
-    fwrite( odol_lod->clip_flags, sizeof(uint32_t), 2, f_target);
-    fwrite(&odol_lod->min_pos, sizeof(struct triplet), 1, f_target);
-    fwrite(&odol_lod->max_pos, sizeof(struct triplet), 1, f_target);
-    fwrite(&odol_lod->autocenter_pos, sizeof(struct triplet), 1, f_target);
-    fwrite(&odol_lod->sphere, sizeof(float), 1, f_target);
+    buffer_append(target, &odol_lod->num_points, sizeof(uint32_t));
+    buffer_append(target, &odol_lod->face_area, sizeof(float));
+    buffer_append(target, odol_lod->clip_flags, sizeof(uint32_t) * 2);
+    buffer_append(target, &odol_lod->min_pos, sizeof(struct triplet));
+    buffer_append(target, &odol_lod->max_pos, sizeof(struct triplet));
+    buffer_append(target, &odol_lod->autocenter_pos, sizeof(struct triplet));
+    buffer_append(target, &odol_lod->sphere, sizeof(float));
 
-    fwrite(&odol_lod->num_textures, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_textures, sizeof(uint32_t));
     ptr = odol_lod->textures;
     for (i = 0; i < odol_lod->num_textures; i++)
         ptr += strlen(ptr) + 1;
-    fwrite( odol_lod->textures, ptr - odol_lod->textures, 1, f_target);
+    buffer_append(target, odol_lod->textures, ptr - odol_lod->textures);
 
-    fwrite(&odol_lod->num_materials, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_materials, sizeof(uint32_t));
     for (i = 0; i < odol_lod->num_materials; i++)
-        write_material(f_target, &odol_lod->materials[i]);
+        write_material(target, &odol_lod->materials[i]);
 
     // the point-to-vertex and vertex-to-point arrays are just left out
-    fwrite("\0\0\0\0\0\0\0\0", sizeof(uint32_t) * 2, 1, f_target);
+    buffer_append(target, "\0\0\0\0\0\0\0\0", sizeof(uint32_t) * 2);
 
-    fwrite(&odol_lod->num_faces, sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_lod->face_allocation_size, sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_lod->always_0, sizeof(uint16_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_faces, sizeof(uint32_t));
+    buffer_append(target, &odol_lod->face_allocation_size, sizeof(uint32_t));
+    buffer_append(target, &odol_lod->always_0, sizeof(uint16_t));
 
     for (i = 0; i < odol_lod->num_faces; i++) {
-        fwrite(&odol_lod->faces[i].face_type, sizeof(uint8_t), 1, f_target);
-        fwrite( odol_lod->faces[i].table, sizeof(uint32_t) * odol_lod->faces[i].face_type, 1, f_target);
+        buffer_append(target, &odol_lod->faces[i].face_type, sizeof(uint8_t));
+        buffer_append(target, odol_lod->faces[i].table, sizeof(uint32_t) * odol_lod->faces[i].face_type);
     }
 
-    fwrite(&odol_lod->num_sections, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_sections, sizeof(uint32_t));
     for (i = 0; i < odol_lod->num_sections; i++) {
-        write_odol_section(f_target, &odol_lod->sections[i]);
+        write_odol_section(target, &odol_lod->sections[i]);
     }
 
-    fwrite(&odol_lod->num_selections, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_selections, sizeof(uint32_t));
     for (i = 0; i < odol_lod->num_selections; i++) {
-        write_odol_selection(f_target, &odol_lod->selections[i]);
+        write_odol_selection(target, &odol_lod->selections[i]);
     }
 
-    fwrite(&odol_lod->num_properties, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_properties, sizeof(uint32_t));
     for (i = 0; i < odol_lod->num_properties; i++) {
-        fwrite(odol_lod->properties[i].name, strlen(odol_lod->properties[i].name) + 1, 1, f_target);
-        fwrite(odol_lod->properties[i].value, strlen(odol_lod->properties[i].value) + 1, 1, f_target);
+        buffer_append(target, odol_lod->properties[i].name, strlen(odol_lod->properties[i].name) + 1);
+        buffer_append(target, odol_lod->properties[i].value, strlen(odol_lod->properties[i].value) + 1);
     }
 
-    fwrite(&odol_lod->num_frames, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_frames, sizeof(uint32_t));
     // @todo frames
 
-    fwrite(&odol_lod->icon_color, sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_lod->selected_color, sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_lod->flags, sizeof(uint32_t), 1, f_target);
-    fwrite(&odol_lod->vertexboneref_is_simple, sizeof(bool), 1, f_target);
+    buffer_append(target, &odol_lod->icon_color, sizeof(uint32_t));
+    buffer_append(target, &odol_lod->selected_color, sizeof(uint32_t));
+    buffer_append(target, &odol_lod->flags, sizeof(uint32_t));
+    buffer_append(target, &odol_lod->vertexboneref_is_simple, sizeof(bool));
 
-    fp_vertextable_size = ftell(f_target);
-    fwrite("\0\0\0\0", 4, 1, f_target);
+    fp_vertextable_size = target->length;
+    buffer_append(target, "\0\0\0\0", 4);
 
     // pointflags
-    fwrite(&odol_lod->num_points, 4, 1, f_target);
-    fputc(1, f_target);
+    buffer_append(target, &odol_lod->num_points, 4);
+    buffer_append_byte(target, 1);
     if (odol_lod->num_points > 0)
-        fwrite("\0\0\0\0", 4, 1, f_target);
+        buffer_append(target, "\0\0\0\0", 4);
 
     // uvs
-    fwrite( odol_lod->uv_scale, sizeof(struct uv_pair) * 2, 1, f_target);
-    fwrite(&odol_lod->num_points, sizeof(uint32_t), 1, f_target);
-    fputc(0, f_target);
+    buffer_append(target, odol_lod->uv_scale, sizeof(struct uv_pair) * 2);
+    buffer_append(target, &odol_lod->num_points, sizeof(uint32_t));
+    buffer_append_byte(target, 0);
     if (odol_lod->num_points > 0) {
-        fputc(0, f_target);
+        buffer_append_byte(target, 0);
         for (i = 0; i < odol_lod->num_points; i++) {
             // write compressed pair
             u_relative = (odol_lod->uv_coords[i].u - odol_lod->uv_scale[0].u) / (odol_lod->uv_scale[1].u - odol_lod->uv_scale[0].u);
@@ -1459,24 +1751,24 @@ void write_odol_lod(FILE *f_target, struct odol_lod *odol_lod) {
             u = (short)(u_relative * 2 * INT16_MAX - INT16_MAX);
             v = (short)(v_relative * 2 * INT16_MAX - INT16_MAX);
 
-            fwrite(&u, sizeof(int16_t), 1, f_target);
-            fwrite(&v, sizeof(int16_t), 1, f_target);
+            buffer_append(target, &u, sizeof(int16_t));
+            buffer_append(target, &v, sizeof(int16_t));
         }
     }
-    fwrite("\x01\0\0\0", 4, 1, f_target);
+    buffer_append(target, "\x01\0\0\0", 4);
 
     // points
-    fwrite(&odol_lod->num_points, sizeof(uint32_t), 1, f_target);
+    buffer_append(target, &odol_lod->num_points, sizeof(uint32_t));
     if (odol_lod->num_points > 0) {
-        fputc(0, f_target);
-        fwrite( odol_lod->points, sizeof(struct triplet) * odol_lod->num_points, 1, f_target);
+        buffer_append_byte(target, 0);
+        buffer_append(target, odol_lod->points, sizeof(struct triplet) * odol_lod->num_points);
     }
 
     // normals
-    fwrite(&odol_lod->num_points, sizeof(uint32_t), 1, f_target);
-    fputc(0, f_target);
+    buffer_append(target, &odol_lod->num_points, sizeof(uint32_t));
+    buffer_append_byte(target, 0);
     if (odol_lod->num_points > 0) {
-        fputc(0, f_target);
+        buffer_append_byte(target, 0);
         for (i = 0; i < odol_lod->num_points; i++) {
             // write compressed triplet
             x = (int)(-511.0f * odol_lod->normals[i].x + 0.5);
@@ -1488,35 +1780,33 @@ void write_odol_lod(FILE *f_target, struct odol_lod *odol_lod) {
             z = MAX(MIN(z, 511), -511);
 
             temp = (((uint32_t)z & 0x3FF) << 20) | (((uint32_t)y & 0x3FF) << 10) | ((uint32_t)x & 0x3FF);
-            fwrite(&temp, sizeof(uint32_t), 1, f_target);
+            buffer_append(target, &temp, sizeof(uint32_t));
         }
     }
 
     // ST coordinates
-    fwrite("\0\0\0\0", 4, 1, f_target);
+    buffer_append(target, "\0\0\0\0", 4);
 
     // vertex bone ref
     if (odol_lod->vertexboneref == 0 || odol_lod->num_points == 0) {
-        fwrite("\0\0\0\0", 4, 1, f_target);
+        buffer_append(target, "\0\0\0\0", 4);
     } else {
-        fwrite(&odol_lod->num_points, sizeof(uint32_t), 1, f_target);
-        fputc(0, f_target);
-        fwrite(odol_lod->vertexboneref, sizeof(struct odol_vertexboneref), odol_lod->num_points, f_target);
+        buffer_append(target, &odol_lod->num_points, sizeof(uint32_t));
+        buffer_append_byte(target, 0);
+        buffer_append(target, odol_lod->vertexboneref, sizeof(struct odol_vertexboneref) * odol_lod->num_points);
     }
 
     // neighbor bone ref
-    fwrite("\0\0\0\0", 4, 1, f_target);
+    buffer_append(target, "\0\0\0\0", 4);
 
     // has Collimator info?
-    fwrite("\0\0\0\0", sizeof(uint32_t), 1, f_target); //If 1 then need to write CollimatorInfo structure
+    buffer_append(target, "\0\0\0\0", sizeof(uint32_t)); //If 1 then need to write CollimatorInfo structure
 
     // unknown byte
-    fwrite("\0", 1, 1, f_target);
+    buffer_append(target, "\0", 1);
 
-    temp = ftell(f_target) - fp_vertextable_size;
-    fseek(f_target, fp_vertextable_size, SEEK_SET);
-    fwrite(&temp, 4, 1, f_target);
-    fseek(f_target, 0, SEEK_END);
+    temp = target->length - fp_vertextable_size;
+    memcpy(target->data + fp_vertextable_size, &temp, 4);
 }
 
 
@@ -1691,7 +1981,7 @@ void write_animations(FILE *f_target, uint32_t num_lods, struct mlod_lod *mlod_l
             if (index == -1) {
                 if (i == 0) { // we only report errors for the first LOD
                     lnwarningf(current_target, -1, "unknown-bone", "Failed to find bone \"%s\" for animation \"%s\".\n",
-                            model_info->skeleton->bones[k].name, anim->name);
+                            anim->selection, anim->name);
                 }
                 continue;
             }
@@ -1711,23 +2001,84 @@ void write_animations(FILE *f_target, uint32_t num_lods, struct mlod_lod *mlod_l
 }
 
 
-int mlod2odol(char *source, char *target) {
+void free_odol_lod(struct odol_lod *odol_lod) {
+    uint32_t i;
+
+    free(odol_lod->proxies);
+    free(odol_lod->subskeleton_to_skeleton);
+    free(odol_lod->skeleton_to_subskeleton);
+    free(odol_lod->textures);
+    free(odol_lod->point_to_vertex);
+    free(odol_lod->vertex_to_point);
+    free(odol_lod->point_first_vertex);
+    free(odol_lod->vertex_next);
+    free(odol_lod->face_lookup);
+    free(odol_lod->faces);
+    free(odol_lod->uv_coords);
+    free(odol_lod->points);
+    free(odol_lod->normals);
+    free(odol_lod->sections);
+    free(odol_lod->vertexboneref);
+    free(odol_lod->point_bones_start);
+    free(odol_lod->point_bones);
+
+    for (i = 0; i < odol_lod->num_materials; i++) {
+        free(odol_lod->materials[i].textures);
+        free(odol_lod->materials[i].transforms);
+    }
+
+    free(odol_lod->materials);
+
+    for (i = 0; i < odol_lod->num_selections; i++) {
+        free(odol_lod->selections[i].faces);
+        free(odol_lod->selections[i].sections);
+        free(odol_lod->selections[i].vertices);
+        free(odol_lod->selections[i].vertex_weights);
+    }
+
+    free(odol_lod->selections);
+}
+
+
+int convert_lod_job(int index, void *jobs_ptr) {
     /*
-     * Converts the MLOD P3D to ODOL. Overwrites the target if it already
-     * exists.
+     * Converts a single LOD and writes it to the job's buffer. LODs only
+     * share the read-only model info, so they can be converted in parallel.
+     * Conversion can't fail, so this always returns 0.
+     */
+
+    struct odol_lod_jobs *jobs = (struct odol_lod_jobs *)jobs_ptr;
+    struct odol_lod odol_lod;
+
+    current_target = jobs->source;
+    cache_start_recording(jobs->recording);
+
+    convert_lod(&jobs->mlod_lods[index], &odol_lod, jobs->model_info);
+
+    buffer_init(&jobs->buffers[index], 65536);
+    write_odol_lod(&jobs->buffers[index], &odol_lod);
+
+    free_odol_lod(&odol_lod);
+
+    return 0;
+}
+
+
+int mlod2odol(char *source, char *target, int num_threads) {
+    /*
+     * Converts the MLOD P3D to ODOL, converting the LODs on up to
+     * num_threads threads. Overwrites the target if it already exists.
      *
      * Returns 0 on success and a positive integer on failure.
      */
 
     extern struct arguments args;
-    extern char *current_target;
     FILE *f_source;
     FILE *f_temp;
     FILE *f_target;
     char buffer[4096];
     int datasize;
     int i;
-    int j;
     int success;
     long fp_lods;
     long fp_temp;
@@ -1735,7 +2086,7 @@ int mlod2odol(char *source, char *target) {
     uint32_t num_lods;
     struct mlod_lod *mlod_lods;
     struct model_info model_info;
-    struct odol_lod odol_lod;
+    struct string_table strings;
 
     current_target = source;
 
@@ -1784,10 +2135,12 @@ int mlod2odol(char *source, char *target) {
     fseek(f_source, 8, SEEK_SET);
     fread(&num_lods, 4, 1, f_source);
     mlod_lods = (struct mlod_lod *)safe_malloc(sizeof(struct mlod_lod) * num_lods);
-    num_lods = read_lods(f_source, mlod_lods, num_lods);
-    if (num_lods < 0) {
+    string_table_init(&strings);
+    success = read_lods(f_source, mlod_lods, num_lods, &strings);
+    if (success < 0) {
         errorf("Failed to read LODs.\n");
         free(mlod_lods);
+        string_table_free(&strings);
         fclose(f_temp);
         fclose(f_source);
 #ifdef _WIN32
@@ -1797,6 +2150,7 @@ int mlod2odol(char *source, char *target) {
     }
 
     fclose(f_source);
+    num_lods = success;
 
     // Write header
     fwrite("ODOL", 4, 1, f_temp);
@@ -1839,6 +2193,19 @@ int mlod2odol(char *source, char *target) {
     for (i = 0; i < num_lods; i++)
         fputc(1, f_temp);
 
+    // Convert LODs, every LOD is written to its own buffer
+    struct odol_lod_jobs jobs;
+
+    jobs.mlod_lods = mlod_lods;
+    jobs.model_info = &model_info;
+    jobs.buffers = (struct buffer *)safe_malloc(sizeof(struct buffer) * num_lods);
+    jobs.source = source;
+    jobs.recording = cache_get_recording();
+
+    run_parallel(num_lods, num_threads, convert_lod_job, &jobs, NULL);
+
+    current_target = source;
+
     // Write LODs
     for (i = 0; i < num_lods; i++) {
         // Write start address
@@ -1847,42 +2214,8 @@ int mlod2odol(char *source, char *target) {
         fwrite(&fp_temp, 4, 1, f_temp);
         fseek(f_temp, 0, SEEK_END);
 
-        // Convert to ODOL
-        convert_lod(&mlod_lods[i], &odol_lod, &model_info);
-
-        // Write to file
-        write_odol_lod(f_temp, &odol_lod);
-
-        // Clean up
-        free(odol_lod.proxies);
-        free(odol_lod.subskeleton_to_skeleton);
-        free(odol_lod.skeleton_to_subskeleton);
-        free(odol_lod.textures);
-        free(odol_lod.point_to_vertex);
-        free(odol_lod.vertex_to_point);
-        free(odol_lod.face_lookup);
-        free(odol_lod.faces);
-        free(odol_lod.uv_coords);
-        free(odol_lod.points);
-        free(odol_lod.normals);
-        free(odol_lod.sections);
-        free(odol_lod.vertexboneref);
-
-        for (j = 0; j < odol_lod.num_materials; j++) {
-            free(odol_lod.materials[j].textures);
-            free(odol_lod.materials[j].transforms);
-        }
-
-        free(odol_lod.materials);
-
-        for (j = 0; j < odol_lod.num_selections; j++) {
-            free(odol_lod.selections[j].faces);
-            free(odol_lod.selections[j].sections);
-            free(odol_lod.selections[j].vertices);
-            free(odol_lod.selections[j].vertex_weights);
-        }
-
-        free(odol_lod.selections);
+        fwrite(jobs.buffers[i].data, jobs.buffers[i].length, 1, f_temp);
+        buffer_free(&jobs.buffers[i]);
 
         // Write end address
         fp_temp = ftell(f_temp);
@@ -1891,6 +2224,8 @@ int mlod2odol(char *source, char *target) {
         fseek(f_temp, 0, SEEK_END);
     }
 
+    free(jobs.buffers);
+
     // Write PhysX (@todo)
     fwrite("\x00\x03\x03\x03\x00\x00\x00\x00", 8, 1, f_temp);
     fwrite("\x00\x03\x03\x03\x00\x00\x00\x00", 8, 1, f_temp);
@@ -1928,23 +2263,13 @@ int mlod2odol(char *source, char *target) {
     DeleteFile(temp_name);
 #endif
 
-    for (i = 0; i < num_lods; i++) {
-        free(mlod_lods[i].points);
-        free(mlod_lods[i].facenormals);
-        free(mlod_lods[i].faces);
-        free(mlod_lods[i].mass);
-        free(mlod_lods[i].sharp_edges);
-
-        for (j = 0; j < mlod_lods[i].num_selections; j++) {
-            free(mlod_lods[i].selections[j].points);
-            free(mlod_lods[i].selections[j].faces);
-        }
-
-        free(mlod_lods[i].selections);
-    }
+    for (i = 0; i < num_lods; i++)
+        free_mlod_lod(&mlod_lods[i]);
     free(mlod_lods);
+    string_table_free(&strings);
 
     free(model_info.lod_resolutions);
+    skeleton_free(model_info.skeleton);
     free(model_info.skeleton);
 
     return 0;
@@ -24,6 +24,7 @@
 #define MAXTEXTURES 128
 #define MAXMATERIALS 128
 #define MAXPROPERTIES 128
+#define SELECTIONINTERVAL 32
 
 #define LOD_GRAPHICAL_START                              0.0f
 #define LOD_GRAPHICAL_END                              999.9f
@@ -82,6 +83,7 @@
 //#include "utils.h"
 #include "model_config.h"
 #include "matrix.h"
+#include "geometry.h"
 
 
 struct uv_pair {
@@ -105,11 +107,11 @@ struct mlod_face {
     uint32_t face_type;
     struct pseudovertextable table[4];
     uint32_t face_flags;
-    char texture_name[512];
+    uint32_t texture_name;
     int texture_index;
-    char material_name[512];
+    uint32_t material_name;
     int material_index;
-    char section_names[512];
+    uint32_t section_names;
 };
 
 struct mlod_selection {
@@ -124,6 +126,7 @@ struct mlod_lod {
     uint32_t num_faces;
     uint32_t num_sharp_edges;
     struct point *points;
+    struct point_soa positions;
     struct triplet *facenormals;
     struct mlod_face *faces;
     float *mass;
@@ -132,6 +135,13 @@ struct mlod_lod {
     float resolution;
     uint32_t num_selections;
     struct mlod_selection *selections;
+    struct string_table *strings;
+};
+
+struct mlod_cursor {
+    char *data;
+    size_t size;
+    size_t pos;
 };
 
 struct odol_face {
@@ -194,6 +204,11 @@ struct odol_vertexboneref {
     uint8_t weights[4][2];
 };
 
+struct point_bone {
+    uint32_t bone;
+    uint8_t weight;
+};
+
 struct odol_lod {
     uint32_t num_proxies;
     struct odol_proxy *proxies;
@@ -215,6 +230,8 @@ struct odol_lod {
     struct material *materials;
     uint32_t *point_to_vertex;
     uint32_t *vertex_to_point;
+    uint32_t *point_first_vertex;
+    uint32_t *vertex_next;
     uint32_t *face_lookup;
     uint32_t num_faces;
     uint32_t face_allocation_size;
@@ -237,6 +254,16 @@ struct odol_lod {
     struct triplet *points;
     struct triplet *normals;
     struct odol_vertexboneref *vertexboneref;
+    uint32_t *point_bones_start;
+    struct point_bone *point_bones;
+};
+
+struct odol_lod_jobs {
+    struct mlod_lod *mlod_lods;
+    struct model_info *model_info;
+    struct buffer *buffers;
+    char *source;
+    struct cache_entry *recording;
 };
 
 struct lod_indices {
@@ -302,6 +329,8 @@ struct model_info {
     uint32_t always_0;
 };
 
-int read_lods(FILE *f_source, struct mlod_lod *mlod_lods, uint32_t num_lods);
+void free_mlod_lod(struct mlod_lod *mlod_lod);
+
+int read_lods(FILE *f_source, struct mlod_lod *mlod_lods, uint32_t num_lods, struct string_table *strings);
 
-int mlod2odol(char *source, char *target);
+int mlod2odol(char *source, char *target, int num_threads);
@@ -38,6 +38,7 @@
 
 #include "args.h"
 #include "utils.h"
+#include "batch.h"
 #include "paa2img.h"
 
 
@@ -401,12 +402,27 @@ int paa2img(char *source, char *target) {
 }
 
 
+static int convert_paa(char *source, char *target, int num_threads) {
+    /*
+     * Batch conversion callback for paa2img, which always runs on a single
+     * thread.
+     */
+
+    return paa2img(source, target);
+}
+
+
 int cmd_paa2img() {
     extern struct arguments args;
 
+    char *extensions[] = { "paa", "pac", NULL };
+
     if (args.num_positionals != 3)
         return 128;
 
+    if (args.recursive)
+        return convert_directory(args.positionals[1], args.positionals[2], extensions, "png", convert_paa);
+
     // check if target already exists
     if (access(args.positionals[2], F_OK) != -1 && !args.force) {
         errorf("File %s already exists and --force was not set.\n", args.positionals[2]);
@@ -30,12 +30,13 @@
 #include <wchar.h>
 #else
 #include <errno.h>
-#include <fts.h>
 #endif
 
 #include "args.h"
 #include "filesystem.h"
 #include "utils.h"
+#include "include_index.h"
+#include "cache.h"
 #include "preprocess.h"
 
 
@@ -44,6 +45,10 @@
     ((x) >= 'A' && (x) <= 'Z') || \
     ((x) >= '0' && (x) <= '9') )
 
+
+__thread char include_stack[MAXINCLUDES][1024];
+
+
 #if __APPLE__
 char *strchrnul(const char *s, int c) {
     char *first = strchr(s, c);
@@ -54,19 +59,74 @@ char *strchrnul(const char *s, int c) {
 }
 #endif
 
+/*
+ * The constants are kept in an open-addressing hash table. Removed
+ * constants leave a tombstone behind, so that probe sequences of other
+ * constants aren't cut short.
+ */
+struct constant constant_tombstone;
+#define TOMBSTONE (&constant_tombstone)
+
+
 struct constants *constants_init() {
     struct constants *c = (struct constants *)safe_malloc(sizeof(struct constants));
-    c->head = NULL;
-    c->tail = NULL;
+    c->num_constants = 0;
+    c->num_used = 0;
+    c->size = CONSTINTERVAL;
+    c->slots = (struct constant **)safe_malloc(sizeof(struct constant *) * c->size);
+    memset(c->slots, 0, sizeof(struct constant *) * c->size);
     return c;
 }
 
+void constants_resize(struct constants *constants, uint32_t size) {
+    struct constant **old_slots = constants->slots;
+    uint32_t old_size = constants->size;
+    uint32_t i;
+    uint32_t j;
+
+    constants->size = size;
+    constants->slots = (struct constant **)safe_malloc(sizeof(struct constant *) * size);
+    memset(constants->slots, 0, sizeof(struct constant *) * size);
+
+    for (i = 0; i < old_size; i++) {
+        if (old_slots[i] == NULL || old_slots[i] == TOMBSTONE)
+            continue;
+        for (j = old_slots[i]->hash & (size - 1); constants->slots[j] != NULL; j = (j + 1) & (size - 1));
+        constants->slots[j] = old_slots[i];
+    }
+
+    constants->num_used = constants->num_constants;
+    free(old_slots);
+}
+
+void constants_add(struct constants *constants, struct constant *c) {
+    uint32_t size;
+    uint32_t i;
+
+    // keep the load (including tombstones) below 3/4
+    if ((constants->num_used + 1) * 4 > constants->size * 3) {
+        for (size = CONSTINTERVAL; (constants->num_constants + 1) * 2 > size; size *= 2);
+        constants_resize(constants, MAX(size, constants->size));
+    }
+
+    for (i = c->hash & (constants->size - 1);
+            constants->slots[i] != NULL && constants->slots[i] != TOMBSTONE;
+            i = (i + 1) & (constants->size - 1));
+
+    if (constants->slots[i] == NULL)
+        constants->num_used++;
+
+    constants->slots[i] = c;
+    constants->num_constants++;
+}
+
 bool constants_parse(struct constants *constants, char *definition, int line) {
     struct constant *c = (struct constant *)safe_malloc(sizeof(struct constant));
     char *ptr = definition;
     char *name;
     char *argstr;
     char *tok;
+    char *saveptr;
     char *start;
     char **args;
     int i;
@@ -83,6 +143,8 @@ bool constants_parse(struct constants *constants, char *definition, int line) {
                 "Constant \"%s\" is being redefined without an #undef.\n", name);
 
     c->name = name;
+    c->name_len = ptr - definition;
+    c->hash = hash_string(name, c->name_len);
 
     c->num_args = 0;
     if (*ptr == '(') {
@@ -97,14 +159,14 @@ bool constants_parse(struct constants *constants, char *definition, int line) {
 
         args = (char **)safe_malloc(sizeof(char *) * 4);
 
-        tok = strtok(argstr, ",");
+        tok = strtok_r(argstr, ",", &saveptr);
         while (tok) {
             if (c->num_args % 4 == 0)
                 args = (char **)safe_realloc(args, sizeof(char *) * (c->num_args + 4));
             args[c->num_args] = safe_strdup(tok);
             trim(args[c->num_args], strlen(args[c->num_args]) + 1);
             c->num_args++;
-            tok = strtok(NULL, ",");
+            tok = strtok_r(NULL, ",", &saveptr);
         }
 
         free(argstr);
@@ -225,14 +287,7 @@ bool constants_parse(struct constants *constants, char *definition, int line) {
         trim(c->value, strlen(c->value) + 1);
     }
 
-    c->last = constants->tail;
-    c->next = NULL;
-    if (constants->tail == NULL) {
-        constants->head = constants->tail = c;
-    } else {
-        constants->tail->next = c;
-        constants->tail = c;
-    }
+    constants_add(constants, c);
 
     if (c->num_args > 0) {
         for (i = 0; i < c->num_args; i++)
@@ -243,38 +298,45 @@ bool constants_parse(struct constants *constants, char *definition, int line) {
     return true;
 }
 
-bool constants_remove(struct constants *constants, char *name) {
-    struct constant *c = constants_find(constants, name, 0);
-    if (c == NULL)
-        return false;
+struct constant **constants_find_slot(struct constants *constants, char *name, int len) {
+    struct constant *c;
+    uint32_t hash;
+    uint32_t i;
 
-    if (c->next == NULL)
-        constants->tail = c->last;
-    else
-        c->next->last = c->last;
+    if (len <= 0)
+        len = strlen(name);
 
-    if (c->last == NULL)
-        constants->head = c->next;
-    else
-        c->last->next = c->next;
+    hash = hash_string(name, len);
+
+    for (i = hash & (constants->size - 1); (c = constants->slots[i]) != NULL; i = (i + 1) & (constants->size - 1)) {
+        if (c != TOMBSTONE && c->hash == hash && c->name_len == len && memcmp(c->name, name, len) == 0)
+            return &constants->slots[i];
+    }
+
+    return NULL;
+}
+
+bool constants_remove(struct constants *constants, char *name) {
+    struct constant **slot = constants_find_slot(constants, name, 0);
+    if (slot == NULL)
+        return false;
 
-    constant_free(c);
+    constant_free(*slot);
+    *slot = TOMBSTONE;
+    constants->num_constants--;
 
     return true;
 }
 
 struct constant *constants_find(struct constants *constants, char *name, int len) {
-    struct constant *c = constants->head;
+    /*
+     * Finds the constant with the given name. If len is positive, only the
+     * first len characters of name are used, otherwise it is null-terminated.
+     */
 
-    while (c != NULL) {
-        if (len <= 0 && strcmp(c->name, name) == 0)
-            break;
-        if (len > 0 && strlen(c->name) == len && strncmp(c->name, name, len) == 0)
-            break;
-        c = c->next;
-    }
+    struct constant **slot = constants_find_slot(constants, name, len);
 
-    return c;
+    return (slot == NULL) ? NULL : *slot;
 }
 
 char *constants_preprocess(struct constants *constants, char *source, int line, struct constant_stack *constant_stack) {
@@ -301,9 +363,10 @@ char *constants_preprocess(struct constants *constants, char *source, int line,
             ptr++;
 
         if (ptr - start > 0) {
+            result = (char *)safe_realloc(result, len + (ptr - start) + 1);
+            memcpy(result + len, start, ptr - start);
             len += ptr - start;
-            result = (char *)safe_realloc(result, len + 1);
-            strncat(result, start, ptr - start);
+            result[len] = 0;
         }
 
         if (*ptr == 0)
@@ -316,9 +379,10 @@ char *constants_preprocess(struct constants *constants, char *source, int line,
 
         c = constants_find(constants, start, ptr - start);
         if (c == NULL || (c->num_args > 0 && *ptr != '(')) {
+            result = (char *)safe_realloc(result, len + (ptr - start) + 1);
+            memcpy(result + len, start, ptr - start);
             len += ptr - start;
-            result = (char *)safe_realloc(result, len + 1);
-            strncat(result, start, ptr - start);
+            result[len] = 0;
             continue;
         }
 
@@ -383,9 +447,9 @@ char *constants_preprocess(struct constants *constants, char *source, int line,
             free(args);
         }
 
+        result = (char *)safe_realloc(result, len + strlen(value) + 1);
+        strcpy(result + len, value);
         len += strlen(value);
-        result = (char *)safe_realloc(result, len + 1);
-        strcat(result, value);
 
         free(value);
     }
@@ -396,14 +460,13 @@ char *constants_preprocess(struct constants *constants, char *source, int line,
 }
 
 void constants_free(struct constants *constants) {
-    struct constant *c = constants->head;
-    struct constant *next;
+    uint32_t i;
 
-    while (c != NULL) {
-        next = c->next;
-        constant_free(c);
-        c = next;
+    for (i = 0; i < constants->size; i++) {
+        if (constants->slots[i] != NULL && constants->slots[i] != TOMBSTONE)
+            constant_free(constants->slots[i]);
     }
+    free(constants->slots);
     free(constants);
 }
 
@@ -467,71 +530,13 @@ void constant_free(struct constant *constant) {
 }
 
 
-bool matches_includepath(char *path, char *includepath, char *includefolder) {
-    /*
-     * Checks if a given file can be matched to an include path by traversing
-     * backwards through the filesystem until a $PBOPREFIX$ file is found.
-     * If the prefix file, together with the diretory strucure, matches the
-     * included path, true is returned.
-     */
-
-    int i;
-    char cwd[2048];
-    char prefixpath[2048];
-    char prefixedpath[2048];
-    char *ptr;
-    FILE *f_prefix;
-
-    strncpy(cwd, path, 2048);
-    ptr = cwd + strlen(cwd);
-
-    while (strcmp(includefolder, cwd) != 0) {
-        while (*ptr != PATHSEP)
-            ptr--;
-        *ptr = 0;
-
-        strncpy(prefixpath, cwd, 2048);
-        strcat(prefixpath, PATHSEP_STR);
-        strcat(prefixpath, "$PBOPREFIX$");
-
-        f_prefix = fopen(prefixpath, "rb");
-        if (!f_prefix)
-            continue;
-
-        fgets(prefixedpath, sizeof(prefixedpath), f_prefix);
-        fclose(f_prefix);
-
-        if (prefixedpath[strlen(prefixedpath) - 1] == '\n')
-            prefixedpath[strlen(prefixedpath) - 1] = 0;
-        if (prefixedpath[strlen(prefixedpath) - 1] == '\r')
-            prefixedpath[strlen(prefixedpath) - 1] = 0;
-        if (prefixedpath[strlen(prefixedpath) - 1] == '\\')
-            prefixedpath[strlen(prefixedpath) - 1] = 0;
-
-        strcat(prefixedpath, path + strlen(cwd));
-
-        for (i = 0; i < strlen(prefixedpath); i++) {
-            if (prefixedpath[i] == '/')
-                prefixedpath[i] = '\\';
-        }
-
-        // compensate for missing leading slash in PBOPREFIX
-        if (prefixedpath[0] != '\\')
-            return (strcmp(prefixedpath, includepath+1) == 0);
-        else
-            return (strcmp(prefixedpath, includepath) == 0);
-    }
-
-    return false;
-}
-
-
-int find_file_helper(char *includepath, char *origin, char *includefolder, char *actualpath, char *cwd) {
+int find_file_helper(char *includepath, char *origin, char *includefolder, char *actualpath) {
     /*
      * Finds the file referenced in includepath in the includefolder. origin
      * describes the file in which the include is used (used for relative
-     * includes). actualpath holds the return pointer. The 4th arg is used for
-     * recursion on Windows and should be passed as NULL initially.
+     * includes). actualpath holds the return pointer. Absolute includes are
+     * looked up in the include index of the folder (see include_index.c),
+     * which maps the paths as seen through $PBOPREFIX$ files to real ones.
      *
      * Returns 0 on success, 1 on error and 2 if no file could be found.
      *
@@ -558,90 +563,19 @@ int find_file_helper(char *includepath, char *origin, char *includefolder, char
         return 0;
     }
 
+    struct include_index *index;
     char filename[2048];
-    char *ptr = includepath + strlen(includepath);
-
-    while (*ptr != '\\')
-        ptr--;
-    ptr++;
-
-    strncpy(filename, ptr, 2048);
-
-#ifdef _WIN32
-    if (cwd == NULL)
-        return find_file_helper(includepath, origin, includefolder, actualpath, includefolder);
-
-    WIN32_FIND_DATA file;
-    HANDLE handle = NULL;
-    char mask[2048];
-
-    GetFullPathName(includefolder, 2048, includefolder, NULL);
+    char *real_path;
 
-    GetFullPathName(cwd, 2048, mask, NULL);
-    sprintf(mask, "%s\\*", mask);
-
-    handle = FindFirstFile(mask, &file);
-    if (handle == INVALID_HANDLE_VALUE)
-        return 1;
-
-    do {
-        if (strcmp(file.cFileName, ".") == 0 || strcmp(file.cFileName, "..") == 0)
-            continue;
-
-        if (strcmp(file.cFileName, ".git") == 0)
-            continue;
-
-        GetFullPathName(cwd, 2048, mask, NULL);
-        sprintf(mask, "%s\\%s", mask, file.cFileName);
-        if (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            if (!find_file_helper(includepath, origin, includefolder, actualpath, mask)) {
-                FindClose(handle);
-                return 0;
-            }
-        } else {
-            if (strcmp(filename, file.cFileName) == 0 && matches_includepath(mask, includepath, includefolder)) {
-                strncpy(actualpath, mask, 2048);
-                FindClose(handle);
-                return 0;
-            }
-        }
-    } while (FindNextFile(handle, &file));
-
-    FindClose(handle);
-#else
-    FTS *tree;
-    FTSENT *f;
-    char *argv[] = { includefolder, NULL };
-
-    tree = fts_open(argv, FTS_LOGICAL | FTS_NOSTAT, NULL);
-    if (tree == NULL)
-        return 1;
-
-    while ((f = fts_read(tree))) {
-        if (!strcmp(f->fts_name, ".git"))
-            fts_set(tree, f, FTS_SKIP);
-
-        switch (f->fts_info) {
-            case FTS_DNR:
-            case FTS_ERR:
-                fts_close(tree);
-                return 2;
-            case FTS_NS: continue;
-            case FTS_DP: continue;
-            case FTS_D: continue;
-            case FTS_DC: continue;
-        }
-
-        if (strcmp(filename, f->fts_name) == 0 && matches_includepath(f->fts_path, includepath, includefolder)) {
-            strncpy(actualpath, f->fts_path, 2048);
-            fts_close(tree);
+    index = get_include_index(includefolder);
+    if (index != NULL) {
+        real_path = include_index_find(index, includepath + 1);
+        if (real_path != NULL) {
+            strncpy(actualpath, real_path, 2048);
             return 0;
         }
     }
 
-    fts_close(tree);
-#endif
-
     // check for file without pboprefix
     strncpy(filename, includefolder, sizeof(filename));
     strncat(filename, includepath, sizeof(filename) - strlen(filename) - 1);
@@ -665,8 +599,8 @@ int find_file(char *includepath, char *origin, char *actualpath) {
     /*
      * Finds the file referenced in includepath in the includefolder. origin
      * describes the file in which the include is used (used for relative
-     * includes). actualpath holds the return pointer. The 4th arg is used for
-     * recursion on Windows and should be passed as NULL initially.
+     * includes). actualpath holds the return pointer. The include folders
+     * are searched in the order they were given.
      *
      * Returns 0 on success, 1 on error and 2 if no file could be found.
      *
@@ -677,35 +611,26 @@ int find_file(char *includepath, char *origin, char *actualpath) {
     extern struct arguments args;
     int i;
     int success;
-    char *temp = (char *)malloc(2048);
 
     for (i = 0; i < args.num_includefolders; i++) {
-        strcpy(temp, args.includefolders[i]);
-        success = find_file_helper(includepath, origin, temp, actualpath, NULL);
-
-        if (success != 2) {
-            free(temp);
+        success = find_file_helper(includepath, origin, args.includefolders[i], actualpath);
+        if (success != 2)
             return success;
-        }
     }
 
-    free(temp);
-
     return 2;
 }
 
 
-int preprocess(char *source, FILE *f_target, struct constants *constants, struct lineref *lineref) {
+int preprocess(char *source, struct buffer *target, struct constants *constants, struct lineref *lineref) {
     /*
-     * Writes the contents of source into the target file pointer, while
+     * Writes the contents of source into the target buffer, while
      * recursively resolving constants and includes using the includefolder
      * for finding included files.
      *
      * Returns 0 on success, a positive integer on failure.
      */
 
-    extern char *current_target;
-    extern char include_stack[MAXINCLUDES][1024];
     int file_index;
     int line = 0;
     int i = 0;
@@ -752,6 +677,8 @@ int preprocess(char *source, FILE *f_target, struct constants *constants, struct
         return 1;
     }
 
+    cache_add_dependency(source);
+
     // Skip byte order mark if it exists
     if (fgetc(f_source) == 0xef)
         fseek(f_source, 3, SEEK_SET);
@@ -918,7 +845,7 @@ int preprocess(char *source, FILE *f_target, struct constants *constants, struct
                 free(directive);
                 free(buffer);
 
-                success = preprocess(actualpath, f_target, constants, lineref);
+                success = preprocess(actualpath, target, constants, lineref);
 
                 for (i = 0; i < MAXINCLUDES && include_stack[i][0] != 0; i++);
                 include_stack[i - 1][0] = 0;
@@ -973,7 +900,7 @@ int preprocess(char *source, FILE *f_target, struct constants *constants, struct
                 return success;
             }
 
-            fputs(buffer, f_target);
+            buffer_append(target, buffer, strlen(buffer));
 
             lineref->file_index[lineref->num_lines] = file_index;
             lineref->line_number[lineref->num_lines] = line;
@@ -23,8 +23,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "utils.h"
+
 
 #define MAXCONSTS 4096
+#define CONSTINTERVAL 256
 #define MAXARGS 32
 #define MAXINCLUDES 64
 #define FILEINTERVAL 32
@@ -33,17 +36,19 @@
 
 struct constant {
     char *name;
+    int name_len;
+    uint32_t hash;
     char *value;
     int num_args;
     int num_occurences;
     int (*occurrences)[2];
-    struct constant *next;
-    struct constant *last;
 };
 
 struct constants {
-    struct constant *head;
-    struct constant *tail;
+    uint32_t num_constants;
+    uint32_t num_used;
+    uint32_t size;
+    struct constant **slots;
 };
 
 struct lineref {
@@ -60,7 +65,7 @@ struct constant_stack {
 };
 
 
-char include_stack[MAXINCLUDES][1024];
+extern __thread char include_stack[MAXINCLUDES][1024];
 
 
 struct constants *constants_init();
@@ -74,10 +79,8 @@ char *constant_value(struct constants *constants, struct constant *constant,
         int num_args, char **args, int value, struct constant_stack *constant_stack);
 void constant_free(struct constant *constant);
 
-bool matches_includepath(char *path, char *includepath, char *includefolder);
-
 int find_file(char *includepath, char *origin, char *actualpath);
 
 char * resolve_macros(char *string, size_t buffsize, struct constant *constants);
 
-int preprocess(char *source, FILE *f_target, struct constants *constants, struct lineref *lineref);
+int preprocess(char *source, struct buffer *target, struct constants *constants, struct lineref *lineref);
@@ -36,47 +36,42 @@
 #include "rapify.tab.h"
 
 
-struct definitions *new_definitions() {
+struct definitions *new_definitions(struct arena *arena) {
     struct definitions *result;
 
-    result = (struct definitions *)safe_malloc(sizeof(struct definitions));
+    result = (struct definitions *)arena_alloc(arena, sizeof(struct definitions));
+    result->num_entries = 0;
     result->head = NULL;
+    result->tail = NULL;
 
     return result;
 }
 
 
-struct definitions *add_definition(struct definitions *head, int type, void *content) {
+struct definitions *add_definition(struct arena *arena, struct definitions *head, int type, void *content) {
     struct definition *definition;
-    struct definition *tmp;
 
-    definition = (struct definition *)safe_malloc(sizeof(struct definition));
+    definition = (struct definition *)arena_alloc(arena, sizeof(struct definition));
     definition->type = type;
     definition->content = content;
     definition->next = NULL;
 
-    if (head->head == NULL) {
+    if (head->tail == NULL)
         head->head = definition;
-        return head;
-    }
+    else
+        head->tail->next = definition;
 
-    tmp = head->head;
-    while (tmp != NULL) {
-        if (tmp->next == NULL) {
-            tmp->next = definition;
-            return head;
-        }
-        tmp = tmp->next;
-    }
+    head->tail = definition;
+    head->num_entries++;
 
     return head;
 }
 
 
-struct class *new_class(char *name, char *parent, struct definitions *content, bool is_delete) {
+struct class *new_class(struct arena *arena, char *name, char *parent, struct definitions *content, bool is_delete) {
     struct class *result;
 
-    result = (struct class *)safe_malloc(sizeof(struct class));
+    result = (struct class *)arena_alloc(arena, sizeof(struct class));
     result->name = name;
     result->parent = parent;
     result->is_delete = is_delete;
@@ -86,10 +81,10 @@ struct class *new_class(char *name, char *parent, struct definitions *content, b
 }
 
 
-struct variable *new_variable(int type, char *name, struct expression *expression) {
+struct variable *new_variable(struct arena *arena, int type, char *name, struct expression *expression) {
     struct variable *result;
 
-    result = (struct variable *)safe_malloc(sizeof(struct variable));
+    result = (struct variable *)arena_alloc(arena, sizeof(struct variable));
     result->type = type;
     result->name = name;
     result->expression = expression;
@@ -98,13 +93,15 @@ struct variable *new_variable(int type, char *name, struct expression *expressio
 }
 
 
-struct expression *new_expression(int type, void *value) {
+struct expression *new_expression(struct arena *arena, int type, void *value) {
     struct expression *result;
 
-    result = (struct expression *)safe_malloc(sizeof(struct expression));
+    result = (struct expression *)arena_alloc(arena, sizeof(struct expression));
     result->type = type;
     result->string_value = NULL;
+    result->num_entries = 0;
     result->head = NULL;
+    result->tail = NULL;
     result->next = NULL;
 
     if (type == TYPE_INT) {
@@ -113,160 +110,174 @@ struct expression *new_expression(int type, void *value) {
         result->float_value = *((float *)value);
     } else if (type == TYPE_STRING) {
         result->string_value = (char *)value;
-    } else if (type == TYPE_ARRAY || type == TYPE_ARRAY_EXPANSION) {
+    } else if ((type == TYPE_ARRAY || type == TYPE_ARRAY_EXPANSION) && value != NULL) {
         result->head = (struct expression *)value;
+        result->tail = result->head;
+        result->num_entries = 1;
     }
 
     return result;
 }
 
 
-struct expression *add_expression(struct expression *head, struct expression *new) {
+struct expression *add_expression(struct expression *array, struct expression *new) {
+    if (array->tail == NULL)
+        array->head = new;
+    else
+        array->tail->next = new;
+
+    array->tail = new;
+    array->num_entries++;
+
+    return array;
+}
+
+
+size_t rapified_expression_size(struct expression *expr) {
     struct expression *tmp;
+    size_t size;
 
-    tmp = head;
-    while (tmp != NULL) {
-        if (tmp->next == NULL) {
-            tmp->next = new;
-            break;
+    if (expr->type == TYPE_ARRAY) {
+        size = compressed_int_size(expr->num_entries);
+        tmp = expr->head;
+        while (tmp != NULL) {
+            size += 1 + rapified_expression_size(tmp);
+            tmp = tmp->next;
         }
 
-        tmp = tmp->next;
+        return size;
+    } else if (expr->type == TYPE_INT || expr->type == TYPE_FLOAT) {
+        return 4;
+    } else {
+        return strlen(expr->string_value) + 1;
     }
-
-    return head;
 }
 
 
-void free_expression(struct expression *expr) {
-    if (expr == NULL) { return; }
-    free(expr->string_value);
-    free_expression(expr->head);
-    free_expression(expr->next);
-    free(expr);
-}
+size_t rapified_variable_size(struct variable *var) {
+    size_t size;
 
+    if (var->type == TYPE_VAR)
+        size = 2;
+    else if (var->type == TYPE_ARRAY_EXPANSION)
+        size = 5;
+    else
+        size = 1;
 
-void free_variable(struct variable *var) {
-    free(var->name);
-    free_expression(var->expression);
-    free(var);
+    return size + strlen(var->name) + 1 + rapified_expression_size(var->expression);
 }
 
 
-void free_definition(struct definition *definition) {
-    if (definition == NULL) { return; }
-
-    free_definition(definition->next);
+size_t rapified_class_size(struct class *class) {
+    /*
+     * Calculates the number of bytes rapify_class is going to write for the
+     * given class, including all of its subclass bodies.
+     */
 
-    if (definition->type == TYPE_VAR)
-        free_variable((struct variable *)definition->content);
-    else
-        free_class((struct class *)definition->content);
+    struct definition *tmp;
+    struct class *subclass;
+    size_t size;
 
-    free(definition);
-}
+    if (class->content == NULL)
+        return 1 + strlen(class->name) + 1;
 
+    size = (class->parent ? strlen(class->parent) : 0) + 1;
+    size += compressed_int_size(class->content->num_entries);
 
-void free_class(struct class *class) {
-    free(class->name);
-    free(class->parent);
+    tmp = class->content->head;
+    while (tmp != NULL) {
+        if (tmp->type == TYPE_VAR) {
+            size += rapified_variable_size((struct variable *)tmp->content);
+        } else {
+            subclass = (struct class *)tmp->content;
+            if (subclass->content != NULL)
+                size += 1 + strlen(subclass->name) + 1 + 4;
+            size += rapified_class_size(subclass);
+        }
 
-    if (class->content != NULL && class->content != (struct definitions *)-1) {
-        free_definition(class->content->head);
-        free(class->content);
+        tmp = tmp->next;
     }
 
-    free(class);
+    return size;
 }
 
 
-void rapify_expression(struct expression *expr, FILE *f_target) {
+void rapify_expression(struct expression *expr, struct buffer *target) {
     struct expression *tmp;
-    uint32_t num_entries;
 
     if (expr->type == TYPE_ARRAY) {
-        num_entries = 0;
-        tmp = expr->head;
-        while (tmp != NULL) {
-            num_entries++;
-            tmp = tmp->next;
-        }
-
-        write_compressed_int(num_entries, f_target);
+        write_compressed_int(expr->num_entries, target);
 
         tmp = expr->head;
         while (tmp != NULL) {
-            fputc((char)((tmp->type == TYPE_STRING) ? 0 :
+            buffer_append_byte(target, (tmp->type == TYPE_STRING) ? 0 :
                 ((tmp->type == TYPE_FLOAT) ? 1 :
-                ((tmp->type == TYPE_INT) ? 2 : 3))), f_target);
-            rapify_expression(tmp, f_target);
+                ((tmp->type == TYPE_INT) ? 2 : 3)));
+            rapify_expression(tmp, target);
             tmp = tmp->next;
         }
     } else if (expr->type == TYPE_INT) {
-        fwrite(&expr->int_value, 4, 1, f_target);
+        buffer_append(target, &expr->int_value, 4);
     } else if (expr->type == TYPE_FLOAT) {
-        fwrite(&expr->float_value, 4, 1, f_target);
+        buffer_append(target, &expr->float_value, 4);
     } else {
-        fwrite(expr->string_value, strlen(expr->string_value) + 1, 1, f_target);
+        buffer_append(target, expr->string_value, strlen(expr->string_value) + 1);
     }
 }
 
 
-void rapify_variable(struct variable *var, FILE *f_target) {
+void rapify_variable(struct variable *var, struct buffer *target) {
     if (var->type == TYPE_VAR) {
-        fputc(1, f_target);
-        fputc((char)((var->expression->type == TYPE_STRING) ? 0 : ((var->expression->type == TYPE_FLOAT) ? 1 : 2 )), f_target);
+        buffer_append_byte(target, 1);
+        buffer_append_byte(target, (var->expression->type == TYPE_STRING) ? 0 : ((var->expression->type == TYPE_FLOAT) ? 1 : 2 ));
     } else {
-        fputc((char)((var->type == TYPE_ARRAY) ? 2 : 5), f_target);
+        buffer_append_byte(target, (var->type == TYPE_ARRAY) ? 2 : 5);
         if (var->type == TYPE_ARRAY_EXPANSION) {
-            fwrite("\x01\0\0\0", 4, 1, f_target);
+            buffer_append(target, "\x01\0\0\0", 4);
         }
     }
 
-    fwrite(var->name, strlen(var->name) + 1, 1, f_target);
-    rapify_expression(var->expression, f_target);
+    buffer_append(target, var->name, strlen(var->name) + 1);
+    rapify_expression(var->expression, target);
 }
 
 
-void rapify_class(struct class *class, FILE *f_target) {
+void rapify_class(struct class *class, struct buffer *target) {
+    /*
+     * Appends the rapified class to the target buffer. The offsets of
+     * subclass bodies are patched in place once the bodies are written.
+     */
+
     struct definition *tmp;
     uint32_t fp_temp;
-    uint32_t num_entries = 0;
 
     if (class->content == NULL) {
         // extern or delete class
-        fputc((char)(class->is_delete ? 4 : 3), f_target);
-        fwrite(class->name, strlen(class->name) + 1, 1, f_target);
+        buffer_append_byte(target, class->is_delete ? 4 : 3);
+        buffer_append(target, class->name, strlen(class->name) + 1);
         return;
     }
 
     if (class->parent)
-        fwrite(class->parent, strlen(class->parent) + 1, 1, f_target);
+        buffer_append(target, class->parent, strlen(class->parent) + 1);
     else
-        fputc(0, f_target);
-
-    tmp = class->content->head;
-    while (tmp != NULL) {
-        num_entries++;
-        tmp = tmp->next;
-    }
+        buffer_append_byte(target, 0);
 
-    write_compressed_int(num_entries, f_target);
+    write_compressed_int(class->content->num_entries, target);
 
     tmp = class->content->head;
     while (tmp != NULL) {
         if (tmp->type == TYPE_VAR) {
-            rapify_variable((struct variable *)tmp->content, f_target);
+            rapify_variable((struct variable *)tmp->content, target);
         } else {
             if (((struct class *)(tmp->content))->content != NULL) {
-                fputc(0, f_target);
-                fwrite(((struct class *)(tmp->content))->name,
-                    strlen(((struct class *)(tmp->content))->name) + 1, 1, f_target);
-                ((struct class *)(tmp->content))->offset_location = ftell(f_target);
-                fwrite("\0\0\0\0", 4, 1, f_target);
+                buffer_append_byte(target, 0);
+                buffer_append(target, ((struct class *)(tmp->content))->name,
+                    strlen(((struct class *)(tmp->content))->name) + 1);
+                ((struct class *)(tmp->content))->offset_location = target->length;
+                buffer_append(target, "\0\0\0\0", 4);
             } else {
-                rapify_class(tmp->content, f_target);
+                rapify_class(tmp->content, target);
             }
         }
 
@@ -276,102 +287,60 @@ void rapify_class(struct class *class, FILE *f_target) {
     tmp = class->content->head;
     while (tmp != NULL) {
         if (tmp->type == TYPE_CLASS && ((struct class *)(tmp->content))->content != NULL) {
-            fp_temp = ftell(f_target);
-            fseek(f_target, ((struct class *)(tmp->content))->offset_location, SEEK_SET);
-            fwrite(&fp_temp, sizeof(uint32_t), 1, f_target);
-            fseek(f_target, 0, SEEK_END);
+            fp_temp = target->length;
+            memcpy(target->data + ((struct class *)(tmp->content))->offset_location, &fp_temp, sizeof(uint32_t));
 
-            rapify_class(tmp->content, f_target);
+            rapify_class(tmp->content, target);
         }
 
         tmp = tmp->next;
     }
 }
 
-int rapify_file(char *source, char *target) {
+
+int rapify_to_buffer(char *source, struct buffer *target) {
     /*
-     * Resolves macros/includes and rapifies the given file. If source and
-     * target are identical, the target is overwritten.
+     * Resolves macros/includes and rapifies the given file into the given
+     * buffer, which is initialized by this function. Files that are already
+     * rapified are read as they are.
      *
-     * Returns 0 on success and a positive integer on failure.
+     * Returns 0 on success and a positive integer on failure. The buffer
+     * only has to be freed on success.
      */
 
-    extern char *current_target;
-    FILE *f_temp;
-    FILE *f_target;
+    FILE *f_source;
     int i;
-    int datasize;
     int success;
-    char buffer[4096];
+    long datasize;
+    char magic[4];
     uint32_t enum_offset = 0;
+    struct buffer preprocessed;
     struct constants *constants;
     struct lineref *lineref;
+    struct arena arena;
 
     current_target = source;
 
     // Check if the file is already rapified
-    f_temp = fopen(source, "rb");
-    if (!f_temp) {
+    f_source = fopen(source, "rb");
+    if (!f_source) {
         errorf("Failed to open %s.\n", source);
         return 1;
     }
 
-    fread(buffer, 4, 1, f_temp);
-    if (strncmp(buffer, "\0raP", 4) == 0) {
-        if ((strcmp(source, target)) == 0) {
-            fclose(f_temp);
-            return 0;
-        }
-
-        if (strcmp(target, "-") == 0) {
-            f_target = stdout;
-        } else {
-            f_target = fopen(target, "wb");
-            if (!f_target) {
-                errorf("Failed to open %s.\n", target);
-                fclose(f_temp);
-                return 2;
-            }
-        }
-
-        fseek(f_temp, 0, SEEK_END);
-        datasize = ftell(f_temp);
-
-        fseek(f_temp, 0, SEEK_SET);
-        for (i = 0; datasize - i >= sizeof(buffer); i += sizeof(buffer)) {
-            fread(buffer, sizeof(buffer), 1, f_temp);
-            fwrite(buffer, sizeof(buffer), 1, f_target);
-        }
-        fread(buffer, datasize - i, 1, f_temp);
-        fwrite(buffer, datasize - i, 1, f_target);
+    if (fread(magic, 4, 1, f_source) == 1 && strncmp(magic, "\0raP", 4) == 0) {
+        fseek(f_source, 0, SEEK_END);
+        datasize = ftell(f_source);
+        fseek(f_source, 0, SEEK_SET);
 
-        fclose(f_temp);
-        if (strcmp(target, "-") != 0)
-            fclose(f_target);
+        buffer_init(target, datasize);
+        target->length = fread(target->data, 1, datasize, f_source);
+        fclose(f_source);
 
         return 0;
-    } else {
-        fclose(f_temp);
     }
 
-#ifdef _WIN32
-    char temp_name[2048];
-    if (!GetTempFileName(".", "amk", 0, temp_name)) {
-        errorf("Failed to get temp file name (system error %i).\n", GetLastError());
-        return 1;
-    }
-    f_temp = fopen(temp_name, "wb+");
-#else
-    f_temp = tmpfile();
-#endif
-
-    if (!f_temp) {
-        errorf("Failed to open temp file.\n");
-#ifdef _WIN32
-        DeleteFile(temp_name);
-#endif
-        return 1;
-    }
+    fclose(f_source);
 
     for (i = 0; i < MAXINCLUDES; i++)
         include_stack[i][0] = 0;
@@ -385,16 +354,15 @@ int rapify_file(char *source, char *target) {
     lineref->file_index = (uint32_t *)safe_malloc(sizeof(uint32_t) * LINEINTERVAL);
     lineref->line_number = (uint32_t *)safe_malloc(sizeof(uint32_t) * LINEINTERVAL);
 
-    success = preprocess(source, f_temp, constants, lineref);
+    buffer_init(&preprocessed, 65536);
+
+    success = preprocess(source, &preprocessed, constants, lineref);
 
     current_target = source;
 
     if (success) {
         errorf("Failed to preprocess %s.\n", source);
-        fclose(f_temp);
-#ifdef _WIN32
-        DeleteFile(temp_name);
-#endif
+        buffer_free(&preprocessed);
         return success;
     }
 
@@ -406,93 +374,39 @@ int rapify_file(char *source, char *target) {
     printf("Done with preprocessing, dumping preprocessed config to %s.\n", dump_name);
 
     f_dump = fopen(dump_name, "wb");
-    fseek(f_temp, 0, SEEK_END);
-    datasize = ftell(f_temp);
-
-    fseek(f_temp, 0, SEEK_SET);
-    for (i = 0; datasize - i >= sizeof(buffer); i += sizeof(buffer)) {
-        fread(buffer, sizeof(buffer), 1, f_temp);
-        fwrite(buffer, sizeof(buffer), 1, f_dump);
-    }
-
-    fread(buffer, datasize - i, 1, f_temp);
-    fwrite(buffer, datasize - i, 1, f_dump);
-
+    fwrite(preprocessed.data, preprocessed.length, 1, f_dump);
     fclose(f_dump);
 #endif
 
-    fseek(f_temp, 0, SEEK_SET);
+    // flex scans the buffer in place and needs two null bytes at the end
+    buffer_append(&preprocessed, "\0\0", 2);
+
+    // the whole parse tree lives in the arena and is released in one go
+    arena_init(&arena, 65536);
+
     struct class *result;
-    result = parse_file(f_temp, lineref);
+    result = parse_file(preprocessed.data, preprocessed.length, lineref, &arena);
+
+    buffer_free(&preprocessed);
 
     if (result == NULL) {
         errorf("Failed to parse config.\n");
+        arena_free(&arena);
         return 1;
     }
 
-#ifdef _WIN32
-    char temp_name2[2048];
-#endif
+    // Rapify file into memory, allocating the exact size up front
+    buffer_init(target, 16 + rapified_class_size(result) + 4);
 
-    // Rapify file
-    if (strcmp(target, "-") == 0) {
-#ifdef _WIN32
-        if (!GetTempFileName(".", "amk", 0, temp_name2)) {
-            errorf("Failed to get temp file name (system error %i).\n", GetLastError());
-            return 1;
-        }
-        f_target = fopen(temp_name, "wb+");
-#else
-        f_target = tmpfile();
-#endif
-
-        if (!f_target) {
-            errorf("Failed to open temp file.\n");
-#ifdef _WIN32
-            DeleteFile(temp_name2);
-#endif
-            return 1;
-        }
-    } else {
-        f_target = fopen(target, "wb+");
-        if (!f_target) {
-            errorf("Failed to open %s.\n", target);
-            fclose(f_temp);
-            return 2;
-        }
-    }
-    fwrite("\0raP", 4, 1, f_target);
-    fwrite("\0\0\0\0\x08\0\0\0", 8, 1, f_target);
-    fwrite(&enum_offset, 4, 1, f_target); // this is replaced later
+    buffer_append(target, "\0raP", 4);
+    buffer_append(target, "\0\0\0\0\x08\0\0\0", 8);
+    buffer_append(target, &enum_offset, 4); // this is replaced later
 
-    rapify_class(result, f_target);
+    rapify_class(result, target);
 
-    enum_offset = ftell(f_target);
-    fwrite("\0\0\0\0", 4, 1, f_target); // fuck enums
-    fseek(f_target, 12, SEEK_SET);
-    fwrite(&enum_offset, 4, 1, f_target);
-
-    if (strcmp(target, "-") == 0) {
-        fseek(f_target, 0, SEEK_END);
-        datasize = ftell(f_target);
-
-        fseek(f_target, 0, SEEK_SET);
-        for (i = 0; datasize - i >= sizeof(buffer); i += sizeof(buffer)) {
-            fread(buffer, sizeof(buffer), 1, f_target);
-            fwrite(buffer, sizeof(buffer), 1, stdout);
-        }
-        fread(buffer, datasize - i, 1, f_target);
-        fwrite(buffer, datasize - i, 1, stdout);
-    }
-
-    fclose(f_temp);
-    fclose(f_target);
-
-#ifdef _WIN32
-    DeleteFile(temp_name);
-    if (strcmp(target, "-") == 0)
-        DeleteFile(temp_name2);
-#endif
+    enum_offset = target->length;
+    buffer_append(target, "\0\0\0\0", 4); // fuck enums
+    memcpy(target->data + 12, &enum_offset, 4);
 
     constants_free(constants);
 
@@ -503,7 +417,44 @@ int rapify_file(char *source, char *target) {
     free(lineref->line_number);
     free(lineref);
 
-    free_class(result);
+    arena_free(&arena);
+
+    return 0;
+}
+
+
+int rapify_file(char *source, char *target) {
+    /*
+     * Resolves macros/includes and rapifies the given file. Files that are
+     * already rapified are copied as they are. If source and target are
+     * identical, the target is overwritten.
+     *
+     * Returns 0 on success and a positive integer on failure.
+     */
+
+    FILE *f_target;
+    int success;
+    struct buffer output;
+
+    success = rapify_to_buffer(source, &output);
+    if (success)
+        return success;
+
+    // Write it out in one go
+    if (strcmp(target, "-") == 0) {
+        fwrite(output.data, output.length, 1, stdout);
+    } else {
+        f_target = fopen(target, "wb");
+        if (!f_target) {
+            errorf("Failed to open %s.\n", target);
+            buffer_free(&output);
+            return 2;
+        }
+        fwrite(output.data, output.length, 1, f_target);
+        fclose(f_target);
+    }
+
+    buffer_free(&output);
 
     return 0;
 }
@@ -36,7 +36,9 @@ enum {
 };
 
 struct definitions {
+    uint32_t num_entries;
     struct definition *head;
+    struct definition *tail;
 };
 
 struct definition {
@@ -49,7 +51,7 @@ struct class {
     char *name;
     char *parent;
     bool is_delete;
-    long offset_location;
+    size_t offset_location;
     struct definitions *content;
 };
 
@@ -64,37 +66,39 @@ struct expression {
     int32_t int_value;
     float float_value;
     char *string_value;
+    uint32_t num_entries;
     struct expression *head;
+    struct expression *tail;
     struct expression *next;
 };
 
 
-struct class *parse_file(FILE *f, struct lineref *lineref);
+struct class *parse_file(char *buffer, size_t size, struct lineref *lineref, struct arena *arena);
 
-struct definitions *new_definitions();
+struct definitions *new_definitions(struct arena *arena);
 
-struct definitions *add_definition(struct definitions *head, int type, void *content);
+struct definitions *add_definition(struct arena *arena, struct definitions *head, int type, void *content);
 
-struct class *new_class(char *name, char *parent, struct definitions *content, bool is_delete);
+struct class *new_class(struct arena *arena, char *name, char *parent, struct definitions *content, bool is_delete);
 
-struct variable *new_variable(int type, char *name, struct expression *expression);
+struct variable *new_variable(struct arena *arena, int type, char *name, struct expression *expression);
 
-struct expression *new_expression(int type, void *value);
+struct expression *new_expression(struct arena *arena, int type, void *value);
 
-struct expression *add_expression(struct expression *head, struct expression *new);
+struct expression *add_expression(struct expression *array, struct expression *new);
 
-void free_expression(struct expression *expr);
+size_t rapified_expression_size(struct expression *expr);
 
-void free_variable(struct variable *var);
+size_t rapified_variable_size(struct variable *var);
 
-void free_definition(struct definition *definition);
+size_t rapified_class_size(struct class *class);
 
-void free_class(struct class *class);
+void rapify_expression(struct expression *expr, struct buffer *target);
 
-void rapify_expression(struct expression *expr, FILE *f_target);
+void rapify_variable(struct variable *var, struct buffer *target);
 
-void rapify_variable(struct variable *var, FILE *f_target);
+void rapify_class(struct class *class, struct buffer *target);
 
-void rapify_class(struct class *class, FILE *f_target);
+int rapify_to_buffer(char *source, struct buffer *target);
 
 int rapify_file(char *source, char *target);
@@ -0,0 +1,119 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison interface for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+#ifndef YY_YY_SRC_RAPIFY_TAB_H_INCLUDED
+# define YY_YY_SRC_RAPIFY_TAB_H_INCLUDED
+/* Debug traces.  */
+#ifndef YYDEBUG
+# define YYDEBUG 0
+#endif
+#if YYDEBUG
+extern int yydebug;
+#endif
+
+/* Token kinds.  */
+#ifndef YYTOKENTYPE
+# define YYTOKENTYPE
+  enum yytokentype
+  {
+    YYEMPTY = -2,
+    YYEOF = 0,                     /* "end of file"  */
+    YYerror = 256,                 /* error  */
+    YYUNDEF = 257,                 /* "invalid token"  */
+    T_NAME = 258,                  /* T_NAME  */
+    T_INT = 259,                   /* T_INT  */
+    T_FLOAT = 260,                 /* T_FLOAT  */
+    T_STRING = 261,                /* T_STRING  */
+    T_CLASS = 262,                 /* T_CLASS  */
+    T_DELETE = 263,                /* T_DELETE  */
+    T_SEMICOLON = 264,             /* T_SEMICOLON  */
+    T_COLON = 265,                 /* T_COLON  */
+    T_COMMA = 266,                 /* T_COMMA  */
+    T_EQUALS = 267,                /* T_EQUALS  */
+    T_PLUS = 268,                  /* T_PLUS  */
+    T_LBRACE = 269,                /* T_LBRACE  */
+    T_RBRACE = 270,                /* T_RBRACE  */
+    T_LBRACKET = 271,              /* T_LBRACKET  */
+    T_RBRACKET = 272               /* T_RBRACKET  */
+  };
+  typedef enum yytokentype yytoken_kind_t;
+#endif
+
+/* Value type.  */
+#if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
+union YYSTYPE
+{
+#line 52 "src/rapify.y"
+
+    struct definitions* definitions_value;
+    struct class *class_value;
+    struct variable *variable_value;
+    struct expression *expression_value;
+    int32_t int_value;
+    float float_value;
+    char *string_value;
+
+#line 91 "src/rapify.tab.h"
+
+};
+typedef union YYSTYPE YYSTYPE;
+# define YYSTYPE_IS_TRIVIAL 1
+# define YYSTYPE_IS_DECLARED 1
+#endif
+
+/* Location type.  */
+#if ! defined YYLTYPE && ! defined YYLTYPE_IS_DECLARED
+typedef struct YYLTYPE YYLTYPE;
+struct YYLTYPE
+{
+  int first_line;
+  int first_column;
+  int last_line;
+  int last_column;
+};
+# define YYLTYPE_IS_DECLARED 1
+# define YYLTYPE_IS_TRIVIAL 1
+#endif
+
+
+extern YYSTYPE yylval;
+extern YYLTYPE yylloc;
+
+int yyparse (struct class **result, struct lineref *lineref, struct arena *arena);
+
+
+#endif /* !YY_YY_SRC_RAPIFY_TAB_H_INCLUDED  */
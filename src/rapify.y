@@ -19,7 +19,9 @@
 %{
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "utils.h"
 #include "filesystem.h"
@@ -29,12 +31,22 @@
 #define YYDEBUG 0
 #define YYERROR_VERBOSE 1
 
-extern int yylex(struct class **result, struct lineref *lineref);
+extern int yylex(struct class **result, struct lineref *lineref, struct arena *arena);
 extern int yyparse();
-extern FILE* yyin;
 extern int yylineno;
 
-void yyerror(struct class **result, struct lineref *lineref, const char* s);
+struct yy_buffer_state;
+extern struct yy_buffer_state *yy_scan_buffer(char *base, size_t size);
+extern void yy_delete_buffer(struct yy_buffer_state *buffer);
+extern void restore_scan_buffer();
+
+void yyerror(struct class **result, struct lineref *lineref, struct arena *arena, const char* s);
+
+/* flex and bison keep their state in globals, so only one parse at a time */
+pthread_mutex_t parser_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the buffer being parsed, used to print the offending line on errors */
+char *parse_buffer;
 %}
 
 %union {
@@ -63,80 +75,93 @@ void yyerror(struct class **result, struct lineref *lineref, const char* s);
 
 %start start
 
-%param {struct class **result} {struct lineref *lineref}
+%param {struct class **result} {struct lineref *lineref} {struct arena *arena}
 %locations
 
 %%
-start: definitions { *result = new_class(NULL, NULL, $1, false); }
+start: definitions { *result = new_class(arena, NULL, NULL, $1, false); }
 
-definitions:  /* empty */ { $$ = new_definitions(); }
-            | definitions class { $$ = add_definition($1, TYPE_CLASS, $2); }
-            | definitions variable { $$ = add_definition($1, TYPE_VAR, $2); }
+definitions:  /* empty */ { $$ = new_definitions(arena); }
+            | definitions class { $$ = add_definition(arena, $1, TYPE_CLASS, $2); }
+            | definitions variable { $$ = add_definition(arena, $1, TYPE_VAR, $2); }
 ;
 
-class:        T_CLASS T_NAME T_LBRACE definitions T_RBRACE T_SEMICOLON { $$ = new_class($2, NULL, $4, false); }
-            | T_CLASS T_NAME T_COLON T_NAME T_LBRACE definitions T_RBRACE T_SEMICOLON { $$ = new_class($2, $4, $6, false); }
-            | T_CLASS T_NAME T_SEMICOLON { $$ = new_class($2, NULL, NULL, false); }
-            | T_CLASS T_NAME T_COLON T_NAME T_SEMICOLON { $$ = new_class($2, $4, 0, false); }
-            | T_DELETE T_NAME T_SEMICOLON { $$ = new_class($2, NULL, NULL, true); }
+class:        T_CLASS T_NAME T_LBRACE definitions T_RBRACE T_SEMICOLON { $$ = new_class(arena, $2, NULL, $4, false); }
+            | T_CLASS T_NAME T_COLON T_NAME T_LBRACE definitions T_RBRACE T_SEMICOLON { $$ = new_class(arena, $2, $4, $6, false); }
+            | T_CLASS T_NAME T_SEMICOLON { $$ = new_class(arena, $2, NULL, NULL, false); }
+            | T_CLASS T_NAME T_COLON T_NAME T_SEMICOLON { $$ = new_class(arena, $2, $4, 0, false); }
+            | T_DELETE T_NAME T_SEMICOLON { $$ = new_class(arena, $2, NULL, NULL, true); }
 ;
 
-variable:     T_NAME T_EQUALS expression T_SEMICOLON { $$ = new_variable(TYPE_VAR, $1, $3); }
-            | T_NAME T_LBRACKET T_RBRACKET T_EQUALS expression T_SEMICOLON { $$ = new_variable(TYPE_ARRAY, $1, $5); }
-            | T_NAME T_LBRACKET T_RBRACKET T_PLUS T_EQUALS expression T_SEMICOLON { $$ = new_variable(TYPE_ARRAY_EXPANSION, $1, $6); }
+variable:     T_NAME T_EQUALS expression T_SEMICOLON { $$ = new_variable(arena, TYPE_VAR, $1, $3); }
+            | T_NAME T_LBRACKET T_RBRACKET T_EQUALS expression T_SEMICOLON { $$ = new_variable(arena, TYPE_ARRAY, $1, $5); }
+            | T_NAME T_LBRACKET T_RBRACKET T_PLUS T_EQUALS expression T_SEMICOLON { $$ = new_variable(arena, TYPE_ARRAY_EXPANSION, $1, $6); }
 ;
 
-expression:   T_INT { $$ = new_expression(TYPE_INT, &$1); }
-            | T_FLOAT { $$ = new_expression(TYPE_FLOAT, &$1); }
-            | T_STRING { $$ = new_expression(TYPE_STRING, $1); }
-            | T_LBRACE expressions T_RBRACE { $$ = new_expression(TYPE_ARRAY, $2); }
-            | T_LBRACE expressions T_COMMA T_RBRACE { $$ = new_expression(TYPE_ARRAY, $2); }
-            | T_LBRACE T_RBRACE { $$ = new_expression(TYPE_ARRAY, NULL); }
+expression:   T_INT { $$ = new_expression(arena, TYPE_INT, &$1); }
+            | T_FLOAT { $$ = new_expression(arena, TYPE_FLOAT, &$1); }
+            | T_STRING { $$ = new_expression(arena, TYPE_STRING, $1); }
+            | T_LBRACE expressions T_RBRACE { $$ = $2; }
+            | T_LBRACE expressions T_COMMA T_RBRACE { $$ = $2; }
+            | T_LBRACE T_RBRACE { $$ = new_expression(arena, TYPE_ARRAY, NULL); }
 ;
 
-expressions:  expression { $$ = $1; }
+expressions:  expression { $$ = new_expression(arena, TYPE_ARRAY, $1); }
             | expressions T_COMMA expression { $$ = add_expression($1, $3); }
 ;
 %%
 
-struct class *parse_file(FILE *f, struct lineref *lineref) {
+struct class *parse_file(char *buffer, size_t size, struct lineref *lineref, struct arena *arena) {
+    /*
+     * Parses the preprocessed config in the given buffer. flex scans the
+     * buffer in place, so it is modified and the last two bytes of it have
+     * to be null bytes. All nodes and strings of the resulting tree are
+     * allocated from the given arena.
+     */
+
     struct class *result;
+    struct yy_buffer_state *scan_buffer;
+
+    pthread_mutex_lock(&parser_lock);
 
     yylineno = 0;
-    yyin = f;
+    parse_buffer = buffer;
 
 #if YYDEBUG == 1
     yydebug = 1;
 #endif
 
-    do { 
-        if (yyparse(&result, lineref)) {
-            return NULL;
-        }
-    } while(!feof(yyin));
+    scan_buffer = yy_scan_buffer(buffer, size);
+    if (scan_buffer == NULL || yyparse(&result, lineref, arena))
+        result = NULL;
+
+    if (scan_buffer != NULL)
+        yy_delete_buffer(scan_buffer);
+
+    pthread_mutex_unlock(&parser_lock);
 
     return result;
 }
 
-void yyerror(struct class **result, struct lineref *lineref,  const char* s) {
+void yyerror(struct class **result, struct lineref *lineref, struct arena *arena, const char* s) {
     int line = 0;
-    char *buffer = NULL;
-    size_t buffsize;
+    char *ptr = parse_buffer;
+    char *end;
 
-    fseek(yyin, 0, SEEK_SET);
-    while (line < yylloc.first_line) {
-        if (buffer != NULL)
-            free(buffer);
-
-        buffer = NULL;
-        buffsize = 0;
-        getline(&buffer, &buffsize, yyin);
+    // flex terminates the current token in place, put the character back
+    restore_scan_buffer();
 
+    while (line < yylloc.first_line && strchr(ptr, '\n') != NULL) {
+        ptr = strchr(ptr, '\n') + 1;
         line++;
     }
 
     lerrorf(lineref->file_names[lineref->file_index[yylloc.first_line]],
             lineref->line_number[yylloc.first_line], "%s\n", s);
 
-    fprintf(stderr, " %s", buffer);
+    end = strchr(ptr, '\n');
+    if (end == NULL)
+        end = ptr + strlen(ptr);
+
+    fprintf(stderr, " %.*s\n", (int)(end - ptr), ptr);
 }
@@ -0,0 +1,115 @@
+/* Test-only stand-in for the flex scanner generated from src/rapify.l. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <regex.h>
+#include "utils.h"
+#include "rapify.h"
+#include "rapify.tab.h"
+
+int yylineno = 1;
+extern int count_paused __attribute__((weak));
+#define PAUSE(v) if (&count_paused) count_paused = v;
+char *yytext;
+int yyleng;
+static char *buf; static size_t pos, len;
+struct yy_buffer_state { int dummy; };
+static struct yy_buffer_state state;
+
+struct yy_buffer_state *yy_scan_buffer(char *base, size_t size) {
+    if (size < 2 || base[size-1] || base[size-2]) return NULL;
+    buf = base; len = size - 2; pos = 0; return &state;
+}
+void yy_delete_buffer(struct yy_buffer_state *b) { (void)b; }
+
+static const char *pats[] = {
+    "^[ \t]", "^\n", "^;", "^:", "^,", "^\\+", "^=", "^\\]", "^\\[", "^\\}", "^\\{",
+    "^class", "^delete",
+    "^s*[-+]?[0-9]+", "^s*[-+]?0x[0-9]+", "^s*[-+]?[0-9]*\\.[0-9]+",
+    "^s*[-+]?([0-9]*\\.)?[0-9]+[eE][-+]?[0-9]+",
+    "^\"(\\\\.|\"\"|[^\"])*\"", "^'(\\\\.|''|[^'])*'",
+    "^([^;{\"' \t\n][^;{\n]*)[ \t\n]*;",
+    "^([^;,{\"'} \t\n][^;,{}\n]*)[ \t\n]*[,}]",
+    "^[a-zA-Z0-9_]+", "^[^\n]"
+};
+#define NRULES (sizeof(pats)/sizeof(pats[0]))
+static regex_t res[NRULES]; static bool compiled = false;
+
+bool allow_val = false, allow_arr = false, last_was_class = false, tmp;
+#define RESET_VARS allow_val = false; allow_arr = false; last_was_class = false;
+
+int yylex(struct class **result, struct lineref *lineref, struct arena *arena) {
+    size_t i, k, n, cand_rule[NRULES], cand_total[NRULES], cand_text[NRULES];
+    regmatch_t m[3];
+    char *endptr;
+    size_t wend; char wsave;
+    static char *text = NULL; static size_t textcap = 0;
+    if (!compiled) { PAUSE(1) for (i = 0; i < NRULES; i++) if (regcomp(&res[i], pats[i], REG_EXTENDED)) abort(); compiled = true; PAUSE(0) }
+again:
+    if (pos >= len) return 0;
+    PAUSE(1)
+    n = 0;
+    wend = pos + 8192 < len ? pos + 8192 : len; wsave = buf[wend]; buf[wend] = 0;
+    for (i = 0; i < NRULES; i++) {
+        if (regexec(&res[i], buf + pos, 3, m, 0) == 0 && m[0].rm_eo > 0) {
+            cand_rule[n] = i; cand_total[n] = m[0].rm_eo;
+            cand_text[n] = (i == 19 || i == 20) ? (size_t)m[1].rm_eo : (size_t)m[0].rm_eo;
+            n++;
+        }
+    }
+    buf[wend] = wsave;
+    PAUSE(0)
+    /* stable sort by total length desc */
+    for (i = 1; i < n; i++) for (k = i; k > 0 && cand_total[k] > cand_total[k-1]; k--) {
+        size_t t;
+        t = cand_rule[k]; cand_rule[k] = cand_rule[k-1]; cand_rule[k-1] = t;
+        t = cand_total[k]; cand_total[k] = cand_total[k-1]; cand_total[k-1] = t;
+        t = cand_text[k]; cand_text[k] = cand_text[k-1]; cand_text[k-1] = t;
+    }
+    for (k = 0; k < n; k++) {
+        int saved_line = yylineno;
+        yyleng = cand_text[k];
+        if (textcap < (size_t)yyleng + 1) { textcap = yyleng + 1024; PAUSE(1) text = realloc(text, textcap); PAUSE(0) }
+        memcpy(text, buf + pos, yyleng); text[yyleng] = 0; yytext = text;
+        for (i = 0; i < (size_t)yyleng; i++) if (yytext[i] == '\n') yylineno++;
+        yylloc.first_line = yylloc.last_line = yylineno;
+#define REJECT { yylineno = saved_line; continue; }
+#define ACCEPT pos += yyleng;
+        switch (cand_rule[k]) {
+        case 0: case 1: ACCEPT goto again;
+        case 2: ACCEPT RESET_VARS; return T_SEMICOLON;
+        case 3: ACCEPT tmp = last_was_class; RESET_VARS; last_was_class = tmp; return T_COLON;
+        case 4: ACCEPT RESET_VARS; allow_arr = true; return T_COMMA;
+        case 5: ACCEPT RESET_VARS; return T_PLUS;
+        case 6: ACCEPT RESET_VARS; allow_val = true; return T_EQUALS;
+        case 7: ACCEPT RESET_VARS; return T_RBRACKET;
+        case 8: ACCEPT RESET_VARS; return T_LBRACKET;
+        case 9: ACCEPT RESET_VARS; return T_RBRACE;
+        case 10: ACCEPT tmp = !last_was_class; RESET_VARS; allow_arr = tmp; return T_LBRACE;
+        case 11: ACCEPT RESET_VARS; last_was_class = true; return T_CLASS;
+        case 12: ACCEPT RESET_VARS; return T_DELETE;
+        case 13: if (!allow_val && !allow_arr) REJECT; ACCEPT RESET_VARS; yylval.int_value = atol(yytext); return T_INT;
+        case 14: ACCEPT RESET_VARS; yylval.int_value = strtol(yytext, NULL, 16); return T_INT;
+        case 15: ACCEPT RESET_VARS; yylval.float_value = atof(yytext); return T_FLOAT;
+        case 16: ACCEPT RESET_VARS; yylval.string_value = arena_alloc(arena, yyleng + 1); strcpy(yylval.string_value, yytext); return T_STRING;
+        case 17: case 18: ACCEPT RESET_VARS; yylval.string_value = arena_alloc(arena, yyleng + 1); strcpy(yylval.string_value, yytext);
+            unescape_string(yylval.string_value, yyleng + 1); return T_STRING;
+        case 19: case 20:
+            if (cand_rule[k] == 19 ? !allow_val : !allow_arr) REJECT;
+            trim(yytext, yyleng + 1);
+            strtof(yytext, &endptr);
+            if (*endptr == 0) REJECT;
+            lnwarningf(lineref->file_names[lineref->file_index[yylineno]], lineref->line_number[yylineno],
+                    "unquoted-string", "String \"%s\" is not quoted properly.\n", yytext);
+            ACCEPT RESET_VARS; yylval.string_value = arena_alloc(arena, yyleng + 1); strcpy(yylval.string_value, yytext);
+            trim(yylval.string_value, yyleng + 1); return T_STRING;
+        case 21: if (allow_arr || allow_val) REJECT; ACCEPT
+            tmp = last_was_class; RESET_VARS; last_was_class = tmp;
+            yylval.string_value = arena_alloc(arena, yyleng + 1); strcpy(yylval.string_value, yytext); return T_NAME;
+        case 22: ACCEPT goto again;
+        }
+    }
+    pos++; goto again;
+}
+void restore_scan_buffer() {}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "simd.h"
+
+
+int detected_simd_level = SIMD_NONE;
+bool simd_ready = false;
+
+
+void simd_init() {
+    /*
+     * Detects the widest instruction set that is supported by both the
+     * build and the CPU. Setting ARMAKESIMD to "none" or "sse2" limits it
+     * further, e.g. to compare the kernels against the scalar code. Has to
+     * be called before the kernels are used on several threads.
+     */
+
+    char *limit;
+    int level;
+
+    if (simd_ready)
+        return;
+
+    level = SIMD_NONE;
+
+#ifdef SIMD_X86
+    if (__builtin_cpu_supports("sse2"))
+        level = SIMD_SSE2;
+    if (__builtin_cpu_supports("avx2"))
+        level = SIMD_AVX2;
+#endif
+
+    limit = getenv("ARMAKESIMD");
+    if (limit != NULL && strcmp(limit, "none") == 0)
+        level = SIMD_NONE;
+    if (limit != NULL && strcmp(limit, "sse2") == 0 && level > SIMD_SSE2)
+        level = SIMD_SSE2;
+
+    detected_simd_level = level;
+    simd_ready = true;
+}
+
+
+int simd_level() {
+    /*
+     * Returns the instruction set detected by simd_init, detecting it on
+     * the first call.
+     */
+
+    if (!simd_ready)
+        simd_init();
+
+    return detected_simd_level;
+}
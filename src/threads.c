@@ -0,0 +1,120 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "args.h"
+#include "utils.h"
+#include "threads.h"
+
+
+int get_num_jobs() {
+    /*
+     * Returns the number of worker threads requested with -j, defaulting to
+     * a single (the main) thread.
+     */
+
+    extern struct arguments args;
+    int num_jobs;
+
+    if (args.jobs == NULL)
+        return 1;
+
+    num_jobs = atoi(args.jobs);
+    return MAX(num_jobs, 1);
+}
+
+
+void *worker_thread(void *ptr) {
+    struct worker_pool *pool = (struct worker_pool *)ptr;
+    int success;
+    int i;
+
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (i >= pool->num_items)
+            break;
+
+        success = pool->callback(i, pool->data);
+        if (pool->results != NULL)
+            pool->results[i] = success;
+    }
+
+    return NULL;
+}
+
+
+int run_parallel(int num_items, int num_threads, int (*callback)(int, void *), void *data, int *results) {
+    /*
+     * Calls the callback once for every item index in [0, num_items) using
+     * up to num_threads threads (including the calling one) and stores the
+     * return values in results (which may be NULL for callbacks that can't
+     * fail). Items are handed out in order, but may finish in any order, so
+     * the callback must only touch its own item.
+     *
+     * Returns 0 on success. If some threads fail to start, the remaining
+     * ones (at least the calling thread) process all items anyway.
+     */
+
+    struct worker_pool pool;
+    pthread_t *threads;
+    int num_started;
+    int success;
+    int i;
+
+    pool.next = 0;
+    pool.num_items = num_items;
+    pool.callback = callback;
+    pool.data = data;
+    pool.results = results;
+
+    num_threads = MIN(num_threads, num_items);
+
+    if (num_threads <= 1) {
+        for (i = 0; i < num_items; i++) {
+            success = callback(i, data);
+            if (results != NULL)
+                results[i] = success;
+        }
+        return 0;
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+
+    threads = (pthread_t *)safe_malloc(sizeof(pthread_t) * (num_threads - 1));
+    for (num_started = 0; num_started < num_threads - 1; num_started++) {
+        if (pthread_create(&threads[num_started], NULL, worker_thread, &pool))
+            break;
+    }
+
+    worker_thread(&pool);
+
+    for (i = 0; i < num_started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+
+    return 0;
+}
@@ -58,7 +58,6 @@ bool is_garbage(struct header *header) {
 
 int cmd_inspect() {
     extern struct arguments args;
-    extern char *current_target;
     FILE *f_target;
     int num_files;
     long i;
@@ -164,7 +163,6 @@ int cmd_inspect() {
 
 int cmd_unpack() {
     extern struct arguments args;
-    extern char *current_target;
     FILE *f_source;
     FILE *f_target;
     int num_files;
@@ -363,7 +361,6 @@ int cmd_unpack() {
 
 int cmd_cat() {
     extern struct arguments args;
-    extern char *current_target;
     FILE *f_source;
     int num_files;
     int file_index;
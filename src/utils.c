@@ -24,12 +24,20 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include "args.h"
 #include "filesystem.h"
 #include "utils.h"
 
 
+__thread char *current_target = NULL;
+
+
 #ifdef _WIN32
 
 char *strndup(const char *s, size_t n) {
@@ -72,6 +80,30 @@ int stricmp(char *a, char *b) {
 #endif
 
 
+double get_milliseconds() {
+    /*
+     * Returns a monotonic timestamp in milliseconds, for measuring how long
+     * something took.
+     */
+
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return counter.QuadPart * 1000.0 / frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+
 void infof(char *format, ...) {
     char buffer[4096];
     va_list argptr;
@@ -80,13 +112,14 @@ void infof(char *format, ...) {
     vsnprintf(buffer, sizeof(buffer), format, argptr);
     va_end(argptr);
 
+    // stdout might be the binarized file
 #ifdef _WIN32
-    fprintf(stdout, "info: %s", buffer);
+    fprintf(stderr, "info: %s", buffer);
 #else
-    fprintf(stdout, "%sinfo:%s %s", COLOR_GREEN, COLOR_RESET, buffer);
+    fprintf(stderr, "%sinfo:%s %s", COLOR_GREEN, COLOR_RESET, buffer);
 #endif
 
-    fflush(stdout);
+    fflush(stderr);
 }
 
 
@@ -340,6 +373,23 @@ bool matches_glob(char *string, char *pattern) {
 }
 
 
+uint32_t hash_string(const char *string, size_t len) {
+    /*
+     * 32-bit FNV-1a hash of the first len characters of the string.
+     */
+
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)string[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
 bool float_equal(float f1, float f2, float precision) {
     /*
      * Performs a fuzzy float comparison.
@@ -618,32 +668,44 @@ void unescape_string(char *buffer, size_t buffsize) {
 }
 
 
-void write_compressed_int(uint32_t integer, FILE *f) {
+void write_compressed_int(uint32_t integer, struct buffer *buffer) {
     uint64_t temp;
     char c;
 
     temp = (uint64_t)integer;
 
     if (temp == 0) {
-        fwrite(&temp, 1, 1, f);
+        buffer_append_byte(buffer, 0);
     }
 
     while (temp > 0) {
         if (temp > 0x7f) {
             // there are going to be more entries
             c = 0x80 | (temp & 0x7f);
-            fwrite(&c, 1, 1, f);
+            buffer_append_byte(buffer, c);
             temp = temp >> 7;
         } else {
             // last entry
             c = temp;
-            fwrite(&c, 1, 1, f);
+            buffer_append_byte(buffer, c);
             temp = 0;
         }
     }
 }
 
 
+size_t compressed_int_size(uint32_t integer) {
+    size_t size = 1;
+
+    while (integer > 0x7f) {
+        integer = integer >> 7;
+        size++;
+    }
+
+    return size;
+}
+
+
 uint32_t read_compressed_int(FILE *f) {
     int i;
     uint64_t result;
@@ -661,3 +723,220 @@ uint32_t read_compressed_int(FILE *f) {
 
     return (uint32_t)result;
 }
+
+
+void buffer_init(struct buffer *buffer, size_t size) {
+    /*
+     * Initializes an empty growable in-memory buffer with the given initial
+     * capacity.
+     */
+
+    buffer->size = MAX(size, 16);
+    buffer->length = 0;
+    buffer->data = (char *)safe_malloc(buffer->size);
+}
+
+
+void buffer_reserve(struct buffer *buffer, size_t length) {
+    /*
+     * Makes sure that at least length more bytes fit into the buffer.
+     */
+
+    if (buffer->length + length <= buffer->size)
+        return;
+
+    while (buffer->length + length > buffer->size)
+        buffer->size *= 2;
+
+    buffer->data = (char *)safe_realloc(buffer->data, buffer->size);
+}
+
+
+void buffer_append(struct buffer *buffer, const void *data, size_t length) {
+    buffer_reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+
+void buffer_append_byte(struct buffer *buffer, uint8_t byte) {
+    buffer_reserve(buffer, 1);
+    buffer->data[buffer->length++] = byte;
+}
+
+
+void buffer_free(struct buffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->size = 0;
+}
+
+
+void arena_init(struct arena *arena, size_t chunk_size) {
+    /*
+     * Initializes an empty arena. Memory is handed out from chunks of the
+     * given size and can only be released all at once with arena_free.
+     */
+
+    arena->head = NULL;
+    arena->chunk_size = chunk_size;
+}
+
+
+void *arena_alloc(struct arena *arena, size_t size) {
+    struct arena_chunk *chunk;
+    size_t chunk_size;
+
+    // keep everything aligned for pointers and floats
+    size = (size + 7) & ~((size_t)7);
+
+    chunk = arena->head;
+    if (chunk == NULL || chunk->used + size > chunk->size) {
+        chunk_size = MAX(arena->chunk_size, size);
+
+        // the data follows the chunk header
+        chunk = (struct arena_chunk *)safe_malloc(sizeof(struct arena_chunk) + chunk_size);
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        // oversized allocations get their own chunk so the current one stays in use
+        if (chunk_size > arena->chunk_size && arena->head != NULL) {
+            chunk->next = arena->head->next;
+            arena->head->next = chunk;
+        } else {
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+    }
+
+    chunk->used += size;
+    return (char *)(chunk + 1) + chunk->used - size;
+}
+
+
+void arena_free(struct arena *arena) {
+    struct arena_chunk *chunk;
+    struct arena_chunk *next;
+
+    for (chunk = arena->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    arena->head = NULL;
+}
+
+
+void string_table_init(struct string_table *table) {
+    /*
+     * Initializes a table of interned strings. Every distinct string gets
+     * a 32-bit id, starting at 0 for the empty string, and
+     * table->strings[id] returns it again.
+     */
+
+    table->num_strings = 0;
+    table->strings = NULL;
+    table->size = 0;
+    table->slots = NULL;
+    arena_init(&table->arena, 65536);
+
+    string_table_add(table, "");
+}
+
+
+uint32_t string_table_add(struct string_table *table, const char *string) {
+    /*
+     * Returns the id of the given string, adding it to the table if it
+     * isn't in there yet.
+     */
+
+    uint32_t *old_slots;
+    uint32_t old_size;
+    uint32_t hash;
+    uint32_t i;
+    uint32_t j;
+    size_t len;
+
+    // keep the load factor below 1/2
+    if ((table->num_strings + 1) * 2 > table->size) {
+        old_slots = table->slots;
+        old_size = table->size;
+
+        table->size = (old_size == 0) ? STRINGINTERVAL : old_size * 2;
+        table->slots = (uint32_t *)safe_malloc(sizeof(uint32_t) * table->size);
+        memset(table->slots, 0, sizeof(uint32_t) * table->size);
+
+        for (i = 0; i < old_size; i++) {
+            if (old_slots[i] == 0)
+                continue;
+            hash = hash_string(table->strings[old_slots[i] - 1], strlen(table->strings[old_slots[i] - 1]));
+            for (j = hash & (table->size - 1); table->slots[j] != 0; j = (j + 1) & (table->size - 1));
+            table->slots[j] = old_slots[i];
+        }
+
+        free(old_slots);
+    }
+
+    len = strlen(string);
+    hash = hash_string(string, len);
+
+    for (i = hash & (table->size - 1); table->slots[i] != 0; i = (i + 1) & (table->size - 1)) {
+        if (strcmp(table->strings[table->slots[i] - 1], string) == 0)
+            return table->slots[i] - 1;
+    }
+
+    if (table->num_strings % STRINGINTERVAL == 0)
+        table->strings = (char **)safe_realloc(table->strings,
+                sizeof(char *) * (table->num_strings + STRINGINTERVAL));
+
+    table->strings[table->num_strings] = (char *)arena_alloc(&table->arena, len + 1);
+    memcpy(table->strings[table->num_strings], string, len + 1);
+
+    // slots hold id + 1, so 0 marks an empty slot
+    table->slots[i] = ++table->num_strings;
+
+    return table->num_strings - 1;
+}
+
+
+char *string_table_intern(struct string_table *table, const char *string) {
+    /*
+     * Same as string_table_add, but returns the interned copy. It stays
+     * valid until the table is freed.
+     */
+
+    return table->strings[string_table_add(table, string)];
+}
+
+
+uint32_t string_table_find(struct string_table *table, const char *string) {
+    /*
+     * Returns the id of the given string without adding it, or NOSTRING if
+     * it isn't in the table.
+     */
+
+    uint32_t i;
+
+    if (table->size == 0)
+        return NOSTRING;
+
+    for (i = hash_string(string, strlen(string)) & (table->size - 1); table->slots[i] != 0; i = (i + 1) & (table->size - 1)) {
+        if (strcmp(table->strings[table->slots[i] - 1], string) == 0)
+            return table->slots[i] - 1;
+    }
+
+    return NOSTRING;
+}
+
+
+void string_table_free(struct string_table *table) {
+    free(table->strings);
+    free(table->slots);
+    arena_free(&table->arena);
+
+    table->num_strings = 0;
+    table->strings = NULL;
+    table->size = 0;
+    table->slots = NULL;
+}
@@ -44,6 +44,9 @@
 #define OP_DERAPIFY 8
 #define OP_IMAGE 9
 
+#define STRINGINTERVAL 256
+#define NOSTRING UINT32_MAX
+
 
 struct point {
     float x;
@@ -52,17 +55,46 @@ struct point {
     uint32_t point_flags;
 };
 
-char *current_target;
+struct buffer {
+    char *data;
+    size_t length;
+    size_t size;
+};
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+};
+
+struct arena {
+    struct arena_chunk *head;
+    size_t chunk_size;
+};
+
+struct string_table {
+    uint32_t num_strings;
+    char **strings;
+    uint32_t size;
+    uint32_t *slots;
+    struct arena arena;
+};
+
+extern __thread char *current_target;
 
 
 #ifdef _WIN32
 char *strndup(const char *s, size_t n);
 
 char *strchrnul(const char *s, int c);
+
+#define strtok_r strtok_s
 #else
 int stricmp(char *a, char *b);
 #endif
 
+double get_milliseconds();
+
 void infof(char *format, ...);
 
 void debugf(char *format, ...);
@@ -89,6 +121,8 @@ void reverse_endianness(void *ptr, size_t buffsize);
 
 bool matches_glob(char *string, char *pattern);
 
+uint32_t hash_string(const char *string, size_t len);
+
 bool float_equal(float f1, float f2, float precision);
 
 int fsign(float f);
@@ -115,6 +149,34 @@ void escape_string(char *buffer, size_t buffsize);
 
 void unescape_string(char *buffer, size_t buffsize);
 
-void write_compressed_int(uint32_t integer, FILE *f);
+void write_compressed_int(uint32_t integer, struct buffer *buffer);
+
+size_t compressed_int_size(uint32_t integer);
 
 uint32_t read_compressed_int(FILE *f);
+
+void buffer_init(struct buffer *buffer, size_t size);
+
+void buffer_reserve(struct buffer *buffer, size_t length);
+
+void buffer_append(struct buffer *buffer, const void *data, size_t length);
+
+void buffer_append_byte(struct buffer *buffer, uint8_t byte);
+
+void buffer_free(struct buffer *buffer);
+
+void arena_init(struct arena *arena, size_t chunk_size);
+
+void *arena_alloc(struct arena *arena, size_t size);
+
+void arena_free(struct arena *arena);
+
+void string_table_init(struct string_table *table);
+
+uint32_t string_table_add(struct string_table *table, const char *string);
+
+char *string_table_intern(struct string_table *table, const char *string);
+
+uint32_t string_table_find(struct string_table *table, const char *string);
+
+void string_table_free(struct string_table *table);
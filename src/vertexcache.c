@@ -0,0 +1,276 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "utils.h"
+#include "vertexcache.h"
+
+
+#define NOFACE UINT32_MAX
+#define VALENCETABLESIZE 64
+
+// Scoring constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+#define CACHEDECAYPOWER 1.5f
+#define LASTFACESCORE 0.75f
+#define VALENCEBOOSTSCALE 2.0f
+#define VALENCEBOOSTPOWER 0.5f
+
+
+float vertex_score(const float *position_scores, const float *valence_scores,
+        int32_t cache_position, uint32_t remaining) {
+    float score;
+
+    // vertices without faces left don't matter anymore
+    if (remaining == 0)
+        return -1.0f;
+
+    score = (cache_position >= 0) ? position_scores[cache_position] : 0.0f;
+
+    if (remaining < VALENCETABLESIZE)
+        score += valence_scores[remaining];
+    else
+        score += VALENCEBOOSTSCALE * powf((float)remaining, -VALENCEBOOSTPOWER);
+
+    return score;
+}
+
+
+float face_score(const uint32_t *face_start, const uint32_t *indices, const float *scores, uint32_t face) {
+    uint32_t i;
+    float score;
+
+    score = 0.0f;
+    for (i = face_start[face]; i < face_start[face + 1]; i++)
+        score += scores[indices[i]];
+
+    return score;
+}
+
+
+void vertex_cache_optimize(uint32_t num_faces, const uint32_t *face_start, const uint32_t *indices,
+        uint32_t num_vertices, uint32_t *order) {
+    /*
+     * Orders the given faces for the post-transform vertex cache, following
+     * Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": the face whose
+     * vertices score highest is drawn next, where a vertex scores by its
+     * position in a simulated LRU cache and by how few faces still use it.
+     *
+     * Face i uses the vertices indices[face_start[i]] up to (excluding)
+     * indices[face_start[i + 1]]. order receives the face indices in their
+     * new order.
+     */
+
+    uint32_t i;
+    uint32_t j;
+    uint32_t k;
+    uint32_t n;
+    uint32_t v;
+    uint32_t face;
+    uint32_t best_face;
+    uint32_t next_face;
+    uint32_t max_face_size;
+    uint32_t num_cached;
+    uint32_t *cache;
+    uint32_t *new_cache;
+    uint32_t *vertex_faces_start;
+    uint32_t *vertex_faces;
+    uint32_t *remaining;
+    int32_t *cache_positions;
+    float *scores;
+    float *face_scores;
+    float best_score;
+    float position_scores[VERTEXCACHESIZE];
+    float valence_scores[VALENCETABLESIZE];
+    bool *emitted;
+
+    if (num_faces == 0)
+        return;
+
+    for (i = 0; i < VERTEXCACHESIZE; i++) {
+        // the vertices of the last face get a fixed score, so that the next
+        // face doesn't depend on the order they were added in
+        if (i < 3)
+            position_scores[i] = LASTFACESCORE;
+        else
+            position_scores[i] = powf(1.0f - (float)(i - 3) / (VERTEXCACHESIZE - 3), CACHEDECAYPOWER);
+    }
+
+    valence_scores[0] = 0.0f;
+    for (i = 1; i < VALENCETABLESIZE; i++)
+        valence_scores[i] = VALENCEBOOSTSCALE * powf((float)i, -VALENCEBOOSTPOWER);
+
+    // Faces of every vertex, the first remaining[v] of them are not drawn yet
+    vertex_faces_start = (uint32_t *)safe_malloc(sizeof(uint32_t) * (num_vertices + 1));
+    vertex_faces = (uint32_t *)safe_malloc(sizeof(uint32_t) * MAX(face_start[num_faces], 1));
+    remaining = (uint32_t *)safe_malloc(sizeof(uint32_t) * MAX(num_vertices, 1));
+
+    memset(vertex_faces_start, 0, sizeof(uint32_t) * (num_vertices + 1));
+    for (i = 0; i < face_start[num_faces]; i++)
+        vertex_faces_start[indices[i] + 1]++;
+    for (v = 0; v < num_vertices; v++)
+        vertex_faces_start[v + 1] += vertex_faces_start[v];
+
+    max_face_size = 0;
+    memset(remaining, 0, sizeof(uint32_t) * MAX(num_vertices, 1));
+    for (face = 0; face < num_faces; face++) {
+        max_face_size = MAX(max_face_size, face_start[face + 1] - face_start[face]);
+        for (i = face_start[face]; i < face_start[face + 1]; i++) {
+            v = indices[i];
+            vertex_faces[vertex_faces_start[v] + remaining[v]++] = face;
+        }
+    }
+
+    cache_positions = (int32_t *)safe_malloc(sizeof(int32_t) * MAX(num_vertices, 1));
+    scores = (float *)safe_malloc(sizeof(float) * MAX(num_vertices, 1));
+    for (v = 0; v < num_vertices; v++) {
+        cache_positions[v] = -1;
+        scores[v] = vertex_score(position_scores, valence_scores, -1, remaining[v]);
+    }
+
+    face_scores = (float *)safe_malloc(sizeof(float) * num_faces);
+    emitted = (bool *)safe_malloc(sizeof(bool) * num_faces);
+
+    best_face = 0;
+    best_score = -1.0f;
+    for (face = 0; face < num_faces; face++) {
+        emitted[face] = false;
+        face_scores[face] = face_score(face_start, indices, scores, face);
+        if (face_scores[face] > best_score) {
+            best_face = face;
+            best_score = face_scores[face];
+        }
+    }
+
+    cache = (uint32_t *)safe_malloc(sizeof(uint32_t) * (VERTEXCACHESIZE + max_face_size));
+    new_cache = (uint32_t *)safe_malloc(sizeof(uint32_t) * (VERTEXCACHESIZE + max_face_size));
+    num_cached = 0;
+    next_face = 0;
+
+    for (n = 0; n < num_faces; n++) {
+        // Nothing in the cache has faces left, continue in input order
+        if (best_face == NOFACE) {
+            while (emitted[next_face])
+                next_face++;
+            best_face = next_face;
+        }
+
+        order[n] = best_face;
+        emitted[best_face] = true;
+
+        // Take the face off its vertices and move them to the cache front,
+        // -2 marks vertices already in the new cache
+        k = 0;
+        for (i = face_start[best_face]; i < face_start[best_face + 1]; i++) {
+            v = indices[i];
+
+            for (j = vertex_faces_start[v]; vertex_faces[j] != best_face; j++);
+            vertex_faces[j] = vertex_faces[vertex_faces_start[v] + remaining[v] - 1];
+            vertex_faces[vertex_faces_start[v] + remaining[v] - 1] = best_face;
+            remaining[v]--;
+
+            if (cache_positions[v] != -2) {
+                cache_positions[v] = -2;
+                new_cache[k++] = v;
+            }
+        }
+
+        for (i = 0; i < num_cached; i++) {
+            if (cache_positions[cache[i]] != -2) {
+                cache_positions[cache[i]] = -2;
+                new_cache[k++] = cache[i];
+            }
+        }
+
+        // Rescore the cache, including the vertices that just dropped out
+        for (i = 0; i < k; i++) {
+            v = new_cache[i];
+            cache_positions[v] = (i < VERTEXCACHESIZE) ? (int32_t)i : -1;
+            scores[v] = vertex_score(position_scores, valence_scores, cache_positions[v], remaining[v]);
+        }
+
+        // The next face is the best one using a cached vertex
+        best_face = NOFACE;
+        best_score = -1.0f;
+        for (i = 0; i < k; i++) {
+            v = new_cache[i];
+            for (j = vertex_faces_start[v]; j < vertex_faces_start[v] + remaining[v]; j++) {
+                face = vertex_faces[j];
+                face_scores[face] = face_score(face_start, indices, scores, face);
+                if (i < VERTEXCACHESIZE && face_scores[face] > best_score) {
+                    best_face = face;
+                    best_score = face_scores[face];
+                }
+            }
+        }
+
+        num_cached = MIN(k, VERTEXCACHESIZE);
+        memcpy(cache, new_cache, sizeof(uint32_t) * num_cached);
+    }
+
+    free(cache);
+    free(new_cache);
+    free(emitted);
+    free(face_scores);
+    free(scores);
+    free(cache_positions);
+    free(remaining);
+    free(vertex_faces);
+    free(vertex_faces_start);
+}
+
+
+uint32_t vertex_cache_misses(uint32_t num_faces, const uint32_t *face_start, const uint32_t *indices,
+        uint32_t num_vertices, const uint32_t *order) {
+    /*
+     * Counts the misses of a FIFO vertex cache with VERTEXCACHEFIFO entries
+     * when drawing the given faces in the given order, or in their input
+     * order if order is NULL.
+     */
+
+    uint32_t i;
+    uint32_t n;
+    uint32_t v;
+    uint32_t face;
+    uint32_t misses;
+    uint32_t *inserted;
+
+    // inserted[v] is the number of misses after v was last added, 0 if never
+    inserted = (uint32_t *)safe_malloc(sizeof(uint32_t) * MAX(num_vertices, 1));
+    memset(inserted, 0, sizeof(uint32_t) * MAX(num_vertices, 1));
+
+    misses = 0;
+    for (n = 0; n < num_faces; n++) {
+        face = (order != NULL) ? order[n] : n;
+        for (i = face_start[face]; i < face_start[face + 1]; i++) {
+            v = indices[i];
+            if (inserted[v] == 0 || misses - inserted[v] >= VERTEXCACHEFIFO)
+                inserted[v] = ++misses;
+        }
+    }
+
+    free(inserted);
+
+    return misses;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C)  2016  Felix "KoffeinFlummi" Wiegand
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+
+/*
+ * The optimizer models an LRU cache of this many vertices, misses are
+ * counted for a FIFO cache of VERTEXCACHEFIFO vertices, which is closer to
+ * what GPUs actually do.
+ */
+#define VERTEXCACHESIZE 32
+#define VERTEXCACHEFIFO 16
+
+
+void vertex_cache_optimize(uint32_t num_faces, const uint32_t *face_start, const uint32_t *indices,
+        uint32_t num_vertices, uint32_t *order);
+
+uint32_t vertex_cache_misses(uint32_t num_faces, const uint32_t *face_start, const uint32_t *indices,
+        uint32_t num_vertices, const uint32_t *order);
@@ -0,0 +1,55 @@
+#!/bin/bash
+# Batch image conversion
+
+mkdir -p /tmp/amktest/source/sub || exit 1
+
+cp test/paa/test_alpha.png /tmp/amktest/source/alpha.png
+cp test/paa/test_alpha.png /tmp/amktest/source/sub/alpha.png
+touch -d "2000-01-01" /tmp/amktest/source/alpha.png /tmp/amktest/source/sub/alpha.png
+
+./bin/armake img2paa test/paa/test_alpha.png /tmp/amktest/single.paa
+./bin/armake img2paa -r -j 2 /tmp/amktest/source /tmp/amktest/target 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+cmp --silent /tmp/amktest/single.paa /tmp/amktest/target/alpha.paa &&
+        cmp --silent /tmp/amktest/single.paa /tmp/amktest/target/sub/alpha.paa || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# targets newer than their source are left alone, older ones are converted again
+echo "stale" > /tmp/amktest/target/alpha.paa
+echo "stale" > /tmp/amktest/target/sub/alpha.paa
+touch -d "1999-01-01" /tmp/amktest/target/sub/alpha.paa
+
+./bin/armake img2paa -r /tmp/amktest/source /tmp/amktest/target 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+grep --silent "stale" /tmp/amktest/target/alpha.paa &&
+        cmp --silent /tmp/amktest/single.paa /tmp/amktest/target/sub/alpha.paa || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake img2paa -r -f /tmp/amktest/source /tmp/amktest/target 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake paa2img /tmp/amktest/single.paa /tmp/amktest/single.png
+./bin/armake paa2img -r -j 2 /tmp/amktest/target /tmp/amktest/back 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+cmp --silent /tmp/amktest/single.png /tmp/amktest/back/alpha.png &&
+        cmp --silent /tmp/amktest/single.png /tmp/amktest/back/sub/alpha.png || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+rm -rf /tmp/amktest
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Binarization cache
+
+mkdir -p /tmp/amktest/src || exit 1
+
+echo "#define VALUE 42" > /tmp/amktest/src/macros.hpp
+printf '#include "macros.hpp"\nclass CfgTest { value = VALUE; };\n' > /tmp/amktest/src/config.cpp
+
+binarize() {
+    ./bin/armake binarize -f -c /tmp/amktest/cache /tmp/amktest/src/config.cpp $1
+}
+
+binarize /tmp/amktest/first.bin
+binarize /tmp/amktest/second.bin
+
+# the second call has to be served from the cache
+ls /tmp/amktest/cache/*.armake.dep > /dev/null 2>&1 &&
+    cmp --silent /tmp/amktest/first.bin /tmp/amktest/second.bin || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# changing an included file has to invalidate the entry
+echo "#define VALUE 43" > /tmp/amktest/src/macros.hpp
+binarize /tmp/amktest/third.bin
+./bin/armake derapify -f /tmp/amktest/third.bin /tmp/amktest/third.cpp
+
+grep -q "value = 43;" /tmp/amktest/third.cpp || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# rebinarizing a target that was served from the cache must leave the
+# cached file alone
+binarize /tmp/amktest/third.bin
+printf '#include "macros.hpp"\nclass CfgTest { value = 44; };\n' > /tmp/amktest/src/config.cpp
+binarize /tmp/amktest/third.bin
+printf '#include "macros.hpp"\nclass CfgTest { value = VALUE; };\n' > /tmp/amktest/src/config.cpp
+binarize /tmp/amktest/fourth.bin
+./bin/armake derapify -f /tmp/amktest/fourth.bin /tmp/amktest/fourth.cpp
+
+grep -q "value = 43;" /tmp/amktest/fourth.cpp || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# files binarized in build's temp folder are stored relative to it, so
+# they are still found by later builds
+./bin/armake build -f -c /tmp/amktest/buildcache /tmp/amktest/src /tmp/amktest/first.pbo
+./bin/armake build -f -c /tmp/amktest/buildcache /tmp/amktest/src /tmp/amktest/second.pbo
+
+grep -q "^R.*macros.hpp" /tmp/amktest/buildcache/*.armake.dep &&
+    cmp --silent /tmp/amktest/first.pbo /tmp/amktest/second.pbo || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+rm -rf /tmp/amktest
@@ -0,0 +1 @@
+#define COMMON_VALUE "common"
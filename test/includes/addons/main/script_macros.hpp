@@ -0,0 +1 @@
+#define MAIN_VALUE 42
@@ -0,0 +1,7 @@
+#include "\x\test\main\script_macros.hpp"
+#include "\x\test\common\sub\macros.hpp"
+
+class CfgTest {
+    main = MAIN_VALUE;
+    common = COMMON_VALUE;
+};
@@ -0,0 +1,14 @@
+#!/bin/bash
+# Include resolution
+
+mkdir -p /tmp/amktest || exit 1
+
+./bin/armake binarize -f -i test/includes/addons test/includes/config.cpp /tmp/amktest/config.bin
+./bin/armake derapify -f /tmp/amktest/config.bin /tmp/amktest/config.cpp
+
+grep -q "main = 42;" /tmp/amktest/config.cpp && grep -q "common = \"common\";" /tmp/amktest/config.cpp || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+rm -rf /tmp/amktest
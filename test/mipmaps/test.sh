@@ -0,0 +1,118 @@
+#!/bin/bash
+# Mipmap downsampling
+
+mkdir -p /tmp/amktest || exit 1
+
+cat > /tmp/amktest/downsample.c <<'C'
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+#include "downsample.h"
+
+int check(const unsigned char *src, bool linear, bool premultiply, const unsigned char expected[4]) {
+    unsigned char dest[4];
+
+    downsample_2x2(src, 2, 2, dest, linear, premultiply, SIMD_NONE);
+    if (memcmp(dest, expected, 4) == 0)
+        return 0;
+
+    fprintf(stderr, "got %i %i %i %i, expected %i %i %i %i\n", dest[0], dest[1], dest[2], dest[3],
+            expected[0], expected[1], expected[2], expected[3]);
+    return 1;
+}
+
+int main() {
+    // opaque red next to transparent green, and a black and white checkerboard
+    unsigned char alpha[16] = {255, 0, 0, 255,  0, 255, 0, 0,  255, 0, 0, 255,  0, 255, 0, 0};
+    unsigned char checker[16] = {0, 0, 0, 255,  255, 255, 255, 255,  255, 255, 255, 255,  0, 0, 0, 255};
+    unsigned char alpha_color[4] = {255, 0, 0, 128};
+    unsigned char alpha_data[4] = {128, 128, 0, 128};
+    unsigned char checker_color[4] = {188, 188, 188, 255};
+    unsigned char checker_data[4] = {128, 128, 128, 255};
+    unsigned char *src;
+    unsigned char *scalar;
+    unsigned char *vector;
+    int width = 70;
+    int height = 6;
+    int mode;
+    int i;
+
+    downsample_init();
+
+    if (check(alpha, true, true, alpha_color) || check(alpha, false, false, alpha_data) ||
+            check(checker, true, false, checker_color) || check(checker, false, false, checker_data))
+        return 1;
+
+    if (simd_level() < SIMD_AVX2)
+        return 0;
+
+    src = malloc(width * height * 4);
+    scalar = malloc(width * height);
+    vector = malloc(width * height);
+
+    srand(1);
+    for (i = 0; i < width * height * 4; i++)
+        src[i] = (i % 8 < 4) ? rand() % 256 : (rand() % 3) * 127;
+
+    for (mode = 0; mode < 3; mode++) {
+        downsample_2x2(src, width, height, scalar, mode > 0, mode > 1, SIMD_NONE);
+        downsample_2x2(src, width, height, vector, mode > 0, mode > 1, SIMD_AVX2);
+        if (memcmp(scalar, vector, width * height) != 0) {
+            fprintf(stderr, "AVX2 differs from scalar in mode %i\n", mode);
+            return 1;
+        }
+    }
+
+    free(src);
+    free(scalar);
+    free(vector);
+
+    return 0;
+}
+C
+
+cc -Isrc -Ilib -o /tmp/amktest/downsample /tmp/amktest/downsample.c src/downsample.c src/simd.c -lm || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+/tmp/amktest/downsample || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# data maps keep their plain average, color textures are averaged in linear light
+./bin/armake img2paa test/paa/test_alpha.png /tmp/amktest/test_ca.paa &&
+        ./bin/armake img2paa test/paa/test_alpha.png /tmp/amktest/test_nohq.paa || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+cmp --silent /tmp/amktest/test_ca.paa /tmp/amktest/test_nohq.paa && {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# the chain stops before sizes DXT blocks don't tile (48x24 -> 24x12, not 12x6),
+# so the output doesn't depend on the number of threads
+./bin/armake img2paa -V test/mipmaps/npot.png /tmp/amktest/npot.paa 2> /tmp/amktest/npot.txt || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+grep -q "2 mipmaps" /tmp/amktest/npot.txt || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+for i in 1 2 3 4; do
+    ./bin/armake img2paa -f -j 4 test/mipmaps/npot.png /tmp/amktest/npot_j4.paa &&
+            cmp --silent /tmp/amktest/npot.paa /tmp/amktest/npot_j4.paa || {
+        rm -rf /tmp/amktest
+        exit 1
+    }
+done
+
+rm -rf /tmp/amktest
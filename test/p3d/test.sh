@@ -0,0 +1,47 @@
+#!/bin/bash
+# P3D binarization
+
+mkdir -p /tmp/amktest || exit 1
+
+./bin/armake binarize -f -w unknown-bone test/p3d/test_model.p3d /tmp/amktest/serial.p3d || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake binarize -f -w unknown-bone -j 4 test/p3d/test_model.p3d /tmp/amktest/parallel.p3d || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+cmp --silent /tmp/amktest/serial.p3d /tmp/amktest/parallel.p3d || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake binarize -f -w unknown-bone -m test/p3d/test_model.p3d /tmp/amktest/optimized.p3d 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake binarize -f -w unknown-bone -m -j 4 test/p3d/test_model.p3d /tmp/amktest/optimized_parallel.p3d 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+cmp --silent /tmp/amktest/optimized.p3d /tmp/amktest/optimized_parallel.p3d || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# the hatch animation's selection is not a bone
+./bin/armake binarize -f test/p3d/test_model.p3d /tmp/amktest/warning.p3d 2> /tmp/amktest/warning.txt || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+grep --silent 'Failed to find bone "hatch" for animation "hatch"' /tmp/amktest/warning.txt || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+rm -rf /tmp/amktest
@@ -6,8 +6,33 @@ mkdir -p /tmp/amktest || exit 1
 ./bin/armake img2paa test/paa/test.png /tmp/amktest/test.paa
 ./bin/armake img2paa test/paa/test_alpha.png /tmp/amktest/test_alpha.paa
 
+./bin/armake img2paa -j 4 test/paa/test_alpha.png /tmp/amktest/test_alpha_parallel.paa
+
+cmp --silent /tmp/amktest/test_alpha.paa /tmp/amktest/test_alpha_parallel.paa || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+./bin/armake img2paa -z test/paa/test.png /tmp/amktest/test_lzo.paa
+./bin/armake img2paa -z -j 4 test/paa/test.png /tmp/amktest/test_lzo_parallel.paa
+
+cmp --silent /tmp/amktest/test_lzo.paa /tmp/amktest/test_lzo_parallel.paa || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+# all instruction sets have to pick the same endpoints
+./bin/armake img2paa -q best test/paa/test_alpha.png /tmp/amktest/test_best.paa
+ARMAKESIMD=none ./bin/armake img2paa -q best test/paa/test_alpha.png /tmp/amktest/test_best_scalar.paa
+
+cmp --silent /tmp/amktest/test_best.paa /tmp/amktest/test_best_scalar.paa || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
 ./bin/armake paa2img /tmp/amktest/test.paa /tmp/amktest/cmp.png
 ./bin/armake paa2img /tmp/amktest/test_alpha.paa /tmp/amktest/cmp_alpha.png
+./bin/armake paa2img /tmp/amktest/test_best.paa /tmp/amktest/cmp_best.png
 
 compare -metric AE -fuzz 5% test/paa/test.png /tmp/amktest/cmp.png /dev/null 2> /dev/null || {
     rm -rf /tmp/amktest
@@ -19,4 +44,9 @@ compare -metric AE -fuzz 8% test/paa/test_alpha.png /tmp/amktest/cmp_alpha.png /
     exit 1
 }
 
+compare -metric AE -fuzz 8% test/paa/test_alpha.png /tmp/amktest/cmp_best.png /dev/null 2> /dev/null || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
 rm -rf /tmp/amktest
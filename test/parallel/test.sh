@@ -0,0 +1,20 @@
+#!/bin/bash
+# Parallel binarization
+
+mkdir -p /tmp/amktest/sample || exit 1
+
+for i in $(seq 1 16); do
+    mkdir -p /tmp/amktest/sample/sub$i
+    cp test/rapification/config.cpp /tmp/amktest/sample/sub$i/config.cpp
+    head -c 256 < /dev/urandom > /tmp/amktest/sample/sub$i/foo
+done
+
+./bin/armake build -f -w unquoted-string /tmp/amktest/sample /tmp/amktest/serial.pbo
+./bin/armake build -f -j 4 -w unquoted-string /tmp/amktest/sample /tmp/amktest/parallel.pbo
+
+cmp --silent /tmp/amktest/serial.pbo /tmp/amktest/parallel.pbo || {
+    rm -rf /tmp/amktest
+    exit 1
+}
+
+rm -rf /tmp/amktest